@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include "Vector.h"
+
+/**
+ * Linear-space running mean of the frames rendered for an unchanged scene.
+ * Stochastic estimates (light sampling, thin lens) converge as frames accumulate.
+ */
+class FrameAccumulator {
+public:
+    FrameAccumulator(int width, int height) : width(width), height(height), mean(width * height) {}
+
+    /**
+     * Add a new sample of pixel (x, y)
+     * @param accumulatedFrames - frames already averaged for this scene, 0 restarts the mean
+     * @return averaged color
+     */
+    RGBColor add(int x, int y, const RGBColor &color, uint32_t accumulatedFrames) {
+        RGBColor &pixel = mean[y * width + x];
+        if (accumulatedFrames == 0)
+            pixel = color;
+        else
+            pixel += (color - pixel) / (float) (accumulatedFrames + 1);
+        return pixel;
+    }
+
+    /**
+     * Averaged colors, row by row
+     */
+    [[nodiscard]] const std::vector<RGBColor> &getColors() const {
+        return mean;
+    }
+
+    [[nodiscard]] int getWidth() const {
+        return width;
+    }
+
+    [[nodiscard]] int getHeight() const {
+        return height;
+    }
+
+private:
+    const int width, height;
+    std::vector<RGBColor> mean;
+};
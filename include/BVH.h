@@ -0,0 +1,196 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "BoundingBox.h"
+#include "Ray.h"
+
+/**
+ * Flat bounding volume hierarchy over abstract primitives given by their boxes.
+ * Nodes are stored depth first: the left child follows its parent, the right
+ * child index is kept in the parent. Leaves reference a range of getOrder().
+ */
+class BVHTree {
+public:
+    struct Node {
+        AABB box;
+        uint32_t offset; // leaf: first primitive in order, inner: right child
+        uint32_t count;  // leaf: primitive count, inner: 0
+    };
+
+    /**
+     * Build with a binned surface area heuristic
+     * @param boxes - primitive bounds
+     * @param maxLeafSize - leaves are never larger than this
+     */
+    void build(const std::vector<AABB> &boxes, uint32_t maxLeafSize = 4) {
+        nodes.clear();
+        order.resize(boxes.size());
+        for (uint32_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        if (boxes.empty())
+            return;
+        nodes.reserve(2 * boxes.size());
+        buildNode(boxes, 0, (uint32_t) boxes.size(), maxLeafSize, 0);
+    }
+
+    [[nodiscard]] bool isEmpty() const {
+        return nodes.empty();
+    }
+
+    [[nodiscard]] const std::vector<Node> &getNodes() const {
+        return nodes;
+    }
+
+    [[nodiscard]] const std::vector<uint32_t> &getOrder() const {
+        return order;
+    }
+
+    /**
+     * Rewrite leaf ranges, e.g. after packing primitives into leaf-sized blocks
+     * @param remap - (offset&, count&) for every leaf
+     */
+    template<typename Remap>
+    void remapLeaves(Remap &&remap) {
+        for (Node &node : nodes) {
+            if (node.count != 0)
+                remap(node.offset, node.count);
+        }
+    }
+
+    [[nodiscard]] AABB bounds() const {
+        return nodes.empty() ? AABB() : nodes[0].box;
+    }
+
+    /**
+     * Visit leaves hit by the ray, nearer subtrees first
+     * @param tMax - current farthest distance, leaves may shrink it
+     * @param visitLeaf - (first, count, tMax&) -> true to stop the traversal
+     */
+    template<typename Visitor>
+    void traverse(const Ray &ray, float &tMax, Visitor &&visitLeaf) const {
+        if (nodes.empty())
+            return;
+        const Vec3f invDir = 1.0f / ray.direction;
+        uint32_t stack[128];
+        int stackSize = 0;
+        uint32_t current = 0;
+        float tEntry = 0;
+        if (!nodes[0].box.intersect(ray.origin, invDir, tMax, tEntry))
+            return;
+        while (true) {
+            const Node &node = nodes[current];
+            if (node.count != 0) {
+                if (visitLeaf(node.offset, node.count, tMax))
+                    return;
+            } else {
+                const uint32_t left = current + 1, right = node.offset;
+                float tLeft = 0, tRight = 0;
+                const bool hitLeft = nodes[left].box.intersect(ray.origin, invDir, tMax, tLeft);
+                const bool hitRight = nodes[right].box.intersect(ray.origin, invDir, tMax, tRight);
+                if (hitLeft && hitRight) {
+                    const bool leftFirst = tLeft <= tRight;
+                    stack[stackSize++] = leftFirst ? right : left;
+                    current = leftFirst ? left : right;
+                    continue;
+                }
+                if (hitLeft || hitRight) {
+                    current = hitLeft ? left : right;
+                    continue;
+                }
+            }
+            if (stackSize == 0)
+                return;
+            current = stack[--stackSize];
+        }
+    }
+
+private:
+    constexpr static int kBins = 16;
+    constexpr static int kSahDepth = 32;
+
+    uint32_t buildNode(const std::vector<AABB> &boxes, uint32_t begin, uint32_t end, uint32_t maxLeafSize, int depth) {
+        const auto current = (uint32_t) nodes.size();
+        nodes.push_back({});
+        AABB box, centroids;
+        for (uint32_t i = begin; i < end; i++) {
+            box.extend(boxes[order[i]]);
+            centroids.extend(boxes[order[i]].centroid());
+        }
+        const uint32_t count = end - begin;
+        const int axis = centroids.largestAxis();
+        const float axisLow = centroids.low[axis], axisHigh = centroids.high[axis];
+        if (count <= maxLeafSize && (count <= 1 || axisHigh <= axisLow || depth >= kSahDepth)) {
+            nodes[current] = {box, begin, count};
+            return current;
+        }
+
+        uint32_t middle = begin + count / 2;
+        // past kSahDepth only median splits are made, which bounds the depth by kSahDepth + log2(count)
+        if (axisHigh > axisLow && depth < kSahDepth) {
+            AABB binBoxes[kBins];
+            uint32_t binCounts[kBins] = {};
+            const float binScale = kBins / (axisHigh - axisLow);
+            auto binOf = [&](uint32_t primitive) {
+                return min(kBins - 1, (int) ((boxes[primitive].centroid()[axis] - axisLow) * binScale));
+            };
+            for (uint32_t i = begin; i < end; i++) {
+                const int bin = binOf(order[i]);
+                binCounts[bin]++;
+                binBoxes[bin].extend(boxes[order[i]]);
+            }
+            float rightAreas[kBins];
+            uint32_t rightCounts[kBins];
+            AABB accumulated;
+            uint32_t accumulatedCount = 0;
+            for (int bin = kBins - 1; bin > 0; bin--) {
+                accumulated.extend(binBoxes[bin]);
+                accumulatedCount += binCounts[bin];
+                rightAreas[bin] = accumulated.surfaceArea();
+                rightCounts[bin] = accumulatedCount;
+            }
+            float bestCost = kBoxInfinity;
+            int bestSplit = -1;
+            accumulated = AABB();
+            accumulatedCount = 0;
+            for (int split = 1; split < kBins; split++) {
+                accumulated.extend(binBoxes[split - 1]);
+                accumulatedCount += binCounts[split - 1];
+                if (accumulatedCount == 0 || rightCounts[split] == 0)
+                    continue;
+                const float cost = accumulated.surfaceArea() * accumulatedCount + rightAreas[split] * rightCounts[split];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestSplit = split;
+                }
+            }
+            const float leafCost = box.surfaceArea() * count;
+            if (count <= maxLeafSize && (bestSplit < 0 || leafCost <= bestCost)) {
+                nodes[current] = {box, begin, count};
+                return current;
+            }
+            if (bestSplit > 0) {
+                middle = (uint32_t) (std::partition(order.begin() + begin, order.begin() + end,
+                                                    [&](uint32_t primitive) { return binOf(primitive) < bestSplit; })
+                                     - order.begin());
+            }
+        }
+        if (middle == begin || middle == end) {
+            middle = begin + count / 2;
+            std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                             [&](uint32_t a, uint32_t b) {
+                                 return boxes[a].centroid()[axis] < boxes[b].centroid()[axis];
+                             });
+        }
+
+        buildNode(boxes, begin, middle, maxLeafSize, depth + 1);
+        const uint32_t right = buildNode(boxes, middle, end, maxLeafSize, depth + 1);
+        nodes[current] = {box, right, 0};
+        return current;
+    }
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> order;
+};
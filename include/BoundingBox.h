@@ -0,0 +1,116 @@
+#pragma once
+
+#include <limits>
+
+#include "Vector.h"
+#include "Matrix.h"
+#include "GeometryHelpers.h"
+#include "Ray.h"
+#include "VectorPacket.h"
+
+static const float kBoxInfinity = std::numeric_limits<float>::max();
+
+/**
+ * Branchless slab test of the ray line against the box [low, high]
+ * @param invDir - component-wise inverse of the ray direction
+ * @param tEntry, tExit - where the line enters and leaves the box
+ */
+template<typename T>
+inline bool intersectSlabs(const Vec3<T> &low, const Vec3<T> &high, const Vec3<T> &orig, const Vec3<T> &invDir,
+                           T &tEntry, T &tExit) {
+    const Vec3<T> t1 = (low - orig) * invDir, t2 = (high - orig) * invDir;
+    tEntry = t1.minComponents(t2).maxComponent();
+    tExit = t1.maxComponents(t2).minComponent();
+    return tEntry <= tExit;
+}
+
+struct AABB {
+    Vec3f low = Vec3f(kBoxInfinity);
+    Vec3f high = Vec3f(-kBoxInfinity);
+
+    void extend(const Vec3f &point) {
+        low = low.minComponents(point);
+        high = high.maxComponents(point);
+    }
+
+    void extend(const AABB &box) {
+        extend(box.low);
+        extend(box.high);
+    }
+
+    [[nodiscard]] bool isEmpty() const {
+        return low[0] > high[0];
+    }
+
+    [[nodiscard]] Vec3f centroid() const {
+        return (low + high) * 0.5f;
+    }
+
+    [[nodiscard]] float surfaceArea() const {
+        if (isEmpty())
+            return 0;
+        const Vec3f d = high - low;
+        return 2 * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+    }
+
+    [[nodiscard]] int largestAxis() const {
+        const Vec3f d = high - low;
+        int axis = 0;
+        if (d[1] > d[axis])
+            axis = 1;
+        if (d[2] > d[axis])
+            axis = 2;
+        return axis;
+    }
+
+    /**
+     * Slab test
+     * @param invDir - component-wise inverse of the ray direction
+     * @param tMax - farthest distance of interest
+     * @param tEntry - distance where the ray enters the box
+     */
+    [[nodiscard]] bool intersect(const Vec3f &orig, const Vec3f &invDir, float tMax, float &tEntry) const {
+        float tExit = 0;
+        return intersectSlabs(low, high, orig, invDir, tEntry, tExit) && tExit >= 0 && tEntry <= tMax;
+    }
+
+    /**
+     * Slab test of 8 rays sharing orig, the same as the one of a single ray lane by lane
+     * @return lanes of the rays that reach the box within their tMax
+     */
+    [[nodiscard]] mask8 intersect(const Vec3f &orig, const Vec3x8 &invDirs, const float8 &tMax) const {
+        float8 tEntry = 0, tExit = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            const float8 t1 = (low[axis] - orig[axis]) * invDirs[axis];
+            const float8 t2 = (high[axis] - orig[axis]) * invDirs[axis];
+            const float8 near = __builtin_elementwise_min(t1, t2), far = __builtin_elementwise_max(t1, t2);
+            tEntry = axis == 0 ? near : __builtin_elementwise_max(tEntry, near);
+            tExit = axis == 0 ? far : __builtin_elementwise_min(tExit, far);
+        }
+        return (tEntry <= tExit) & (tExit >= 0) & (tEntry <= tMax);
+    }
+};
+
+/**
+ * Bounds of the eight transformed corners of box
+ */
+inline AABB transformBox(const AABB &box, const Matrix4x4f &transform) {
+    AABB result;
+    for (int corner = 0; corner < 8; corner++) {
+        const Vec3f point((corner & 1) ? box.high[0] : box.low[0],
+                          (corner & 2) ? box.high[1] : box.low[1],
+                          (corner & 4) ? box.high[2] : box.low[2]);
+        result.extend(transform.multVecMatrix(point));
+    }
+    return result;
+}
+
+/**
+ * Lengths the unit axes get from transform, whose rows are their images
+ */
+inline Vec3f axisLengths(const Matrix4x4f &transform) {
+    float lengths[3];
+    for (int row = 0; row < 3; row++)
+        lengths[row] = Vec3f(transform.get(row, 0), transform.get(row, 1), transform.get(row, 2)).length();
+    return {lengths[0], lengths[1], lengths[2]};
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "Vector.h"
+#include "Matrix.h"
+#include "GeometryHelpers.h"
+#include "SceneProperties.h"
+#include "Random.h"
+
+constexpr int kRayRowCapacity = 32;
+
+/**
+ * Structure of arrays for a horizontal run of camera rays.
+ * Origins are filled only when perRayOrigin is set, otherwise all rays
+ * start at Camera::getOrigin().
+ */
+struct RayRow {
+    alignas(32) float originX[kRayRowCapacity];
+    alignas(32) float originY[kRayRowCapacity];
+    alignas(32) float originZ[kRayRowCapacity];
+    alignas(32) float dirX[kRayRowCapacity];
+    alignas(32) float dirY[kRayRowCapacity];
+    alignas(32) float dirZ[kRayRowCapacity];
+    bool perRayOrigin = false;
+
+    [[nodiscard]] Vec3f origin(int k) const {
+        return {originX[k], originY[k], originZ[k]};
+    }
+
+    [[nodiscard]] Vec3f direction(int k) const {
+        return {dirX[k], dirY[k], dirZ[k]};
+    }
+};
+
+/**
+ * Per-frame camera. Everything that depends only on options is computed once:
+ * the unnormalized world direction of pixel (i, j) is
+ * corner + i * stepX + j * stepY, so a row is produced by stepping instead
+ * of a matrix multiplication per pixel.
+ */
+class Camera {
+public:
+    explicit Camera(const SceneOptions &options) : projection(options.projection),
+                                                   aperture(options.aperture),
+                                                   focusDistance(options.focusDistance) {
+        const Matrix4x4f &cameraToWorld = options.cameraToWorld;
+        const float imageAspectRatio = options.width / (float) options.height;
+        origin = cameraToWorld.multVecMatrix(Vec3f(0));
+        right = cameraToWorld.multDirMatrix(Vec3f(1, 0, 0));
+        up = cameraToWorld.multDirMatrix(Vec3f(0, 1, 0));
+        forward = cameraToWorld.multDirMatrix(Vec3f(0, 0, -1));
+
+        // orthographic rays spread over the view plane instead of the image plane at z = -1
+        const float scale = (projection == Projection::Orthographic) ?
+                            options.orthoHeight * 0.5f : tan(deg2rad(options.fov * 0.5));
+        const float halfWidth = imageAspectRatio * scale, halfHeight = scale;
+        stepX = right * (2 * halfWidth / (float) options.width);
+        stepY = up * (-2 * halfHeight / (float) options.height);
+        corner = right * (halfWidth * (1.0f / options.width - 1)) +
+                 up * (halfHeight * (1 - 1.0f / options.height));
+        if (projection != Projection::Orthographic)
+            corner += forward;
+        forward.normalize();
+        right.normalize();
+        up.normalize();
+    }
+
+    [[nodiscard]] const Vec3f &getOrigin() const {
+        return origin;
+    }
+
+    /**
+     * World size of a pixel at distance along a ray, for texture filtering
+     */
+    [[nodiscard]] float footprint(float distance) const {
+        const float spacing = stepY.length();
+        return projection == Projection::Orthographic ? spacing : spacing * distance;
+    }
+
+    /**
+     * Generate count rays of row j starting at column i
+     * @param seed - frame seed for stochastic projections
+     */
+    void generateRow(int j, int i, int count, RayRow &rays, uint32_t seed = 0) const {
+        switch (projection) {
+            case Projection::Pinhole:
+                generatePinhole(j, i, count, rays);
+                break;
+            case Projection::ThinLens:
+                generateThinLens(j, i, count, rays, seed);
+                break;
+            case Projection::Orthographic:
+                generateOrthographic(j, i, count, rays);
+                break;
+        }
+    }
+
+private:
+    static void normalizeRow(int count, RayRow &rays) {
+#pragma clang loop vectorize(enable)
+        for (int k = 0; k < count; k++) {
+            const float length2 = rays.dirX[k] * rays.dirX[k] + rays.dirY[k] * rays.dirY[k] +
+                                  rays.dirZ[k] * rays.dirZ[k];
+            const float factor = 1 / sqrtf(length2);
+            rays.dirX[k] *= factor;
+            rays.dirY[k] *= factor;
+            rays.dirZ[k] *= factor;
+        }
+    }
+
+    /**
+     * Writes unnormalized pinhole directions of the row
+     */
+    void stepRow(int j, int i, int count, RayRow &rays) const {
+        const Vec3f start = corner + stepX * (float) i + stepY * (float) j;
+        const float startX = start[0], startY = start[1], startZ = start[2];
+        const float dx = stepX[0], dy = stepX[1], dz = stepX[2];
+#pragma clang loop vectorize(enable)
+        for (int k = 0; k < count; k++) {
+            rays.dirX[k] = startX + dx * k;
+            rays.dirY[k] = startY + dy * k;
+            rays.dirZ[k] = startZ + dz * k;
+        }
+    }
+
+    void generatePinhole(int j, int i, int count, RayRow &rays) const {
+        rays.perRayOrigin = false;
+        stepRow(j, i, count, rays);
+        normalizeRow(count, rays);
+    }
+
+    void generateThinLens(int j, int i, int count, RayRow &rays, uint32_t seed) const {
+        rays.perRayOrigin = true;
+        stepRow(j, i, count, rays);
+        const float lensRadius = aperture * 0.5f;
+        for (int k = 0; k < count; k++) {
+            // the pinhole direction has unit depth, so it reaches the focal plane at focusDistance
+            const Vec3f focus = origin + rays.direction(k) * focusDistance;
+            Sampler sampler(i + k, j, seed, SampleStream::Lens);
+            const float r = lensRadius * sqrt(sampler.nextFloat());
+            const float theta = 2 * M_PI * sampler.nextFloat();
+            const Vec3f lensPoint = origin + right * (r * cos(theta)) + up * (r * sin(theta));
+            const Vec3f dir = focus - lensPoint;
+            rays.originX[k] = lensPoint[0];
+            rays.originY[k] = lensPoint[1];
+            rays.originZ[k] = lensPoint[2];
+            rays.dirX[k] = dir[0];
+            rays.dirY[k] = dir[1];
+            rays.dirZ[k] = dir[2];
+        }
+        normalizeRow(count, rays);
+    }
+
+    void generateOrthographic(int j, int i, int count, RayRow &rays) const {
+        rays.perRayOrigin = true;
+        stepRow(j, i, count, rays);
+        const float ox = origin[0], oy = origin[1], oz = origin[2];
+        const float fx = forward[0], fy = forward[1], fz = forward[2];
+#pragma clang loop vectorize(enable)
+        for (int k = 0; k < count; k++) {
+            rays.originX[k] = ox + rays.dirX[k];
+            rays.originY[k] = oy + rays.dirY[k];
+            rays.originZ[k] = oz + rays.dirZ[k];
+            rays.dirX[k] = fx;
+            rays.dirY[k] = fy;
+            rays.dirZ[k] = fz;
+        }
+    }
+
+    Projection projection;
+    float aperture, focusDistance;
+    Vec3f origin;
+    Vec3f right, up, forward;
+    Vec3f corner, stepX, stepY;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Vector.h"
+#include "Matrix.h"
+#include "SceneProperties.h"
+
+/**
+ * Camera moves of the interactive controls, shared by the window and the render server
+ */
+enum class CameraMove : uint32_t {
+    Forward, Back, Left, Right, Up, Down, YawLeft, YawRight, PitchUp, PitchDown, Pause
+};
+
+/**
+ * Turn the camera about the scene origin, its orientation in float and its position in double
+ */
+inline void rotateCamera(const Matrix4x4f &rotation, SceneOptions &options) {
+    options.cameraToWorld *= rotation;
+    const Vec3d eye = options.eye;
+    double turned[3];
+    for (int col = 0; col < 3; col++)
+        turned[col] = eye[0] * rotation.get(0, col) + eye[1] * rotation.get(1, col) + eye[2] * rotation.get(2, col);
+    options.eye = Vec3d(turned[0], turned[1], turned[2]);
+}
+
+/**
+ * @param step - distance of a move, angle of a turn in radians
+ */
+inline void applyCameraMove(CameraMove move, float step, SceneOptions &options, bool &paused) {
+    const Vec3f forward = options.cameraToWorld.multDirMatrix(Vec3f(0, 0, -1)) * step;
+    const Vec3f up = options.cameraToWorld.multDirMatrix(Vec3f(0, 1, 0)) * step;
+    const Vec3f left = options.cameraToWorld.multDirMatrix(Vec3f(-1, 0, 0)) * step;
+    const Vec3d dirForward(forward[0], forward[1], forward[2]);
+    const Vec3d dirUp(up[0], up[1], up[2]);
+    const Vec3d dirLeft(left[0], left[1], left[2]);
+    switch (move) {
+        case CameraMove::Forward:
+            options.eye += dirForward;
+            break;
+        case CameraMove::Back:
+            options.eye += -dirForward;
+            break;
+        case CameraMove::Left:
+            options.eye += dirLeft;
+            break;
+        case CameraMove::Right:
+            options.eye += -dirLeft;
+            break;
+        case CameraMove::Up:
+            options.eye += dirUp;
+            break;
+        case CameraMove::Down:
+            options.eye += -dirUp;
+            break;
+        case CameraMove::YawLeft:
+            rotateCamera(Matrix4x4f::rotY(-step), options);
+            break;
+        case CameraMove::YawRight:
+            rotateCamera(Matrix4x4f::rotY(step), options);
+            break;
+        case CameraMove::PitchUp:
+            rotateCamera(Matrix4x4f::rotX(step), options);
+            break;
+        case CameraMove::PitchDown:
+            rotateCamera(Matrix4x4f::rotX(-step), options);
+            break;
+        case CameraMove::Pause:
+            paused = !paused;
+            break;
+    }
+}
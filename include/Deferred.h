@@ -0,0 +1,281 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include "GBuffer.h"
+#include "Denoiser.h"
+#include "Raycasting.h"
+
+/**
+ * Visibility pass of one tile: nearest hit, normal and textured albedo of every pixel
+ */
+void fillGBufferTile(const SceneSnapshot &scene, const Camera &camera, GBuffer &gbuffer,
+                     RenderStats &stats, int tileX, int tileY) {
+    const SceneOptions &options = scene.getOptions();
+    const MaterialTable &materials = scene.getMaterials();
+    const int x0 = tileX * kTileSize, y0 = tileY * kTileSize;
+    const int width = min(kTileSize, (int) options.width - x0);
+    const int height = min(kTileSize, (int) options.height - y0);
+    const SdfCounters sdfBefore = sdfCounters();
+    RayRow rays;
+    for (int j = 0; j < height; ++j) {
+        camera.generateRow(y0 + j, x0, width, rays, scene.getFrame());
+        for (int k = 0; k < width; ++k) {
+            const size_t i = gbuffer.index(x0 + k, y0 + j);
+            const Vec3f orig = rays.perRayOrigin ? rays.origin(k) : camera.getOrigin();
+            const Vec3f dir = rays.direction(k);
+            float tNear = 0;
+            uint32_t primitive = 0;
+            const HittableObject *object = trace(orig, dir, scene.getGeometry(), tNear, &primitive);
+            gbuffer.viewX[i] = dir[0];
+            gbuffer.viewY[i] = dir[1];
+            gbuffer.viewZ[i] = dir[2];
+            if (object == nullptr) {
+                gbuffer.depth[i] = kInfinity;
+                continue;
+            }
+            const Vec3f point = hitPoint(*object, orig, dir, tNear, options.precision);
+            const Vec3f normal = object->getPrimitiveNormal(point, dir, primitive);
+            const Material &material = materials.get(object->materialId);
+            const RGBColor albedo = materials.surfaceColor(material, *object, point, primitive,
+                                                           camera.footprint(tNear));
+            // shadow rays start at the stored position
+            const Vec3f position = secondaryRayOrigin(*object, orig, dir, tNear, point, normal);
+            gbuffer.positionX[i] = position[0];
+            gbuffer.positionY[i] = position[1];
+            gbuffer.positionZ[i] = position[2];
+            gbuffer.normalX[i] = normal[0];
+            gbuffer.normalY[i] = normal[1];
+            gbuffer.normalZ[i] = normal[2];
+            gbuffer.albedoR[i] = albedo[0];
+            gbuffer.albedoG[i] = albedo[1];
+            gbuffer.albedoB[i] = albedo[2];
+            gbuffer.depth[i] = tNear;
+            gbuffer.materialId[i] = object->materialId;
+        }
+    }
+    stats.sdfMarches = sdfCounters().marches - sdfBefore.marches;
+    stats.sdfSteps = sdfCounters().steps - sdfBefore.steps;
+}
+
+constexpr int kShadeChunk = 64;
+
+/**
+ * Lighting pass over count <= kShadeChunk pixels of row y starting at column x0.
+ * Point and hard distant lights are evaluated one light at a time over the whole
+ * chunk in vectorized loops; only the shadow rays of pixels the light reaches are
+ * traced one by one. Light tree sampling and lights with an extent go through
+ * the per-pixel kernels of the forward renderer.
+ */
+void shadeGBufferChunk(const SceneSnapshot &scene, const GBuffer &gbuffer, int x0, int y, int count,
+                       OccluderCache &occluders, std::vector<uint32_t> &lightStorage, RGBColor *colors) {
+    const SceneOptions &options = scene.getOptions();
+    const MaterialTable &materials = scene.getMaterials();
+    const SceneBVH &geometry = scene.getGeometry();
+    const size_t first = gbuffer.index(x0, y);
+    const float *px = &gbuffer.positionX[first], *py = &gbuffer.positionY[first], *pz = &gbuffer.positionZ[first];
+    const float *nx = &gbuffer.normalX[first], *ny = &gbuffer.normalY[first], *nz = &gbuffer.normalZ[first];
+    const float *vx = &gbuffer.viewX[first], *vy = &gbuffer.viewY[first], *vz = &gbuffer.viewZ[first];
+
+    alignas(32) float mask[kShadeChunk];
+    alignas(32) uint32_t shininess[kShadeChunk];
+    Vec3f low(kInfinity), high(-kInfinity);
+    bool anyHit = false;
+    for (int k = 0; k < count; k++) {
+        const bool hit = gbuffer.isHit(first + k);
+        mask[k] = hit ? 1.f : 0.f;
+        shininess[k] = (uint32_t) materials.get(gbuffer.materialId[first + k]).n;
+        if (hit) {
+            low = low.minComponents(gbuffer.position(first + k));
+            high = high.maxComponents(gbuffer.position(first + k));
+            anyHit = true;
+        }
+    }
+    if (!anyHit) {
+        for (int k = 0; k < count; k++)
+            colors[k] = options.backgroundColor;
+        return;
+    }
+
+    alignas(32) float diffuse[3][kShadeChunk] = {}, specular[3][kShadeChunk] = {};
+    alignas(32) float dirX[kShadeChunk], dirY[kShadeChunk], dirZ[kShadeChunk];
+    alignas(32) float distance[kShadeChunk], weight[kShadeChunk];
+    alignas(32) float cosine[kShadeChunk], highlight[kShadeChunk];
+
+    // dir*, distance and weight describe the light at every pixel, weight is 0 on misses
+    auto accumulate = [&](const RGBColor &power, size_t slot) {
+#pragma clang loop vectorize(enable)
+        for (int k = 0; k < count; k++) {
+            const float dot = dirX[k] * nx[k] + dirY[k] * ny[k] + dirZ[k] * nz[k];
+            cosine[k] = max(0.f, -dot);
+            const float rx = dirX[k] - 2 * dot * nx[k], ry = dirY[k] - 2 * dot * ny[k], rz = dirZ[k] - 2 * dot * nz[k];
+            highlight[k] = maskedPow(max(0.f, -(rx * vx[k] + ry * vy[k] + rz * vz[k])), shininess[k]);
+        }
+        for (int k = 0; k < count; k++) {
+            if (weight[k] <= 0 || (cosine[k] <= 0 && highlight[k] <= 0))
+                continue;
+            SurfaceHit hit = {};
+            hit.point = gbuffer.position(first + k);
+            hit.occluders = &occluders;
+            if (isOccluded(hit, Vec3f(-dirX[k], -dirY[k], -dirZ[k]), distance[k], geometry, slot))
+                weight[k] = 0;
+        }
+        for (int channel = 0; channel < 3; channel++) {
+            const float scale = power[channel];
+#pragma clang loop vectorize(enable)
+            for (int k = 0; k < count; k++) {
+                diffuse[channel][k] += weight[k] > 0 ? scale * weight[k] * cosine[k] : 0.f;
+                specular[channel][k] += weight[k] > 0 ? scale * weight[k] * highlight[k] : 0.f;
+            }
+        }
+    };
+
+    const std::vector<PointLight> &pointLights = scene.getPointLights();
+    if (scene.getLightTree().isEmpty()) {
+        const LightList visible = cullLights(scene, low, high, lightStorage);
+        for (size_t i = 0; i < visible.count; i++) {
+            const PointLight &light = pointLights[visible.indices[i]];
+            const Vec3f &position = light.getPosition();
+            const float lx = position[0], ly = position[1], lz = position[2];
+#pragma clang loop vectorize(enable)
+            for (int k = 0; k < count; k++) {
+                const float dx = px[k] - lx, dy = py[k] - ly, dz = pz[k] - lz;
+                const float r2 = dx * dx + dy * dy + dz * dz;
+                const float inverse = 1 / sqrtf(r2);
+                dirX[k] = dx * inverse;
+                dirY[k] = dy * inverse;
+                dirZ[k] = dz * inverse;
+                distance[k] = r2 * inverse;
+                weight[k] = mask[k] > 0 ? 1 / r2 : 0.f;
+            }
+            accumulate(light.color * light.intensity / (4 * M_PI), visible.indices[i]);
+        }
+    }
+    const std::vector<DistantLight> &distantLights = scene.getDistantLights();
+    for (size_t i = 0; i < distantLights.size(); i++) {
+        Vec3f lightDir, lightIntensity;
+        float lightDistance = 0;
+        distantLights[i].illuminate(0, lightDir, lightIntensity, lightDistance);
+        for (int k = 0; k < count; k++) {
+            dirX[k] = lightDir[0];
+            dirY[k] = lightDir[1];
+            dirZ[k] = lightDir[2];
+            distance[k] = lightDistance;
+            weight[k] = mask[k];
+        }
+        accumulate(lightIntensity, pointLights.size() + i);
+    }
+
+    const size_t softDistantSlot = pointLights.size() + distantLights.size();
+    const size_t sphereSlot = softDistantSlot + scene.getSoftDistantLights().size();
+    const size_t rectSlot = sphereSlot + scene.getSphereLights().size();
+    const size_t otherSlot = rectSlot + scene.getRectLights().size();
+    const FastList<Light *> &others = scene.getOtherLights();
+    const bool perPixel = !scene.getLightTree().isEmpty() || otherSlot > softDistantSlot || others.getSize() > 0;
+
+    for (int k = 0; k < count; k++) {
+        const size_t i = first + k;
+        if (mask[k] <= 0) {
+            colors[k] = options.backgroundColor;
+            continue;
+        }
+        const Material &material = materials.get(gbuffer.materialId[i]);
+        const RGBColor albedo(gbuffer.albedoR[i], gbuffer.albedoG[i], gbuffer.albedoB[i]);
+        Vec3f pixelDiffuse(diffuse[0][k], diffuse[1][k], diffuse[2][k]);
+        Vec3f pixelSpecular(specular[0][k], specular[1][k], specular[2][k]);
+        if (perPixel) {
+            Sampler sampler(x0 + k, y, scene.getFrame(), SampleStream::Lighting);
+            const SurfaceHit hit = {gbuffer.position(i), gbuffer.normal(i), gbuffer.view(i), nullptr, &material,
+                                    albedo, &sampler, &occluders};
+            if (!scene.getLightTree().isEmpty())
+                accumulateSampledLights<0>(scene, hit, geometry, pixelDiffuse, pixelSpecular);
+            accumulateAreaLights<0>(scene.getSoftDistantLights(), softDistantSlot, hit, scene, pixelDiffuse, pixelSpecular);
+            accumulateAreaLights<0>(scene.getSphereLights(), sphereSlot, hit, scene, pixelDiffuse, pixelSpecular);
+            accumulateAreaLights<0>(scene.getRectLights(), rectSlot, hit, scene, pixelDiffuse, pixelSpecular);
+            size_t slot = otherSlot;
+            for (size_t lightIndex = others.begin(); lightIndex != others.end(); others.nextIterator(&lightIndex), slot++) {
+                Light *light = nullptr;
+                others.get(lightIndex, &light);
+                shadeLight<0>(*light, slot, hit, geometry, 1, pixelDiffuse, pixelSpecular);
+            }
+        }
+        colors[k] = material.albedo * pixelDiffuse * material.Kd * albedo +
+                    pixelSpecular * material.Ks * albedo + material.ambient;
+    }
+}
+
+/**
+ * Deferred counterpart of render(): the G-buffer of the whole frame is filled
+ * tile by tile first, then lit row by row. With a denoiser and options.denoiseIterations
+ * the lit (and accumulated) frame is filtered before gamma packing.
+ * All passes are timed into stats.
+ */
+void renderDeferred(const SceneSnapshotPtr &scene, SDL_Surface *surface, ThreadPool &pool, GBuffer &gbuffer,
+                    FrameAccumulator *accumulator = nullptr, RenderStats *stats = nullptr,
+                    Denoiser *denoiser = nullptr) {
+    const SceneSnapshotPtr keepAlive = scene;
+    const SceneOptions &options = scene->getOptions();
+    const Camera camera(options);
+    const int tilesX = ((int) options.width + kTileSize - 1) / kTileSize;
+    const int tilesY = ((int) options.height + kTileSize - 1) / kTileSize;
+    RenderStats frameStats;
+    std::mutex statsLock;
+    if (options.denoiseIterations == 0)
+        denoiser = nullptr;
+
+    auto timeStart = std::chrono::high_resolution_clock::now();
+    pool.parallelFor(tilesX * tilesY, [&, tilesX](size_t tile) {
+        RenderStats tileStats;
+        fillGBufferTile(*keepAlive, camera, gbuffer, tileStats, (int) tile % tilesX, (int) tile / tilesX);
+        std::lock_guard<std::mutex> guard(statsLock);
+        frameStats += tileStats;
+    });
+    auto timeVisible = std::chrono::high_resolution_clock::now();
+
+    pool.parallelFor(options.height, [&](size_t row) {
+        thread_local std::vector<uint32_t> chunkLights;
+        thread_local OccluderCache occluders;
+        occluders.reset(keepAlive->getLights().getSize());
+        occluders.stats = {};
+        const int y = (int) row;
+        RGBColor colors[kShadeChunk];
+        for (int x0 = 0; x0 < (int) options.width; x0 += kShadeChunk) {
+            const int count = min(kShadeChunk, (int) options.width - x0);
+            kernels().shadeChunk(*keepAlive, gbuffer, x0, y, count, occluders, chunkLights, colors);
+            for (int k = 0; k < count; k++) {
+                if (accumulator != nullptr)
+                    colors[k] = accumulator->add(x0 + k, y, colors[k], options.accumulatedFrames);
+                if (denoiser != nullptr)
+                    denoiser->store(gbuffer, gbuffer.index(x0 + k, y), colors[k]);
+            }
+            if (denoiser == nullptr)
+                kernels().packRow(colors, count, getPixelPtr(surface, x0, y));
+        }
+        std::lock_guard<std::mutex> guard(statsLock);
+        frameStats += occluders.stats;
+    });
+    auto timeShaded = std::chrono::high_resolution_clock::now();
+
+    if (denoiser != nullptr) {
+        denoiser->filter(gbuffer, (int) options.width, (int) options.height, options.denoiseIterations, pool);
+        pool.parallelFor(options.height, [&](size_t row) {
+            const int y = (int) row;
+            RGBColor colors[kShadeChunk];
+            for (int x0 = 0; x0 < (int) options.width; x0 += kShadeChunk) {
+                const int count = min(kShadeChunk, (int) options.width - x0);
+                for (int k = 0; k < count; k++)
+                    colors[k] = denoiser->color(gbuffer, gbuffer.index(x0 + k, y));
+                kernels().packRow(colors, count, getPixelPtr(surface, x0, y));
+            }
+        });
+    }
+    auto timeEnd = std::chrono::high_resolution_clock::now();
+
+    frameStats.visibilityTime = std::chrono::duration<float, std::milli>(timeVisible - timeStart).count();
+    frameStats.shadingTime = std::chrono::duration<float, std::milli>(timeShaded - timeVisible).count();
+    frameStats.denoiseTime = std::chrono::duration<float, std::milli>(timeEnd - timeShaded).count();
+    if (stats != nullptr)
+        *stats += frameStats;
+}
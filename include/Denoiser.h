@@ -0,0 +1,138 @@
+#pragma once
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Vector.h"
+#include "GeometryHelpers.h"
+#include "GBuffer.h"
+#include "Shading.h"
+#include "ThreadPool.h"
+
+/**
+ * e^x for x <= 0 without calls, so loops using it vectorize. Relative error below 2e-4.
+ */
+inline float fastExp(float x) {
+    const float t = max(x, -80.f) * 1.44269504f;
+    const float whole = floorf(t), f = t - whole;
+    const float fraction = 1 + f * (0.69606564f + f * (0.22449434f + f * 0.07944024f));
+    return std::bit_cast<float>(std::bit_cast<int32_t>(fraction) + ((int32_t) whole << 23));
+}
+
+/**
+ * Edge-avoiding a-trous wavelet filter (Dammertz et al.) over a deferred frame.
+ * Colors are divided by the G-buffer albedo on the way in and multiplied back on
+ * the way out, so textures stay sharp and only lighting is smoothed. Each pass is
+ * a 5 x 5 B3-spline with taps spread 2^pass pixels apart, weighted by normal,
+ * depth, albedo and color similarity; the color tolerance halves every pass.
+ */
+class Denoiser {
+public:
+    Denoiser(int width, int height) {
+        const size_t size = (size_t) width * height;
+        for (auto channel : {&colorR, &colorG, &colorB, &scratchR, &scratchG, &scratchB})
+            channel->assign(size, 0);
+    }
+
+    /**
+     * Set the noisy color of pixel i of the G-buffer
+     */
+    void store(const GBuffer &gbuffer, size_t i, const RGBColor &color) {
+        colorR[i] = color[0] / max(gbuffer.albedoR[i], kMinAlbedo);
+        colorG[i] = color[1] / max(gbuffer.albedoG[i], kMinAlbedo);
+        colorB[i] = color[2] / max(gbuffer.albedoB[i], kMinAlbedo);
+    }
+
+    [[nodiscard]] RGBColor color(const GBuffer &gbuffer, size_t i) const {
+        return {colorR[i] * max(gbuffer.albedoR[i], kMinAlbedo),
+                colorG[i] * max(gbuffer.albedoG[i], kMinAlbedo),
+                colorB[i] * max(gbuffer.albedoB[i], kMinAlbedo)};
+    }
+
+    /**
+     * Filter the frameWidth x frameHeight corner in place, tile-parallel on pool
+     */
+    void filter(const GBuffer &gbuffer, int frameWidth, int frameHeight, uint32_t iterations, ThreadPool &pool) {
+        const int tilesX = (frameWidth + kTileWidth - 1) / kTileWidth;
+        const int tilesY = (frameHeight + kTileHeight - 1) / kTileHeight;
+        float colorSigma = kColorSigma;
+        for (uint32_t pass = 0; pass < iterations; pass++, colorSigma *= 0.5f) {
+            const int step = 1 << pass;
+            pool.parallelFor(tilesX * tilesY, [&, step, colorSigma, tilesX](size_t tile) {
+                const int x0 = (int) (tile % tilesX) * kTileWidth, y0 = (int) (tile / tilesX) * kTileHeight;
+                filterTile(gbuffer, frameWidth, frameHeight, x0, y0, step, colorSigma);
+            });
+            colorR.swap(scratchR);
+            colorG.swap(scratchG);
+            colorB.swap(scratchB);
+        }
+    }
+
+private:
+    constexpr static int kTileWidth = 64, kTileHeight = 16;
+    constexpr static float kMinAlbedo = 0.01;
+    constexpr static uint32_t kNormalPower = 64;
+    constexpr static float kDepthSigma = 0.02;     // relative to the depth, per pixel of tap spacing
+    constexpr static float kAlbedoSigma2 = 0.01;
+    constexpr static float kColorSigma = 0.6;      // first pass, in units of demodulated color
+
+    /**
+     * One pass over a tile, from color* into scratch*. Misses are copied through.
+     */
+    void filterTile(const GBuffer &gbuffer, int frameWidth, int frameHeight, int x0, int y0,
+                    int step, float colorSigma) {
+        const float kernel[5] = {1 / 16.f, 1 / 4.f, 3 / 8.f, 1 / 4.f, 1 / 16.f};
+        const float inverseColorSigma2 = 1 / (colorSigma * colorSigma);
+        const float *depth = gbuffer.depth.data();
+        const float *nx = gbuffer.normalX.data(), *ny = gbuffer.normalY.data(), *nz = gbuffer.normalZ.data();
+        const float *ar = gbuffer.albedoR.data(), *ag = gbuffer.albedoG.data(), *ab = gbuffer.albedoB.data();
+        const float *cr = colorR.data(), *cg = colorG.data(), *cb = colorB.data();
+        const int count = min(kTileWidth, frameWidth - x0);
+        const int y1 = min(y0 + kTileHeight, frameHeight);
+        for (int y = y0; y < y1; y++) {
+            const size_t row = gbuffer.index(x0, y);
+            alignas(32) float sumR[kTileWidth] = {}, sumG[kTileWidth] = {}, sumB[kTileWidth] = {};
+            alignas(32) float sumWeight[kTileWidth] = {};
+            for (int dy = -2; dy <= 2; dy++) {
+                const size_t tapRow = gbuffer.index(0, max(0, min(frameHeight - 1, y + dy * step)));
+                for (int dx = -2; dx <= 2; dx++) {
+                    const float spline = kernel[dy + 2] * kernel[dx + 2];
+#pragma clang loop vectorize(enable)
+                    for (int k = 0; k < count; k++) {
+                        const size_t p = row + k;
+                        const size_t q = tapRow + max(0, min(frameWidth - 1, x0 + k + dx * step));
+                        const float cosine = max(0.f, nx[p] * nx[q] + ny[p] * ny[q] + nz[p] * nz[q]);
+                        const float depthTerm = fabsf(depth[p] - depth[q]) / (kDepthSigma * step * depth[p] + 1e-4f);
+                        const float albedoDelta = (ar[p] - ar[q]) * (ar[p] - ar[q]) + (ag[p] - ag[q]) * (ag[p] - ag[q]) +
+                                                  (ab[p] - ab[q]) * (ab[p] - ab[q]);
+                        const float colorDelta = (cr[p] - cr[q]) * (cr[p] - cr[q]) + (cg[p] - cg[q]) * (cg[p] - cg[q]) +
+                                                 (cb[p] - cb[q]) * (cb[p] - cb[q]);
+                        const float similarity = fastExp(-(depthTerm + albedoDelta * (1 / kAlbedoSigma2) +
+                                                           colorDelta * inverseColorSigma2));
+                        const float weight = depth[q] < kInfinity ?
+                                             spline * maskedPow(cosine, kNormalPower) * similarity : 0.f;
+                        sumR[k] += weight * cr[q];
+                        sumG[k] += weight * cg[q];
+                        sumB[k] += weight * cb[q];
+                        sumWeight[k] += weight;
+                    }
+                }
+            }
+#pragma clang loop vectorize(enable)
+            for (int k = 0; k < count; k++) {
+                const size_t p = row + k;
+                const bool filtered = depth[p] < kInfinity && sumWeight[k] > 0;
+                const float inverse = filtered ? 1 / sumWeight[k] : 0.f;
+                scratchR[p] = filtered ? sumR[k] * inverse : cr[p];
+                scratchG[p] = filtered ? sumG[k] * inverse : cg[p];
+                scratchB[p] = filtered ? sumB[k] * inverse : cb[p];
+            }
+        }
+    }
+
+    std::vector<float> colorR, colorG, colorB;
+    std::vector<float> scratchR, scratchG, scratchB;
+};
@@ -48,6 +48,20 @@ public:
         init();
     }
 
+    /**
+     * Lists own their storage, so implicit copies would share and free it twice.
+     * Use copy() for an explicit deep copy.
+     */
+    FastList(const FastList &other) = delete;
+
+    FastList &operator=(const FastList &other) = delete;
+
+    FastList(FastList &&other) noexcept : storage(other.storage), optimized(other.optimized),
+                                          capacity(other.capacity), size(other.size),
+                                          freePtr(other.freePtr), freeSize(other.freeSize) {
+        other.storage = nullptr;
+    }
+
     ~FastList(){
         dest();
     }
@@ -69,8 +83,8 @@ public:
     }
 
     void dest() {
-        storage = nullptr;
         free(this->storage);
+        storage = nullptr;
     }
 
     static FastList *New() {
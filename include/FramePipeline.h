@@ -0,0 +1,155 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Raycasting.h"
+#include "Deferred.h"
+#include "SDLHelpers.h"
+#include "SceneSnapshot.h"
+#include "ThreadPool.h"
+
+struct RenderedFrame {
+    SceneSnapshotPtr scene;
+    SDL_Surface *surface = nullptr;
+    size_t buffer = 0;
+    float renderTime = 0; // ms
+    RenderStats stats;
+};
+
+/**
+ * Renders frames asynchronously into a ring of framebuffers.
+ * Framebuffers are allocated once at the largest resolution; every frame is
+ * rendered into the top-left options.width x options.height corner.
+ * While the driver thread renders frame N, the main thread presents N-1
+ * and simulates N+1. At most framesInFlight frames are submitted and not yet
+ * acquired, which bounds latency; submit() blocks when all buffers are busy.
+ */
+class FramePipeline {
+public:
+    FramePipeline(int width, int height, size_t framesInFlight, ThreadPool &pool) :
+            pool(pool), framesInFlight(framesInFlight < 1 ? 1 : framesInFlight), accumulator(width, height),
+            gbuffer(width, height), denoiser(width, height) {
+        for (size_t i = 0; i < this->framesInFlight; i++) {
+            buffers.push_back(createSurface(width, height));
+            freeBuffers.push_back(i);
+        }
+        driver = std::thread(&FramePipeline::driverLoop, this);
+    }
+
+    FramePipeline(const FramePipeline &other) = delete;
+
+    FramePipeline &operator=(const FramePipeline &other) = delete;
+
+    ~FramePipeline() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        changed.notify_all();
+        driver.join();
+        for (auto buffer: buffers)
+            freeSurface(buffer);
+    }
+
+    /**
+     * Queue snapshot for rendering. Blocks until a framebuffer is free.
+     */
+    void submit(SceneSnapshotPtr scene) {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [this]() { return !freeBuffers.empty(); });
+        RenderedFrame frame = {std::move(scene), buffers[freeBuffers.front()], freeBuffers.front()};
+        freeBuffers.pop_front();
+        pending.push_back(std::move(frame));
+        inFlight++;
+        changed.notify_all();
+    }
+
+    /**
+     * Wait for the oldest submitted frame. Returns false if nothing is in flight.
+     */
+    bool acquire(RenderedFrame &frame) {
+        std::unique_lock<std::mutex> guard(lock);
+        if (inFlight == 0)
+            return false;
+        changed.wait(guard, [this]() { return !finished.empty(); });
+        frame = std::move(finished.front());
+        finished.pop_front();
+        inFlight--;
+        return true;
+    }
+
+    /**
+     * Return presented framebuffer to the ring
+     */
+    void release(RenderedFrame &frame) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            freeBuffers.push_back(frame.buffer);
+        }
+        frame.scene.reset();
+        frame.surface = nullptr;
+        changed.notify_all();
+    }
+
+    /**
+     * True when the pipeline is full and the oldest frame should be presented
+     */
+    [[nodiscard]] bool shouldPresent() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return inFlight >= framesInFlight;
+    }
+
+    [[nodiscard]] size_t getFramesInFlight() const {
+        return framesInFlight;
+    }
+
+private:
+    void driverLoop() {
+        while (true) {
+            RenderedFrame frame;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [this]() { return stopping || !pending.empty(); });
+                if (pending.empty())
+                    return;
+                frame = std::move(pending.front());
+                pending.pop_front();
+            }
+            auto timeStart = std::chrono::high_resolution_clock::now();
+            frame.stats = {};
+            const SceneOptions &options = frame.scene->getOptions();
+            if (options.deferredShading || options.denoiseIterations > 0)
+                renderDeferred(frame.scene, frame.surface, pool, gbuffer, &accumulator, &frame.stats, &denoiser);
+            else
+                render(frame.scene, frame.surface, pool, &accumulator, &frame.stats);
+            auto timeEnd = std::chrono::high_resolution_clock::now();
+            frame.renderTime = std::chrono::duration<float, std::milli>(timeEnd - timeStart).count();
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                finished.push_back(std::move(frame));
+            }
+            changed.notify_all();
+        }
+    }
+
+    ThreadPool &pool;
+    const size_t framesInFlight;
+    // frames are rendered one at a time, so a single accumulator, G-buffer and denoiser are enough
+    FrameAccumulator accumulator;
+    GBuffer gbuffer;
+    Denoiser denoiser;
+    std::vector<SDL_Surface *> buffers;
+    std::deque<size_t> freeBuffers;
+    std::deque<RenderedFrame> pending;
+    std::deque<RenderedFrame> finished;
+    size_t inFlight = 0;
+    bool stopping = false;
+    mutable std::mutex lock;
+    std::condition_variable changed;
+    std::thread driver;
+};
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "GeometryHelpers.h"
+#include "SDLHelpers.h"
+
+enum class StreamFormat {
+    Rgb,    // rows of 8-bit r, g, b without a header
+    Y4m,    // YUV4MPEG2, 4:2:0 BT.601 studio range
+};
+
+/**
+ * Streams frames to a file, a named pipe or stdout for an external encoder.
+ * push() copies a frame into a ring of reusable buffers and returns; a writer
+ * thread converts and writes them in order. push() only waits when every buffer
+ * is still queued for writing, and those waits are counted as stalls.
+ */
+class FrameSink {
+public:
+    explicit FrameSink(size_t buffers) : buffers(buffers < 1 ? 1 : buffers) {}
+
+    FrameSink(const FrameSink &other) = delete;
+
+    FrameSink &operator=(const FrameSink &other) = delete;
+
+    ~FrameSink() {
+        close();
+    }
+
+    /**
+     * Start streaming width x height frames to path, "-" for stdout.
+     * Opening a named pipe waits for its reader.
+     * @param fps - frame rate written into the y4m header
+     */
+    bool open(const char *path, StreamFormat format, int width, int height, int fps) {
+        // a reader that goes away should end the stream, not the process
+        signal(SIGPIPE, SIG_IGN);
+        file = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+        if (file == nullptr) {
+            fprintf(stderr, "Can't open %s: %s\n", path, strerror(errno));
+            return false;
+        }
+        this->format = format;
+        this->width = width;
+        this->height = height;
+        if (format == StreamFormat::Y4m)
+            fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+        for (size_t i = 0; i < buffers.size(); i++) {
+            buffers[i].resize((size_t) width * height);
+            freeBuffers.push_back(i);
+        }
+        writer = std::thread(&FrameSink::writerLoop, this);
+        return true;
+    }
+
+    /**
+     * Queue the top-left width x height corner of surface
+     * @return false once writing failed
+     */
+    bool push(SDL_Surface *surface) {
+        std::unique_lock<std::mutex> guard(lock);
+        if (freeBuffers.empty() && !failed) {
+            auto timeStart = std::chrono::high_resolution_clock::now();
+            changed.wait(guard, [this]() { return !freeBuffers.empty() || failed; });
+            stalls++;
+            stallTime += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() -
+                                                                  timeStart).count();
+        }
+        if (failed)
+            return false;
+        const size_t buffer = freeBuffers.front();
+        freeBuffers.pop_front();
+        guard.unlock();
+
+        for (int y = 0; y < height; y++)
+            memcpy(&buffers[buffer][(size_t) y * width], getPixelPtr(surface, 0, y), width * 4);
+
+        guard.lock();
+        filledBuffers.push_back(buffer);
+        pushed++;
+        changed.notify_all();
+        return true;
+    }
+
+    /**
+     * Write the queued frames and close the file
+     */
+    void close() {
+        if (!writer.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        changed.notify_all();
+        writer.join();
+        if (file == stdout)
+            fflush(file);
+        else
+            fclose(file);
+        file = nullptr;
+    }
+
+    [[nodiscard]] bool isOpen() const {
+        return writer.joinable();
+    }
+
+    [[nodiscard]] size_t getFrames() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return pushed;
+    }
+
+    /**
+     * Pushes that waited for a free buffer, and their total wait in ms
+     */
+    [[nodiscard]] size_t getStalls() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return stalls;
+    }
+
+    [[nodiscard]] float getStallTime() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return stallTime;
+    }
+
+private:
+    void writerLoop() {
+        std::vector<uint8_t> converted;
+        while (true) {
+            size_t buffer = 0;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [this]() { return stopping || !filledBuffers.empty(); });
+                if (filledBuffers.empty())
+                    return;
+                buffer = filledBuffers.front();
+                filledBuffers.pop_front();
+            }
+            if (format == StreamFormat::Y4m) {
+                convertYuv420(buffers[buffer], converted);
+                fputs("FRAME\n", file);
+            } else {
+                convertRgb(buffers[buffer], converted);
+            }
+            const bool written = fwrite(converted.data(), 1, converted.size(), file) == converted.size();
+            if (!written)
+                fprintf(stderr, "\nCan't write the stream: %s\n", strerror(errno));
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                freeBuffers.push_back(buffer);
+                failed = failed || !written;
+            }
+            changed.notify_all();
+            if (!written)
+                return;
+        }
+    }
+
+    void convertRgb(const std::vector<uint32_t> &pixels, std::vector<uint8_t> &out) const {
+        out.resize(pixels.size() * 3);
+        for (size_t i = 0; i < pixels.size(); i++)
+            memcpy(&out[i * 3], &pixels[i], 3);
+    }
+
+    /**
+     * Full-resolution luma, then both chroma planes from the average of every 2x2 block
+     */
+    void convertYuv420(const std::vector<uint32_t> &pixels, std::vector<uint8_t> &out) const {
+        const int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+        const size_t lumaSize = (size_t) width * height, chromaSize = (size_t) chromaWidth * chromaHeight;
+        out.resize(lumaSize + 2 * chromaSize);
+        for (size_t i = 0; i < lumaSize; i++) {
+            const auto *rgb = (const uint8_t *) &pixels[i];
+            out[i] = (uint8_t) (((66 * rgb[0] + 129 * rgb[1] + 25 * rgb[2] + 128) >> 8) + 16);
+        }
+        uint8_t *u = &out[lumaSize], *v = u + chromaSize;
+        for (int y = 0; y < chromaHeight; y++) {
+            for (int x = 0; x < chromaWidth; x++) {
+                int sum[3] = {}, count = 0;
+                for (int j = 2 * y; j < min(2 * y + 2, height); j++) {
+                    for (int i = 2 * x; i < min(2 * x + 2, width); i++) {
+                        const auto *rgb = (const uint8_t *) &pixels[(size_t) j * width + i];
+                        for (int c = 0; c < 3; c++)
+                            sum[c] += rgb[c];
+                        count++;
+                    }
+                }
+                const int r = sum[0] / count, g = sum[1] / count, b = sum[2] / count;
+                u[(size_t) y * chromaWidth + x] = (uint8_t) (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+                v[(size_t) y * chromaWidth + x] = (uint8_t) (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+            }
+        }
+    }
+
+    std::vector<std::vector<uint32_t>> buffers;
+    std::deque<size_t> freeBuffers;
+    std::deque<size_t> filledBuffers;
+    FILE *file = nullptr;
+    StreamFormat format = StreamFormat::Y4m;
+    int width = 0, height = 0;
+    size_t pushed = 0;
+    size_t stalls = 0;
+    float stallTime = 0;
+    bool stopping = false;
+    bool failed = false;
+    mutable std::mutex lock;
+    std::condition_variable changed;
+    std::thread writer;
+};
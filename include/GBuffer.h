@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "Vector.h"
+#include "Matrix.h"
+#include "GeometryHelpers.h"
+#include "Light.h"
+
+/**
+ * Visible surface of every pixel, one array per component so that a row of
+ * any attribute is contiguous. Allocated once at the largest resolution;
+ * a frame uses its top-left width x height corner with the full row stride.
+ * Pixels without a hit have infinite depth.
+ */
+struct GBuffer {
+    GBuffer(int width, int height) : width(width), height(height) {
+        const size_t size = (size_t) width * height;
+        for (auto channel : {&positionX, &positionY, &positionZ, &normalX, &normalY, &normalZ,
+                             &viewX, &viewY, &viewZ, &albedoR, &albedoG, &albedoB})
+            channel->assign(size, 0);
+        depth.assign(size, kInfinity);
+        materialId.assign(size, 0);
+    }
+
+    [[nodiscard]] size_t index(int x, int y) const {
+        return (size_t) y * width + x;
+    }
+
+    [[nodiscard]] bool isHit(size_t i) const {
+        return depth[i] < kInfinity;
+    }
+
+    [[nodiscard]] Vec3f position(size_t i) const {
+        return {positionX[i], positionY[i], positionZ[i]};
+    }
+
+    [[nodiscard]] Vec3f normal(size_t i) const {
+        return {normalX[i], normalY[i], normalZ[i]};
+    }
+
+    [[nodiscard]] Vec3f view(size_t i) const {
+        return {viewX[i], viewY[i], viewZ[i]};
+    }
+
+    const int width, height;
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> normalX, normalY, normalZ;
+    std::vector<float> viewX, viewY, viewZ;         // unit primary ray direction
+    std::vector<float> albedoR, albedoG, albedoB;   // material color with textures applied
+    std::vector<float> depth;                       // distance along the primary ray
+    std::vector<uint32_t> materialId;
+};
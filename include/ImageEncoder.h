@@ -0,0 +1,383 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "GeometryHelpers.h"
+#include "Qoi.h"
+#include "SDLHelpers.h"
+#include "ThreadPool.h"
+#include "Vector.h"
+
+constexpr int kPngStripRows = 64;       // rows deflated independently, so strips compress in parallel
+constexpr int kExrBlockRows = 16;       // rows of an OpenEXR ZIP block
+constexpr size_t kMaxQueuedImages = 8;
+
+inline void putLittleEndian(std::vector<uint8_t> &out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        out.push_back((uint8_t) (value >> (8 * i)));
+}
+
+/**
+ * IEEE half float, rounded to nearest even
+ */
+inline uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = (bits >> 16) & 0x8000;
+    const int exponent = (int) ((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (((bits >> 23) & 0xff) == 0xff)
+        return (uint16_t) (sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+    if (exponent >= 31)
+        return (uint16_t) (sign | 0x7c00);
+    if (exponent <= 0) {
+        if (exponent < -10)
+            return (uint16_t) sign;
+        mantissa |= 0x800000;
+        const int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1)))
+            half++;
+        return (uint16_t) (sign | half);
+    }
+    // a carry out of the mantissa correctly moves to the next exponent
+    uint32_t half = sign | (uint32_t) exponent << 10 | mantissa >> 13;
+    const uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return (uint16_t) half;
+}
+
+inline void appendPngChunk(std::vector<uint8_t> &out, const char *type, const std::vector<uint8_t> &data) {
+    putBigEndian(out, (uint32_t) data.size());
+    const size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    putBigEndian(out, (uint32_t) crc32(0, &out[start], (uInt) (data.size() + 4)));
+}
+
+/**
+ * Append an 8-bit RGB PNG. Rows use the Up filter; every strip of kPngStripRows rows is
+ * deflated on its own on pool and the raw deflate streams are joined into one zlib stream,
+ * all but the last ending on a byte-aligned sync flush.
+ * @param level - zlib level, 0 to 9
+ */
+inline bool encodePng(const uint32_t *pixels, int width, int height, int stride, int level, ThreadPool &pool,
+                      std::vector<uint8_t> &out) {
+    const size_t strips = (height + kPngStripRows - 1) / kPngStripRows;
+    const size_t rowSize = 1 + (size_t) width * 3;
+    std::vector<std::vector<uint8_t>> compressed(strips);
+    std::vector<uLong> checksums(strips);
+    std::atomic<bool> failed = false;
+    pool.parallelFor(strips, [&](size_t strip) {
+        const int y0 = (int) strip * kPngStripRows, y1 = min(y0 + kPngStripRows, height);
+        std::vector<uint8_t> filtered(rowSize * (y1 - y0));
+        for (int y = y0; y < y1; y++) {
+            uint8_t *row = &filtered[(y - y0) * rowSize];
+            const auto *current = (const uint8_t *) (pixels + (size_t) y * stride);
+            const auto *above = (const uint8_t *) (pixels + (size_t) (y - 1) * stride);
+            row[0] = 2;
+            for (int x = 0; x < width; x++) {
+                for (int c = 0; c < 3; c++)
+                    row[1 + x * 3 + c] = (uint8_t) (current[x * 4 + c] - (y > 0 ? above[x * 4 + c] : 0));
+            }
+        }
+        checksums[strip] = adler32(adler32(0, nullptr, 0), filtered.data(), (uInt) filtered.size());
+
+        z_stream stream = {};
+        if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            failed = true;
+            return;
+        }
+        std::vector<uint8_t> &target = compressed[strip];
+        target.resize(deflateBound(&stream, filtered.size()) + 16);
+        stream.next_in = filtered.data();
+        stream.avail_in = (uInt) filtered.size();
+        stream.next_out = target.data();
+        stream.avail_out = (uInt) target.size();
+        const bool last = strip + 1 == strips;
+        const int status = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+        if (status != (last ? Z_STREAM_END : Z_OK) || stream.avail_in != 0)
+            failed = true;
+        target.resize(stream.total_out);
+        deflateEnd(&stream);
+    });
+    if (failed)
+        return false;
+
+    std::vector<uint8_t> data = {0x78, 0x01};
+    uLong checksum = checksums[0];
+    for (size_t strip = 0; strip < strips; strip++) {
+        data.insert(data.end(), compressed[strip].begin(), compressed[strip].end());
+        if (strip > 0) {
+            const size_t rows = min(kPngStripRows, height - (int) strip * kPngStripRows);
+            checksum = adler32_combine(checksum, checksums[strip], (z_off_t) (rows * rowSize));
+        }
+    }
+    putBigEndian(data, (uint32_t) checksum);
+
+    const uint8_t signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+    out.insert(out.end(), signature, signature + 8);
+    std::vector<uint8_t> header;
+    putBigEndian(header, width);
+    putBigEndian(header, height);
+    header.insert(header.end(), {8, 2, 0, 0, 0});   // 8 bits, RGB, deflate, adaptive filters, no interlace
+    appendPngChunk(out, "IHDR", header);
+    appendPngChunk(out, "IDAT", data);
+    appendPngChunk(out, "IEND", {});
+    return true;
+}
+
+/**
+ * Append a scanline OpenEXR file with half B, G, R channels and ZIP compression.
+ * colors are the linear output of the renderer, unclamped, so the file keeps
+ * highlights above 1 and the precision the 8-bit framebuffer rounds away.
+ * Blocks of kExrBlockRows rows are compressed in parallel on pool.
+ */
+inline bool encodeExr(const RGBColor *colors, int width, int height, int level, ThreadPool &pool,
+                      std::vector<uint8_t> &out) {
+    const size_t blocks = (height + kExrBlockRows - 1) / kExrBlockRows;
+    std::vector<std::vector<uint8_t>> compressed(blocks);
+    std::atomic<bool> failed = false;
+    pool.parallelFor(blocks, [&](size_t block) {
+        const int y0 = (int) block * kExrBlockRows, y1 = min(y0 + kExrBlockRows, height);
+        std::vector<uint8_t> raw;
+        raw.reserve((size_t) (y1 - y0) * width * 6);
+        for (int y = y0; y < y1; y++) {
+            const RGBColor *row = colors + (size_t) y * width;
+            for (int channel = 2; channel >= 0; channel--) {
+                for (int x = 0; x < width; x++)
+                    putLittleEndian(raw, floatToHalf(row[x][channel]), 2);
+            }
+        }
+        // ZIP: low bytes before high bytes, then byte deltas
+        std::vector<uint8_t> predicted(raw.size());
+        const size_t half = (raw.size() + 1) / 2;
+        for (size_t i = 0; i < raw.size(); i++)
+            predicted[(i & 1) ? half + i / 2 : i / 2] = raw[i];
+        for (size_t i = predicted.size() - 1; i > 0; i--)
+            predicted[i] = (uint8_t) (predicted[i] - predicted[i - 1] + 128);
+
+        std::vector<uint8_t> &target = compressed[block];
+        uLongf size = compressBound(predicted.size());
+        target.resize(size);
+        if (compress2(target.data(), &size, predicted.data(), predicted.size(), level) != Z_OK) {
+            failed = true;
+            return;
+        }
+        if (size < raw.size())
+            target.resize(size);
+        else
+            target = raw;
+    });
+    if (failed)
+        return false;
+
+    auto attribute = [&out](const char *name, const char *type, const std::vector<uint8_t> &value) {
+        out.insert(out.end(), name, name + strlen(name) + 1);
+        out.insert(out.end(), type, type + strlen(type) + 1);
+        putLittleEndian(out, value.size(), 4);
+        out.insert(out.end(), value.begin(), value.end());
+    };
+    std::vector<uint8_t> channels, window;
+    for (const char *name: {"B", "G", "R"}) {
+        channels.insert(channels.end(), {(uint8_t) name[0], 0});
+        putLittleEndian(channels, 1, 4);    // half
+        putLittleEndian(channels, 0, 4);    // perceptually linear flag and reserved bytes
+        putLittleEndian(channels, 1, 4);
+        putLittleEndian(channels, 1, 4);
+    }
+    channels.push_back(0);
+    for (int value: {0, 0, width - 1, height - 1})
+        putLittleEndian(window, (uint32_t) value, 4);
+    std::vector<uint8_t> one;
+    const float unit = 1;
+    one.insert(one.end(), (const uint8_t *) &unit, (const uint8_t *) &unit + 4);
+
+    out.insert(out.end(), {0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0});
+    attribute("channels", "chlist", channels);
+    attribute("compression", "compression", {3});
+    attribute("dataWindow", "box2i", window);
+    attribute("displayWindow", "box2i", window);
+    attribute("lineOrder", "lineOrder", {0});
+    attribute("pixelAspectRatio", "float", one);
+    attribute("screenWindowCenter", "v2f", std::vector<uint8_t>(8, 0));
+    attribute("screenWindowWidth", "float", one);
+    out.push_back(0);
+
+    size_t offset = out.size() + blocks * 8;
+    for (size_t block = 0; block < blocks; block++) {
+        putLittleEndian(out, offset, 8);
+        offset += 8 + compressed[block].size();
+    }
+    for (size_t block = 0; block < blocks; block++) {
+        putLittleEndian(out, (uint32_t) (block * kExrBlockRows), 4);
+        putLittleEndian(out, compressed[block].size(), 4);
+        out.insert(out.end(), compressed[block].begin(), compressed[block].end());
+    }
+    return true;
+}
+
+/**
+ * Extension of path with its dot, empty if there is none
+ */
+inline std::string pathExtension(const std::string &path) {
+    const size_t dot = path.find_last_of('.');
+    return dot == std::string::npos ? "" : path.substr(dot);
+}
+
+/**
+ * Saves images in the background. save() copies the pixels into a reusable
+ * buffer and returns; encoding and writing happen on the threads of the encoder,
+ * large PNG and EXR images split in strips that compress in parallel.
+ * The format follows the extension of the path: .qoi, PNG otherwise for 8-bit
+ * pixels, .exr for linear colors.
+ */
+class ImageEncoder {
+public:
+    ImageEncoder(size_t threads, int level) : level(level), pool(threads < 1 ? 1 : threads) {}
+
+    ImageEncoder(const ImageEncoder &other) = delete;
+
+    ImageEncoder &operator=(const ImageEncoder &other) = delete;
+
+    ~ImageEncoder() {
+        finish();
+    }
+
+    /**
+     * Queue the top-left width x height corner of surface for saving into path.
+     * Blocks while kMaxQueuedImages images wait to be written.
+     */
+    void save(SDL_Surface *surface, int width, int height, const std::string &path) {
+        const std::string extension = pathExtension(path);
+        if (extension == ".exr") {
+            fprintf(stderr, "Can't save %s: OpenEXR files are written from the linear colors of --batch frames\n",
+                    path.c_str());
+            return;
+        }
+        std::vector<uint32_t> pixels = acquire(freeBuffers);
+        pixels.resize((size_t) width * height);
+        for (int y = 0; y < height; y++)
+            memcpy(&pixels[(size_t) y * width], getPixelPtr(surface, 0, y), width * 4);
+        pool.submit([this, pixels = std::move(pixels), width, height, path, extension]() mutable {
+            std::vector<uint8_t> data;
+            bool encoded = true;
+            if (extension == ".qoi")
+                encodeQoi(pixels.data(), width, height, width, data);
+            else
+                encoded = encodePng(pixels.data(), width, height, width, level, pool, data);
+            write(data, encoded, path);
+            release(freeBuffers, std::move(pixels));
+        });
+    }
+
+    /**
+     * Queue width x height linear colors, row by row, for saving into the OpenEXR file path.
+     * Blocks while kMaxQueuedImages images wait to be written.
+     */
+    void save(const RGBColor *colors, int width, int height, const std::string &path) {
+        std::vector<RGBColor> linear = acquire(freeColorBuffers);
+        linear.assign(colors, colors + (size_t) width * height);
+        pool.submit([this, linear = std::move(linear), width, height, path]() mutable {
+            std::vector<uint8_t> data;
+            const bool encoded = encodeExr(linear.data(), width, height, level, pool, data);
+            write(data, encoded, path);
+            release(freeColorBuffers, std::move(linear));
+        });
+    }
+
+    /**
+     * Wait until every queued image is written
+     */
+    void finish() {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [this]() { return queued == 0; });
+    }
+
+    [[nodiscard]] size_t getImages() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return images;
+    }
+
+    [[nodiscard]] size_t getBytes() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return bytes;
+    }
+
+    /**
+     * Images per second while the encoder had work
+     */
+    [[nodiscard]] float getThroughput() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return busyTime > 0 ? images / busyTime : 0;
+    }
+
+private:
+    /**
+     * A buffer of free, waiting while kMaxQueuedImages images are queued
+     */
+    template<typename T>
+    std::vector<T> acquire(std::vector<std::vector<T>> &free) {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [this]() { return queued < kMaxQueuedImages; });
+        if (queued++ == 0)
+            busySince = std::chrono::high_resolution_clock::now();
+        std::vector<T> buffer;
+        if (!free.empty()) {
+            buffer = std::move(free.back());
+            free.pop_back();
+        }
+        return buffer;
+    }
+
+    void write(const std::vector<uint8_t> &data, bool encoded, const std::string &path) {
+        FILE *file = encoded ? fopen(path.c_str(), "wb") : nullptr;
+        if (file == nullptr || fwrite(data.data(), 1, data.size(), file) != data.size())
+            fprintf(stderr, "Can't save %s: %s\n", path.c_str(), encoded ? strerror(errno) : "encoding failed");
+        if (file != nullptr)
+            fclose(file);
+        std::lock_guard<std::mutex> guard(lock);
+        images++;
+        bytes += data.size();
+    }
+
+    /**
+     * Return the buffer of a written image to free and let the next save() in
+     */
+    template<typename T>
+    void release(std::vector<std::vector<T>> &free, std::vector<T> &&buffer) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (free.size() < kMaxQueuedImages)
+            free.push_back(std::move(buffer));
+        if (--queued == 0)
+            busyTime += std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - busySince).count();
+        changed.notify_all();
+    }
+
+    const int level;
+    size_t queued = 0;
+    size_t images = 0;
+    size_t bytes = 0;
+    float busyTime = 0;     // s
+    std::chrono::high_resolution_clock::time_point busySince;
+    std::vector<std::vector<uint32_t>> freeBuffers;
+    std::vector<std::vector<RGBColor>> freeColorBuffers;
+    mutable std::mutex lock;
+    std::condition_variable changed;
+    // last, so that its threads stop before the state they use goes away
+    ThreadPool pool;
+};
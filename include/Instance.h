@@ -0,0 +1,114 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+
+#include "Matrix.h"
+#include "BoundingBox.h"
+#include "SceneObject.h"
+
+/**
+ * Placed copy of a shared shape. The shape, with whatever hierarchy it has
+ * inside, is the bottom level and exists once; an instance only adds its
+ * transform, so memory grows with the unique shapes and moving an instance
+ * changes nothing but its box in the scene hierarchy.
+ * Rays are taken to object space without normalizing the direction, so hit
+ * distances stay in world units.
+ */
+class Instance : public HittableObject {
+public:
+    /**
+     * @param objectToWorld - placement of the shape, the material id is copied from it
+     */
+    Instance(std::shared_ptr<const HittableObject> shape, const Matrix4x4f &objectToWorld) : shape(std::move(shape)) {
+        materialId = this->shape->materialId;
+        setTransform(objectToWorld);
+    }
+
+    void setTransform(const Matrix4x4f &newObjectToWorld) {
+        objectToWorld = newObjectToWorld;
+        worldToObject = objectToWorld.inverse();
+        // normals go through the inverse transpose
+        normalToWorld = worldToObject.transposed();
+        box = transformBox(shape->bounds(), objectToWorld);
+        axisScale = axisLengths(objectToWorld);
+    }
+
+    [[nodiscard]] const Matrix4x4f &getTransform() const {
+        return objectToWorld;
+    }
+
+    [[nodiscard]] const Matrix4x4f &getInverseTransform() const {
+        return worldToObject;
+    }
+
+    bool intersect(const Ray &ray, float &tNear) const override {
+        return shape->intersect(toObject(ray), tNear);
+    }
+
+    bool intersectPrimitive(const Ray &ray, float &tNear, uint32_t &primitive) const override {
+        return shape->intersectPrimitive(toObject(ray), tNear, primitive);
+    }
+
+    [[nodiscard]] Vec3f getSurfaceNormal(const Vec3f &hitPoint, const Vec3f &viewDirection) const override {
+        return toWorldNormal(shape->getSurfaceNormal(worldToObject.multVecMatrix(hitPoint),
+                                                     worldToObject.multDirMatrix(viewDirection)));
+    }
+
+    [[nodiscard]] Vec3f getPrimitiveNormal(const Vec3f &hitPoint, const Vec3f &viewDirection,
+                                           uint32_t primitive) const override {
+        return toWorldNormal(shape->getPrimitiveNormal(worldToObject.multVecMatrix(hitPoint),
+                                                       worldToObject.multDirMatrix(viewDirection), primitive));
+    }
+
+    /**
+     * The frame of the shape scaled back to world units, so textures follow the instance
+     */
+    [[nodiscard]] Vec3f toObjectSpace(const Vec3f &point) const override {
+        return shape->toObjectSpace(worldToObject.multVecMatrix(point)) * axisScale;
+    }
+
+    /**
+     * Coordinates of the shape, so textures follow the instance
+     */
+    [[nodiscard]] Vec2f getTextureCoordinates(const Vec3f &hitPoint, uint32_t primitive) const override {
+        return shape->getTextureCoordinates(worldToObject.multVecMatrix(hitPoint), primitive);
+    }
+
+    [[nodiscard]] float getHitTolerance(float distance) const override {
+        return shape->getHitTolerance(distance);
+    }
+
+    /**
+     * Only the translation changes, so no inverse is taken again
+     */
+    void translate(const Vec3f &offset) override {
+        objectToWorld *= Matrix4x4f::translate(offset);
+        worldToObject = Matrix4x4f::translate(-offset) * worldToObject;
+        box = {box.low + offset, box.high + offset};
+    }
+
+    [[nodiscard]] HittableObject *clone() const override {
+        return new Instance(*this);
+    }
+
+    [[nodiscard]] AABB bounds() const override {
+        return box;
+    }
+
+private:
+    [[nodiscard]] Ray toObject(const Ray &ray) const {
+        return {worldToObject.multVecMatrix(ray.origin), worldToObject.multDirMatrix(ray.direction)};
+    }
+
+    [[nodiscard]] Vec3f toWorldNormal(const Vec3f &normal) const {
+        Vec3f result = normalToWorld.multDirMatrix(normal);
+        result.normalize();
+        return result;
+    }
+
+    std::shared_ptr<const HittableObject> shape;
+    Matrix4x4f objectToWorld, worldToObject, normalToWorld;
+    Vec3f axisScale; // world lengths of the shape axes
+    AABB box;
+};
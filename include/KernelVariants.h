@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+#include "Kernels.h"
+#include "VectorPacket.h"
+#include "TriangleMesh.h"
+#include "Deferred.h"
+
+/**
+ * Affine transform of N points at a time in structure of arrays layout
+ */
+template<int N>
+inline void transformPointsPackets(const Matrix4x4f &transform, Vec3f *points, size_t count) {
+    Vec3xN<N> rows[4];
+    for (int row = 0; row < 4; row++)
+        rows[row] = Vec3xN<N>(Vec3f(transform.get(row, 0), transform.get(row, 1), transform.get(row, 2)));
+    for (size_t first = 0; first < count; first += N) {
+        const int lanes = (int) min((size_t) N, count - first);
+        const Vec3xN<N> point = Vec3xN<N>::load(points + first, lanes);
+        const Vec3xN<N> result = rows[0] * point[0] + rows[1] * point[1] + rows[2] * point[2] + rows[3];
+        for (int lane = 0; lane < lanes; lane++)
+            points[first + lane] = result.get(lane);
+    }
+}
+
+/**
+ * x ^ kPackGamma on every lane of x, as exp2(kPackGamma * log2(x)) with polynomials, so
+ * that it vectorizes where powf doesn't. Lanes are clamped to 1 first; those under the
+ * smallest normal float give 0. Within 5e-6 relative of powf.
+ */
+template<typename Floats, typename Ints>
+inline Floats gammaLanes(Floats x) {
+    x = __builtin_elementwise_min(x, Floats(1));
+    const Ints valid = x >= std::numeric_limits<float>::min();
+    // x = m * 2^e with m in [1, 2), log2(m) from the series of atanh((m - 1) / (m + 1))
+    const Ints bits = __builtin_bit_cast(Ints, x);
+    const Floats exponent = __builtin_convertvector((bits >> 23) - 127, Floats);
+    const Floats mantissa = __builtin_bit_cast(Floats, (bits & 0x7fffff) | 0x3f800000);
+    const Floats s = (mantissa - 1) / (mantissa + 1), s2 = s * s;
+    const Floats series = s * (2 + s2 * (2.0f / 3 + s2 * (2.0f / 5 + s2 * (2.0f / 7 + s2 * (2.0f / 9)))));
+    const Floats y = kPackGamma * (exponent + series * (float) M_LOG2E);
+    // 2^y = 2^i * 2^(f - 0.5) * sqrt(2) with i = floor(y), the middle factor a Taylor series
+    const Ints truncated = __builtin_convertvector(y, Ints);
+    const Ints whole = truncated + (__builtin_convertvector(truncated, Floats) > y);
+    const Floats f = ((y - __builtin_convertvector(whole, Floats)) - 0.5f) * (float) M_LN2;
+    const Floats fraction = 1 + f * (1 + f * (1.0f / 2 + f * (1.0f / 6 + f * (1.0f / 24 + f * (1.0f / 120 +
+                            f * (1.0f / 720))))));
+    const Floats power = fraction * (float) M_SQRT2 * __builtin_bit_cast(Floats, (whole + 127) << 23);
+    return __builtin_bit_cast(Floats, __builtin_bit_cast(Ints, power) & valid);
+}
+
+/**
+ * packColor() of N colors at a time in structure of arrays layout
+ */
+template<int N>
+inline void packColorPackets(const RGBColor *colors, int count, uint32_t *pixels) {
+    typedef int ints __attribute__((ext_vector_type(N)));
+    typedef typename Vec3xN<N>::lanes floats;
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+    const int shifts[4] = {24, 16, 8, 0};
+#else
+    const int shifts[4] = {0, 8, 16, 24};
+#endif
+    for (int first = 0; first < count; first += N) {
+        const int lanes = min(N, count - first);
+        const Vec3xN<N> packet = Vec3xN<N>::load(colors + first, lanes);
+        ints packed = 255 << shifts[3];
+        for (int channel = 0; channel < 3; channel++) {
+            const floats value = gammaLanes<floats, ints>(packet[channel]) * 255;
+            packed |= __builtin_convertvector(value, ints) << shifts[channel];
+        }
+        for (int lane = 0; lane < lanes; lane++)
+            pixels[first + lane] = (uint32_t) packed[lane];
+    }
+}
+
+/**
+ * Kernel table compiled for the target features. Every kernel is flattened, so the
+ * inline code it calls is compiled for those features too; what stays a call,
+ * such as a virtual intersection, runs the baseline code.
+ * @param lanes - vectors per packet of the point transform and the color packing
+ */
+#define DEFINE_KERNEL_TABLE(suffix, name, features, lanes)                                                    \
+    __attribute__((target(features), flatten))                                                              \
+    bool intersectMesh##suffix(const MeshData &mesh, const Ray &ray, float &tNear, uint32_t &primitive) {   \
+        return intersectMesh(mesh, ray, tNear, primitive);                                                  \
+    }                                                                                                       \
+                                                                                                            \
+    __attribute__((target(features), flatten))                                                              \
+    RGBColor shadeHit##suffix(const SurfaceHit &hit, const SceneSnapshot &scene,                            \
+                              const LightList &pointLights) {                                               \
+        return shadeHit(hit, scene, pointLights);                                                           \
+    }                                                                                                       \
+                                                                                                            \
+    __attribute__((target(features), flatten))                                                              \
+    void shadeChunk##suffix(const SceneSnapshot &scene, const GBuffer &gbuffer, int x0, int y, int count,   \
+                            OccluderCache &occluders, std::vector<uint32_t> &lightStorage, RGBColor *colors) { \
+        shadeGBufferChunk(scene, gbuffer, x0, y, count, occluders, lightStorage, colors);                   \
+    }                                                                                                       \
+                                                                                                            \
+    __attribute__((target(features), flatten))                                                              \
+    void packRow##suffix(const RGBColor *colors, int count, uint32_t *pixels) {                             \
+        packColorPackets<lanes>(colors, count, pixels);                                                     \
+    }                                                                                                       \
+                                                                                                            \
+    __attribute__((target(features), flatten))                                                              \
+    void transformPoints##suffix(const Matrix4x4f &transform, Vec3f *points, size_t count) {                \
+        transformPointsPackets<lanes>(transform, points, count);                                            \
+    }                                                                                                       \
+                                                                                                            \
+    const KernelTable kernels##suffix = {name, intersectMesh##suffix, shadeHit##suffix, shadeChunk##suffix, \
+                                         packRow##suffix, transformPoints##suffix};
+
+// the build targets SSE 4.2, so its kernels are the baseline code
+DEFINE_KERNEL_TABLE(Sse42, "sse4.2", "sse4.2", 8)
+DEFINE_KERNEL_TABLE(Avx2, "avx2", "avx2,fma", 8)
+DEFINE_KERNEL_TABLE(Avx512, "avx512", "avx512f,avx512vl,avx512bw,avx512dq", 16)
+
+#undef DEFINE_KERNEL_TABLE
+
+const KernelTable &detectKernels() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") &&
+        __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq"))
+        return kernelsAvx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return kernelsAvx2;
+    return kernelsSse42;
+}
+
+/**
+ * Use the kernels of isa: auto for the widest one the CPU supports, sse4.2, avx2 or avx512
+ * @return false if isa is unknown or the CPU lacks it
+ */
+bool selectKernels(const char *isa) {
+    if (strcmp(isa, "auto") == 0) {
+        currentKernels() = &detectKernels();
+        return true;
+    }
+    // tables from the narrowest, each supported when the detected one is at least as wide
+    const KernelTable *tables[] = {&kernelsSse42, &kernelsAvx2, &kernelsAvx512};
+    const KernelTable *widest = &detectKernels();
+    bool supported = true;
+    for (const KernelTable *table : tables) {
+        if (strcmp(isa, table->isa) == 0) {
+            if (!supported) {
+                fprintf(stderr, "This CPU doesn't support %s, the widest kernels it runs are %s\n", isa,
+                        widest->isa);
+                return false;
+            }
+            currentKernels() = table;
+            return true;
+        }
+        if (table == widest)
+            supported = false;
+    }
+    fprintf(stderr, "Unknown instruction set %s, expected auto, sse4.2, avx2 or avx512\n", isa);
+    return false;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Vector.h"
+#include "Matrix.h"
+#include "Ray.h"
+
+struct MeshData;
+struct GBuffer;
+struct SurfaceHit;
+struct LightList;
+class SceneSnapshot;
+class OccluderCache;
+
+/**
+ * Hot loops compiled for one instruction set, see KernelVariants.h
+ */
+struct KernelTable {
+    const char *isa;
+
+    /**
+     * Nearest triangle of the mesh along a ray in mesh coordinates
+     */
+    bool (*intersectMesh)(const MeshData &mesh, const Ray &ray, float &tNear, uint32_t &primitive);
+
+    /**
+     * Forward lighting of one hit, see shadeHit()
+     */
+    RGBColor (*shadeHit)(const SurfaceHit &hit, const SceneSnapshot &scene, const LightList &pointLights);
+
+    /**
+     * Deferred lighting of count pixels of a G-buffer row, see shadeGBufferChunk()
+     */
+    void (*shadeChunk)(const SceneSnapshot &scene, const GBuffer &gbuffer, int x0, int y, int count,
+                       OccluderCache &occluders, std::vector<uint32_t> &lightStorage, RGBColor *colors);
+
+    /**
+     * Gamma and 8-bit packing of count colors, see packColor()
+     */
+    void (*packRow)(const RGBColor *colors, int count, uint32_t *pixels);
+
+    /**
+     * Affine transform of points in place
+     */
+    void (*transformPoints)(const Matrix4x4f &transform, Vec3f *points, size_t count);
+};
+
+/**
+ * Kernels of the widest instruction set the CPU supports
+ */
+const KernelTable &detectKernels();
+
+inline const KernelTable *&currentKernels() {
+    static const KernelTable *table = &detectKernels();
+    return table;
+}
+
+/**
+ * Kernels in use, chosen at startup by selectKernels()
+ */
+inline const KernelTable &kernels() {
+    return *currentKernels();
+}
@@ -1,7 +1,15 @@
 #pragma once
 
 static const float kInfinity = std::numeric_limits<float>::max();
-static const float kEpsilon = 1e-8;
+
+/**
+ * Two unit vectors completing w to an orthonormal basis
+ */
+inline void orthonormalBasis(const Vec3f &w, Vec3f &a, Vec3f &b) {
+    a = (fabs(w[0]) > 0.9f) ? Vec3f(0, 1, 0) : Vec3f(1, 0, 0);
+    a = a.crossProduct(w).normalize();
+    b = w.crossProduct(a);
+}
 
 class Light {
 public:
@@ -11,19 +19,31 @@ public:
 
     virtual void illuminate(const Vec3f &P, Vec3f &, Vec3f &, float &) const = 0;
 
+    [[nodiscard]] virtual Light *clone() const = 0;
+
+    /**
+     * Move by offset, see HittableObject::translate()
+     */
+    virtual void translate(const Vec3f &offset) = 0;
+
     RGBColor color;
     float intensity;
 };
 
-class DistantLight : public Light {
+class DistantLight final : public Light {
     Vec3f dir;
+    float cosHalfAngle = 1;
 public:
     explicit DistantLight(const Matrix4x4f &l2w, const RGBColor &c = 1, const float &i = 1) : Light(c, i) {
         dir = l2w.multDirMatrix(Vec3f(0, 0, -1));
         dir.normalize();
     }
 
-    explicit DistantLight(const Vec3f& dir, const RGBColor &c = 1, const float &i = 1) : Light(c, i), dir(dir) {
+    /**
+     * @param angularDiameter - apparent size of the source in radians, 0 for hard shadows
+     */
+    explicit DistantLight(const Vec3f& dir, const RGBColor &c = 1, const float &i = 1, float angularDiameter = 0) :
+            Light(c, i), dir(dir), cosHalfAngle(cos(angularDiameter * 0.5f)) {
         this->dir.normalize();
     }
 
@@ -32,10 +52,38 @@ public:
         lightIntensity = color * intensity;
         distance = kInfinity;
     }
+
+    /**
+     * Direction sampled uniformly inside the cone of the source disc
+     * @param u, v - sample position in [0, 1)^2
+     */
+    void sample(const Vec3f &P, float u, float v, Vec3f &lightDir, Vec3f &lightIntensity, float &distance) const {
+        const float cosTheta = 1 - u * (1 - cosHalfAngle);
+        const float sinTheta = sqrt(max(0.f, 1 - cosTheta * cosTheta));
+        const float phi = 2 * M_PI * v;
+        Vec3f a, b;
+        orthonormalBasis(dir, a, b);
+        lightDir = dir * cosTheta + (a * cos(phi) + b * sin(phi)) * sinTheta;
+        lightIntensity = color * intensity;
+        distance = kInfinity;
+    }
+
+    [[nodiscard]] bool isSoft() const {
+        return cosHalfAngle < 1;
+    }
+
+    [[nodiscard]] Light *clone() const override {
+        return new DistantLight(*this);
+    }
+
+    /**
+     * Directions stay the same
+     */
+    void translate(const Vec3f &offset) override {}
 };
 
 
-class PointLight : public Light {
+class PointLight final : public Light {
     Vec3f pos;
 public:
     explicit PointLight(const Matrix4x4f &l2w, const RGBColor &c = 1, const float &i = 1) : Light(c, i) {
@@ -54,4 +102,103 @@ public:
         lightIntensity = color * intensity / (4 * M_PI * r2);
 //        printf("%f %f %f\n", lightIntensity[0], lightIntensity[1], lightIntensity[2]);
     }
-};
\ No newline at end of file
+
+    [[nodiscard]] Light *clone() const override {
+        return new PointLight(*this);
+    }
+
+    void translate(const Vec3f &offset) override {
+        pos += offset;
+    }
+
+    [[nodiscard]] const Vec3f &getPosition() const {
+        return pos;
+    }
+
+    /**
+     * Distance beyond which every channel of the light is dimmer than cutoff
+     */
+    [[nodiscard]] float influenceRadius(float cutoff) const {
+        const float peak = intensity * max(color[0], max(color[1], color[2]));
+        return sqrt(peak / (4 * M_PI * cutoff));
+    }
+};
+
+/**
+ * Spherical light. Samples are treated as point lights spread over the
+ * hemisphere that faces the shading point, so far away it matches a PointLight.
+ */
+class SphereLight final : public Light {
+    Vec3f center;
+    float radius;
+public:
+    explicit SphereLight(const Vec3f &center, float radius, const RGBColor &c = 1, const float &i = 1) :
+            Light(c, i), center(center), radius(radius) {}
+
+    void illuminate(const Vec3f &P, Vec3f &lightDir, Vec3f &lightIntensity, float &distance) const override {
+        lightDir = (P - center);
+        float r2 = lightDir.length2();
+        distance = sqrt(r2);
+        lightDir /= distance;
+        lightIntensity = color * intensity / (4 * M_PI * r2);
+    }
+
+    void sample(const Vec3f &P, float u, float v, Vec3f &lightDir, Vec3f &lightIntensity, float &distance) const {
+        Vec3f w = P - center, a, b;
+        w.normalize();
+        orthonormalBasis(w, a, b);
+        const float z = u, r = sqrt(max(0.f, 1 - z * z));
+        const float phi = 2 * M_PI * v;
+        const Vec3f point = center + (w * z + (a * cos(phi) + b * sin(phi)) * r) * radius;
+        lightDir = (P - point);
+        float r2 = lightDir.length2();
+        distance = sqrt(r2);
+        lightDir /= distance;
+        lightIntensity = color * intensity / (4 * M_PI * r2);
+    }
+
+    [[nodiscard]] Light *clone() const override {
+        return new SphereLight(*this);
+    }
+
+    void translate(const Vec3f &offset) override {
+        center += offset;
+    }
+};
+
+/**
+ * One-sided rectangular light spanned by two edges from corner,
+ * emitting along edgeU x edgeV
+ */
+class RectLight final : public Light {
+    Vec3f corner, edgeU, edgeV;
+    Vec3f normal;
+public:
+    explicit RectLight(const Vec3f &corner, const Vec3f &edgeU, const Vec3f &edgeV,
+                       const RGBColor &c = 1, const float &i = 1) :
+            Light(c, i), corner(corner), edgeU(edgeU), edgeV(edgeV) {
+        normal = edgeU.crossProduct(edgeV).normalize();
+    }
+
+    void illuminate(const Vec3f &P, Vec3f &lightDir, Vec3f &lightIntensity, float &distance) const override {
+        sample(P, 0.5f, 0.5f, lightDir, lightIntensity, distance);
+    }
+
+    void sample(const Vec3f &P, float u, float v, Vec3f &lightDir, Vec3f &lightIntensity, float &distance) const {
+        const Vec3f point = corner + edgeU * u + edgeV * v;
+        lightDir = (P - point);
+        float r2 = lightDir.length2();
+        distance = sqrt(r2);
+        lightDir /= distance;
+        const float cosine = max(0.f, normal.dotProduct(lightDir));
+        lightIntensity = color * intensity * cosine / (M_PI * r2);
+    }
+
+    [[nodiscard]] Light *clone() const override {
+        return new RectLight(*this);
+    }
+
+    void translate(const Vec3f &offset) override {
+        corner += offset;
+    }
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Vector.h"
+#include "GeometryHelpers.h"
+#include "Light.h"
+
+/**
+ * Binary hierarchy over point lights with a bounding sphere and the total
+ * power of every subtree. Sampling walks from the root and picks a child with
+ * probability proportional to its estimated contribution at the shading point,
+ * so every light keeps a non-zero probability and the estimate stays unbiased.
+ */
+class LightTree {
+public:
+    LightTree() = default;
+
+    explicit LightTree(const std::vector<PointLight> &lights) {
+        if (lights.empty())
+            return;
+        std::vector<uint32_t> indices(lights.size());
+        for (uint32_t i = 0; i < indices.size(); i++)
+            indices[i] = i;
+        nodes.reserve(2 * lights.size());
+        build(lights, indices, 0, indices.size());
+    }
+
+    [[nodiscard]] bool isEmpty() const {
+        return nodes.empty();
+    }
+
+    /**
+     * Pick a light for the shading point
+     * @param point - shading point
+     * @param u - uniform random number in [0, 1)
+     * @param pdf - probability of the returned light
+     * @return index in the light array the tree was built from
+     */
+    [[nodiscard]] uint32_t sample(const Vec3f &point, float u, float &pdf) const {
+        pdf = 1;
+        uint32_t current = 0;
+        while (nodes[current].light < 0) {
+            const Node &node = nodes[current];
+            const float left = importance(nodes[node.left], point);
+            const float right = importance(nodes[node.right], point);
+            const float pLeft = (left + right > 0) ? left / (left + right) : 0.5f;
+            if (u < pLeft) {
+                u /= pLeft;
+                pdf *= pLeft;
+                current = node.left;
+            } else {
+                u = min(0.99999994f, (u - pLeft) / (1 - pLeft));
+                pdf *= 1 - pLeft;
+                current = node.right;
+            }
+        }
+        return nodes[current].light;
+    }
+
+private:
+    struct Node {
+        Vec3f center;
+        float radius2;
+        float power;
+        uint32_t left, right;
+        int32_t light; // leaf light index, -1 for inner nodes
+    };
+
+    /**
+     * Upper estimate of the subtree contribution: power over the squared distance,
+     * where points inside the bounding sphere use the sphere radius instead
+     */
+    static float importance(const Node &node, const Vec3f &point) {
+        const float distance2 = (point - node.center).length2();
+        return node.power / max(distance2, node.radius2 + 1e-4f);
+    }
+
+    static float power(const PointLight &light) {
+        return light.intensity * (light.color[0] + light.color[1] + light.color[2]) / 3;
+    }
+
+    uint32_t build(const std::vector<PointLight> &lights, std::vector<uint32_t> &indices, size_t begin, size_t end) {
+        const auto current = (uint32_t) nodes.size();
+        nodes.push_back({});
+
+        Vec3f low(kInfinity), high(-kInfinity);
+        float totalPower = 0;
+        for (size_t i = begin; i < end; i++) {
+            const Vec3f &position = lights[indices[i]].getPosition();
+            low = Vec3f(min(low[0], position[0]), min(low[1], position[1]), min(low[2], position[2]));
+            high = Vec3f(max(high[0], position[0]), max(high[1], position[1]), max(high[2], position[2]));
+            totalPower += power(lights[indices[i]]);
+        }
+        const Vec3f center = (low + high) * 0.5f;
+        float radius2 = 0;
+        for (size_t i = begin; i < end; i++)
+            radius2 = max(radius2, (lights[indices[i]].getPosition() - center).length2());
+
+        Node node = {center, radius2, totalPower, 0, 0, -1};
+        if (end - begin == 1) {
+            node.light = (int32_t) indices[begin];
+            nodes[current] = node;
+            return current;
+        }
+
+        const Vec3f extent = high - low;
+        int axis = 0;
+        if (extent[1] > extent[axis])
+            axis = 1;
+        if (extent[2] > extent[axis])
+            axis = 2;
+        const size_t middle = begin + (end - begin) / 2;
+        std::nth_element(indices.begin() + begin, indices.begin() + middle, indices.begin() + end,
+                         [&lights, axis](uint32_t a, uint32_t b) {
+                             return lights[a].getPosition()[axis] < lights[b].getPosition()[axis];
+                         });
+        node.left = build(lights, indices, begin, middle);
+        node.right = build(lights, indices, middle, end);
+        nodes[current] = node;
+        return current;
+    }
+
+    std::vector<Node> nodes;
+};
@@ -1,3 +1,7 @@
 #pragma once
 
-bool solveQuadratic(const float &a, const float &b, const float &c, float &x0, float &x1);
\ No newline at end of file
+/**
+ * Real roots of a x^2 + b x + c, instantiated for float and double
+ */
+template<typename T>
+bool solveQuadratic(const T &a, const T &b, const T &c, T &x0, T &x1);
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Vector.h"
+#include "Texture.h"
+#include "SceneObject.h"
+
+/**
+ * Phong parameters, shared by every object with the same materialId
+ */
+struct Material {
+    Vec3f albedo = 0.12;
+    Vec3f ambient = 0.04;
+    float Kd = 0.7;  // phong model diffuse weight
+    float Ks = 0.9;  // phong model specular weight
+    int n = 10;      // phong specular exponent
+    RGBColor color = {1, 1, 1};
+    int32_t texture = -1; // index in the table textures multiplying color, -1 for none
+};
+
+/**
+ * Indexed materials and textures of a scene. Entry 0 is the default material
+ * used by objects that don't set one. Textures are immutable and shared, so
+ * copying the table into a snapshot copies pointers only.
+ */
+class MaterialTable {
+public:
+    MaterialTable() {
+        materials.emplace_back();
+    }
+
+    uint32_t add(const Material &material) {
+        materials.push_back(material);
+        return (uint32_t) materials.size() - 1;
+    }
+
+    int32_t addTexture(std::shared_ptr<const Texture> texture) {
+        textures.push_back(std::move(texture));
+        return (int32_t) textures.size() - 1;
+    }
+
+    [[nodiscard]] const Material &get(uint32_t id) const {
+        return materials[id < materials.size() ? id : 0];
+    }
+
+    Material &get(uint32_t id) {
+        return materials[id < materials.size() ? id : 0];
+    }
+
+    [[nodiscard]] size_t getSize() const {
+        return materials.size();
+    }
+
+    /**
+     * Color of the material at a visible hit. Texture coordinates and lookups
+     * happen only here, once per shaded pixel, never during visibility.
+     * @param footprint - world size of the pixel at the hit
+     */
+    [[nodiscard]] RGBColor surfaceColor(const Material &material, const HittableObject &object,
+                                        const Vec3f &point, uint32_t primitive, float footprint) const {
+        if (material.texture < 0)
+            return material.color;
+        const AABB box = object.bounds();
+        const Vec3f extent = box.high - box.low;
+        const float size = max(extent.maxComponent(), 1e-6f);
+        const TextureQuery query = {object.toObjectSpace(point), object.getTextureCoordinates(point, primitive),
+                                    footprint, footprint / size};
+        return material.color * textures[material.texture]->evaluate(query);
+    }
+
+private:
+    std::vector<Material> materials;
+    std::vector<std::shared_ptr<const Texture>> textures;
+};
@@ -237,7 +237,7 @@ public:
         content = *((content16*)identityData);
     };
 
-    inline const T& get(uint8_t row, uint8_t col) const {
+    inline T get(uint8_t row, uint8_t col) const {
         return content[row][col];
     }
 
@@ -272,6 +272,19 @@ public:
         return *this;
     }
 
+    /**
+     * The matrix multiplied by itself n times, in log2(n) squarings
+     */
+    [[nodiscard]] Matrix4x4 power(uint64_t n) const {
+        Matrix4x4 result, base = *this;
+        for (; n > 0; n >>= 1) {
+            if (n & 1)
+                result *= base;
+            base *= base;
+        }
+        return result;
+    }
+
     static Matrix4x4 translateX(T len){
         T data[4 * 4] = {
                 1, 0, 0, len,
@@ -393,13 +406,13 @@ public:
         for (int i = 0; i < 3; i++) {
             int pivot = i;
 
-            T pivotsize = t[i][i];
+            T pivotsize = t.content[i][i];
 
             if (pivotsize < 0)
                 pivotsize = -pivotsize;
 
             for (int j = i + 1; j < 4; j++) {
-                T tmp = t[j][i];
+                T tmp = t.content[j][i];
 
                 if (tmp < 0)
                     tmp = -tmp;
@@ -418,22 +431,22 @@ public:
                 for (int j = 0; j < 4; j++) {
                     T tmp;
 
-                    tmp = t[i][j];
-                    t[i][j] = t[pivot][j];
-                    t[pivot][j] = tmp;
+                    tmp = t.content[i][j];
+                    t.content[i][j] = t.content[pivot][j];
+                    t.content[pivot][j] = tmp;
 
-                    tmp = s[i][j];
-                    s[i][j] = s[pivot][j];
-                    s[pivot][j] = tmp;
+                    tmp = s.content[i][j];
+                    s.content[i][j] = s.content[pivot][j];
+                    s.content[pivot][j] = tmp;
                 }
             }
 
             for (int j = i + 1; j < 4; j++) {
-                T f = t[j][i] / t[i][i];
+                T f = t.content[j][i] / t.content[i][i];
 
                 for (int k = 0; k < 4; k++) {
-                    t[j][k] -= f * t[i][k];
-                    s[j][k] -= f * s[i][k];
+                    t.content[j][k] -= f * t.content[i][k];
+                    s.content[j][k] -= f * s.content[i][k];
                 }
             }
         }
@@ -441,21 +454,21 @@ public:
         for (int i = 3; i >= 0; --i) {
             T f = 0;
 
-            if ((f = t[i][i]) == 0) {
+            if ((f = t.content[i][i]) == 0) {
                 return Matrix4x4();
             }
 
             for (int j = 0; j < 4; j++) {
-                t[i][j] /= f;
-                s[i][j] /= f;
+                t.content[i][j] /= f;
+                s.content[i][j] /= f;
             }
 
             for (int j = 0; j < i; j++) {
-                f = t[j][i];
+                f = t.content[j][i];
 
                 for (int k = 0; k < 4; k++) {
-                    t[j][k] -= f * t[i][k];
-                    s[j][k] -= f * s[i][k];
+                    t.content[j][k] -= f * t.content[i][k];
+                    s.content[j][k] -= f * s.content[i][k];
                 }
             }
         }
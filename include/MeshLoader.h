@@ -0,0 +1,734 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Vector.h"
+#include "ThreadPool.h"
+#include "TriangleMesh.h"
+
+constexpr size_t kMeshTextChunk = 1 << 22;    // bytes of text parsed by one task
+constexpr size_t kMeshBinaryChunk = 1 << 16;  // binary records parsed by one task
+
+/**
+ * Read-only mapping of a whole file followed by a zero, so number parsing stops at the end.
+ * Pages are read in as the parser reaches them and stay backed by the file, so the
+ * system can drop them again: the text doesn't take memory of its own however large it is.
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const char *path) {
+        const int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat status = {};
+        if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode)) {
+            // zero pages with the file mapped over their start, so the byte after it exists and is 0
+            const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+            const size_t fileSize = (size_t) status.st_size, mapped = (fileSize / page + 1) * page;
+            void *area = mmap(nullptr, mapped, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (area != MAP_FAILED && fileSize > 0 &&
+                mmap(area, fileSize, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+                munmap(area, mapped);
+                area = MAP_FAILED;
+            }
+            if (area != MAP_FAILED) {
+                data = (const char *) area;
+                size = fileSize;
+                mappedSize = mapped;
+            }
+        }
+        close(fd);
+    }
+
+    MappedFile(const MappedFile &other) = delete;
+
+    MappedFile &operator=(const MappedFile &other) = delete;
+
+    ~MappedFile() {
+        if (data != nullptr)
+            munmap((void *) data, mappedSize);
+    }
+
+    [[nodiscard]] bool isOpen() const {
+        return data != nullptr;
+    }
+
+    [[nodiscard]] const char *begin() const {
+        return data;
+    }
+
+    [[nodiscard]] const char *end() const {
+        return data + size;
+    }
+
+private:
+    const char *data = nullptr;
+    size_t size = 0, mappedSize = 0;
+};
+
+inline const char *skipBlanks(const char *p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r')
+        p++;
+    return p;
+}
+
+inline const char *nextLine(const char *p, const char *end) {
+    const void *newline = memchr(p, '\n', end - p);
+    return newline ? (const char *) newline + 1 : end;
+}
+
+/**
+ * Number at p, after blanks, on the line that ends at lineEnd; p moves past it.
+ * Unlike strtod alone this never reads on into the next line.
+ * @return false if the line has no number left
+ */
+inline bool parseLineNumber(const char *&p, const char *lineEnd, double &value) {
+    const char *start = skipBlanks(p);
+    if (start >= lineEnd || *start == '\n')
+        return false;
+    char *next = nullptr;
+    value = strtod(start, &next);
+    if (next == start || next > lineEnd)
+        return false;
+    p = next;
+    return true;
+}
+
+/**
+ * Cut text into pieces of about chunkSize bytes that end on line boundaries
+ * @return chunk i is [bounds[i], bounds[i + 1])
+ */
+inline std::vector<const char *> splitLines(const char *begin, const char *end, size_t chunkSize) {
+    std::vector<const char *> bounds = {begin};
+    while (bounds.back() != end) {
+        const char *p = bounds.back() + min(chunkSize, (size_t) (end - bounds.back()));
+        bounds.push_back(p == end ? end : nextLine(p, end));
+    }
+    return bounds;
+}
+
+/**
+ * Append per-chunk index lists to mesh.indices in parallel
+ * @param resolve - (chunk, stored index) -> final vertex index
+ */
+template<typename Index, typename Resolve>
+inline bool mergeIndices(const std::vector<std::vector<Index>> &chunks, MeshData &mesh, ThreadPool &pool,
+                         Resolve &&resolve) {
+    std::vector<size_t> offsets(chunks.size() + 1, mesh.indices.size());
+    for (size_t c = 0; c < chunks.size(); c++)
+        offsets[c + 1] = offsets[c] + chunks[c].size();
+    mesh.indices.resize(offsets.back());
+    std::atomic<bool> valid = true;
+    const size_t verticesCount = mesh.vertices.size();
+    pool.parallelFor(chunks.size(), [&](size_t c) {
+        uint32_t *target = mesh.indices.data() + offsets[c];
+        for (size_t k = 0; k < chunks[c].size(); k++) {
+            const int64_t index = resolve(c, chunks[c][k]);
+            if (index < 0 || (size_t) index >= verticesCount) {
+                valid = false;
+                return;
+            }
+            target[k] = (uint32_t) index;
+        }
+    });
+    return valid;
+}
+
+/**
+ * Faces of an OBJ chunk before the vertex counts of the previous chunks are known
+ */
+struct ObjChunk {
+    // negative indices are relative to the end of the vertex list, they are kept as
+    // the position inside the chunk minus kRelative until the chunk offset is known
+    constexpr static int64_t kRelative = int64_t(1) << 40;
+
+    std::vector<Vec3f> vertices;
+    std::vector<int64_t> indices;
+    bool valid = true;  // false after a vertex with fewer than 3 coordinates or an index out of range
+
+    void parse(const char *p, const char *end) {
+        std::vector<int64_t> polygon;
+        while (p < end) {
+            const char *line = skipBlanks(p);
+            p = nextLine(line, end);
+            if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t')) {
+                const char *value = line + 2;
+                double xyz[3];
+                for (double &coordinate : xyz) {
+                    if (!parseLineNumber(value, p, coordinate)) {
+                        valid = false;
+                        return;
+                    }
+                }
+                vertices.emplace_back((float) xyz[0], (float) xyz[1], (float) xyz[2]);
+            } else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t')) {
+                polygon.clear();
+                const char *token = skipBlanks(line + 2);
+                while (token < p && *token != '\n' && *token != '#' && *token != 0) {
+                    char *next = nullptr;
+                    const long index = strtol(token, &next, 10);
+                    if (next == token)
+                        break;
+                    // rejected before the arithmetic below can overflow
+                    if (index == 0 || index >= kRelative || index <= -kRelative) {
+                        valid = false;
+                        return;
+                    }
+                    polygon.push_back(index > 0 ? index - 1 : (int64_t) vertices.size() + index - kRelative);
+                    // texture and normal indices are not used
+                    while (*next != ' ' && *next != '\t' && *next != '\r' && *next != '\n' && *next != 0)
+                        next++;
+                    token = skipBlanks(next);
+                }
+                for (size_t k = 2; k < polygon.size(); k++) {
+                    indices.push_back(polygon[0]);
+                    indices.push_back(polygon[k - 1]);
+                    indices.push_back(polygon[k]);
+                }
+            }
+        }
+    }
+};
+
+/**
+ * Wavefront OBJ: only positions and faces are read, polygons are triangulated as fans
+ */
+inline bool parseObj(const char *begin, const char *end, MeshData &mesh, ThreadPool &pool) {
+    const std::vector<const char *> bounds = splitLines(begin, end, kMeshTextChunk);
+    const size_t chunksCount = bounds.size() - 1;
+    std::vector<ObjChunk> chunks(chunksCount);
+    pool.parallelFor(chunksCount, [&](size_t c) {
+        chunks[c].parse(bounds[c], bounds[c + 1]);
+    });
+    for (const ObjChunk &chunk : chunks) {
+        if (!chunk.valid)
+            return false;
+    }
+
+    std::vector<size_t> vertexOffsets(chunksCount + 1, 0);
+    for (size_t c = 0; c < chunksCount; c++)
+        vertexOffsets[c + 1] = vertexOffsets[c] + chunks[c].vertices.size();
+    mesh.vertices.resize(vertexOffsets.back());
+    pool.parallelFor(chunksCount, [&](size_t c) {
+        std::copy(chunks[c].vertices.begin(), chunks[c].vertices.end(), mesh.vertices.begin() + vertexOffsets[c]);
+    });
+
+    std::vector<std::vector<int64_t>> indices(chunksCount);
+    for (size_t c = 0; c < chunksCount; c++)
+        indices[c].swap(chunks[c].indices);
+    return mergeIndices(indices, mesh, pool, [&](size_t c, int64_t index) {
+        return index >= 0 ? index : (int64_t) vertexOffsets[c] + index + ObjChunk::kRelative;
+    });
+}
+
+enum class PlyType {
+    Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, Invalid
+};
+
+inline PlyType parsePlyType(const std::string &name) {
+    if (name == "char" || name == "int8") return PlyType::Int8;
+    if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+    if (name == "short" || name == "int16") return PlyType::Int16;
+    if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+    if (name == "int" || name == "int32") return PlyType::Int32;
+    if (name == "uint" || name == "uint32") return PlyType::UInt32;
+    if (name == "float" || name == "float32") return PlyType::Float32;
+    if (name == "double" || name == "float64") return PlyType::Float64;
+    return PlyType::Invalid;
+}
+
+inline size_t plyTypeSize(PlyType type) {
+    static const size_t sizes[] = {1, 1, 2, 2, 4, 4, 4, 8, 0};
+    return sizes[(int) type];
+}
+
+inline bool isPlyInteger(PlyType type) {
+    return type != PlyType::Float32 && type != PlyType::Float64 && type != PlyType::Invalid;
+}
+
+/**
+ * Vertex index of a parsed list item, checked before the cast so a malformed file can't overflow it
+ * @return false unless value is a whole number below verticesCount
+ */
+inline bool toVertexIndex(double value, size_t verticesCount, uint32_t &index) {
+    if (!(value >= 0 && value < (double) min(verticesCount, (size_t) UINT32_MAX)) || value != floor(value))
+        return false;
+    index = (uint32_t) value;
+    return true;
+}
+
+/**
+ * Binary scalar at p, converted to double
+ */
+inline double readPlyValue(const char *p, PlyType type, bool bigEndian) {
+    unsigned char bytes[8];
+    const size_t size = plyTypeSize(type);
+    memcpy(bytes, p, size);
+    if (bigEndian) {
+        for (size_t k = 0; k < size / 2; k++)
+            swap(bytes[k], bytes[size - 1 - k]);
+    }
+    switch (type) {
+        case PlyType::Int8: { int8_t v; memcpy(&v, bytes, 1); return v; }
+        case PlyType::UInt8: { uint8_t v; memcpy(&v, bytes, 1); return v; }
+        case PlyType::Int16: { int16_t v; memcpy(&v, bytes, 2); return v; }
+        case PlyType::UInt16: { uint16_t v; memcpy(&v, bytes, 2); return v; }
+        case PlyType::Int32: { int32_t v; memcpy(&v, bytes, 4); return v; }
+        case PlyType::UInt32: { uint32_t v; memcpy(&v, bytes, 4); return v; }
+        case PlyType::Float32: { float v; memcpy(&v, bytes, 4); return v; }
+        case PlyType::Float64: { double v; memcpy(&v, bytes, 8); return v; }
+        default: return 0;
+    }
+}
+
+struct PlyProperty {
+    std::string name;
+    PlyType type = PlyType::Invalid;       // item type for lists
+    PlyType countType = PlyType::Invalid;  // set for lists only
+};
+
+struct PlyElement {
+    std::string name;
+    size_t count = 0;
+    std::vector<PlyProperty> properties;
+
+    [[nodiscard]] int find(const char *property) const {
+        for (size_t k = 0; k < properties.size(); k++) {
+            if (properties[k].name == property)
+                return (int) k;
+        }
+        return -1;
+    }
+
+    [[nodiscard]] bool hasLists() const {
+        for (const PlyProperty &property : properties) {
+            if (property.countType != PlyType::Invalid)
+                return true;
+        }
+        return false;
+    }
+};
+
+/**
+ * PLY reader for the vertex and face elements in ascii and both binary formats.
+ * Fixed-size records are parsed in parallel in place; faces of varying size are
+ * first scanned for their triangle counts, so indices are written straight to the mesh.
+ * Indices are checked against the vertices read before them, the vertex element comes first.
+ */
+class PlyParser {
+public:
+    PlyParser(const char *begin, const char *end, MeshData &mesh, ThreadPool &pool) :
+            p(begin), end(end), mesh(mesh), pool(pool) {
+    }
+
+    bool parse() {
+        if (!parseHeader())
+            return false;
+        for (const PlyElement &element : elements) {
+            bool ok = true;
+            if (element.name == "vertex")
+                ok = ascii ? parseAsciiVertices(element) : parseBinaryVertices(element);
+            else if (element.name == "face")
+                ok = ascii ? parseAsciiFaces(element) : parseBinaryFaces(element);
+            else
+                ok = skipElement(element);
+            if (!ok)
+                return false;
+        }
+        return true;
+    }
+
+private:
+    bool parseHeader() {
+        if (strncmp(p, "ply", 3) != 0)
+            return false;
+        p = nextLine(p, end);
+        while (p < end) {
+            const char *lineEnd = nextLine(p, end);
+            std::vector<std::string> words;
+            for (const char *word = skipBlanks(p); word < lineEnd && *word != '\n';) {
+                const char *wordEnd = word;
+                while (wordEnd < lineEnd && *wordEnd != ' ' && *wordEnd != '\t' && *wordEnd != '\r' &&
+                       *wordEnd != '\n')
+                    wordEnd++;
+                words.emplace_back(word, wordEnd);
+                word = skipBlanks(wordEnd);
+            }
+            p = lineEnd;
+            if (words.empty() || words[0] == "comment" || words[0] == "obj_info")
+                continue;
+            if (words[0] == "end_header")
+                return true;
+            if (words[0] == "format" && words.size() >= 2) {
+                ascii = words[1] == "ascii";
+                bigEndian = words[1] == "binary_big_endian";
+                if (!ascii && !bigEndian && words[1] != "binary_little_endian")
+                    return false;
+            } else if (words[0] == "element" && words.size() >= 3) {
+                elements.push_back({words[1], strtoull(words[2].c_str(), nullptr, 10), {}});
+            } else if (words[0] == "property" && !elements.empty()) {
+                PlyProperty property;
+                if (words.size() >= 5 && words[1] == "list") {
+                    property.countType = parsePlyType(words[2]);
+                    property.type = parsePlyType(words[3]);
+                    property.name = words[4];
+                    if (!isPlyInteger(property.countType))
+                        return false;
+                } else if (words.size() >= 3) {
+                    property.type = parsePlyType(words[1]);
+                    property.name = words[2];
+                } else {
+                    return false;
+                }
+                if (property.type == PlyType::Invalid)
+                    return false;
+                elements.back().properties.push_back(property);
+            } else {
+                return false;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Item count of a list property whose count starts at items, with available bytes left
+     * @return false if the count is negative or the items don't fit
+     */
+    bool readListCount(const PlyProperty &property, const char *items, size_t available, size_t &count) const {
+        const size_t countSize = plyTypeSize(property.countType);
+        if (countSize > available)
+            return false;
+        const double value = readPlyValue(items, property.countType, bigEndian);
+        if (!(value >= 0 && value <= (double) ((available - countSize) / plyTypeSize(property.type))))
+            return false;
+        count = (size_t) value;
+        return true;
+    }
+
+    /**
+     * Offset of property list inside the binary record at record, which lists make vary
+     * @return false if the properties before it don't fit before the end of the file
+     */
+    bool listOffset(const PlyElement &element, int list, const char *record, size_t &offset) const {
+        const size_t available = end - record;
+        offset = 0;
+        for (int k = 0; k < list; k++) {
+            const PlyProperty &property = element.properties[k];
+            if (property.countType == PlyType::Invalid) {
+                offset += plyTypeSize(property.type);
+                if (offset > available)
+                    return false;
+                continue;
+            }
+            size_t count = 0;
+            if (!readListCount(property, record + offset, available - offset, count))
+                return false;
+            offset += plyTypeSize(property.countType) + count * plyTypeSize(property.type);
+        }
+        return true;
+    }
+
+    /**
+     * Size of the binary record at record
+     * @return false if it doesn't fit before the end of the file
+     */
+    bool recordSize(const PlyElement &element, const char *record, size_t &size) const {
+        return listOffset(element, (int) element.properties.size(), record, size);
+    }
+
+    bool skipElement(const PlyElement &element) {
+        for (size_t k = 0; k < element.count; k++) {
+            size_t size = 0;
+            if (p >= end || (!ascii && !recordSize(element, p, size)))
+                return false;
+            p = ascii ? nextLine(p, end) : p + size;
+        }
+        return true;
+    }
+
+    bool findPositions(const PlyElement &element, int positions[3]) const {
+        positions[0] = element.find("x");
+        positions[1] = element.find("y");
+        positions[2] = element.find("z");
+        return positions[0] >= 0 && positions[1] >= 0 && positions[2] >= 0;
+    }
+
+    bool parseBinaryVertices(const PlyElement &element) {
+        int positions[3];
+        if (!findPositions(element, positions) || element.hasLists())
+            return false;
+        size_t offsets[3], stride = 0;
+        for (size_t k = 0; k < element.properties.size(); k++) {
+            for (int axis = 0; axis < 3; axis++) {
+                if (positions[axis] == (int) k)
+                    offsets[axis] = stride;
+            }
+            stride += plyTypeSize(element.properties[k].type);
+        }
+        if (stride == 0 || element.count > (size_t) (end - p) / stride)
+            return false;
+        const size_t first = mesh.vertices.size();
+        mesh.vertices.resize(first + element.count);
+        const char *data = p;
+        pool.parallelFor((element.count + kMeshBinaryChunk - 1) / kMeshBinaryChunk, [&](size_t chunk) {
+            const size_t last = min(element.count, (chunk + 1) * kMeshBinaryChunk);
+            for (size_t k = chunk * kMeshBinaryChunk; k < last; k++) {
+                const char *record = data + k * stride;
+                float xyz[3];
+                for (int axis = 0; axis < 3; axis++)
+                    xyz[axis] = (float) readPlyValue(record + offsets[axis],
+                                                     element.properties[positions[axis]].type, bigEndian);
+                mesh.vertices[first + k] = Vec3f(xyz[0], xyz[1], xyz[2]);
+            }
+        });
+        p += stride * element.count;
+        return true;
+    }
+
+    /**
+     * Index of the vertex index list property of a face element
+     * @return -1 if there is none or its items aren't integers
+     */
+    static int findIndexList(const PlyElement &element) {
+        int list = element.find("vertex_indices");
+        if (list < 0)
+            list = element.find("vertex_index");
+        if (list < 0 || element.properties[list].countType == PlyType::Invalid ||
+            !isPlyInteger(element.properties[list].type))
+            return -1;
+        return list;
+    }
+
+    bool parseBinaryFaces(const PlyElement &element) {
+        const int list = findIndexList(element);
+        if (list < 0)
+            return false;
+
+        // sequential pass over the record sizes only, remembering where each chunk starts
+        const size_t chunksCount = (element.count + kMeshBinaryChunk - 1) / kMeshBinaryChunk;
+        std::vector<const char *> starts(chunksCount + 1);
+        std::vector<size_t> triangleOffsets(chunksCount + 1, mesh.indices.size() / 3);
+        for (size_t k = 0; k < element.count; k++) {
+            if (k % kMeshBinaryChunk == 0) {
+                starts[k / kMeshBinaryChunk] = p;
+                triangleOffsets[k / kMeshBinaryChunk + 1] = triangleOffsets[k / kMeshBinaryChunk];
+            }
+            size_t offset = 0, corners = 0, size = 0;
+            if (!listOffset(element, list, p, offset) ||
+                !readListCount(element.properties[list], p + offset, end - p - offset, corners) ||
+                !recordSize(element, p, size))
+                return false;
+            triangleOffsets[k / kMeshBinaryChunk + 1] += corners > 2 ? corners - 2 : 0;
+            p += size;
+        }
+
+        mesh.indices.resize(triangleOffsets[chunksCount] * 3);
+        const PlyProperty &indices = element.properties[list];
+        const size_t verticesCount = mesh.vertices.size();
+        std::atomic<bool> valid = true;
+        pool.parallelFor(chunksCount, [&](size_t chunk) {
+            const char *record = starts[chunk];
+            uint32_t *target = mesh.indices.data() + triangleOffsets[chunk] * 3;
+            const size_t last = min(element.count, (chunk + 1) * kMeshBinaryChunk);
+            // every record was checked by the pass above
+            for (size_t k = chunk * kMeshBinaryChunk; k < last; k++) {
+                size_t offset = 0, corners = 0, size = 0;
+                listOffset(element, list, record, offset);
+                const char *items = record + offset;
+                readListCount(indices, items, end - items, corners);
+                items += plyTypeSize(indices.countType);
+                const size_t itemSize = plyTypeSize(indices.type);
+                uint32_t first = 0, previous = 0;
+                for (size_t corner = 0; corner < corners; corner++) {
+                    uint32_t index = 0;
+                    if (!toVertexIndex(readPlyValue(items + corner * itemSize, indices.type, bigEndian),
+                                       verticesCount, index)) {
+                        valid = false;
+                        return;
+                    }
+                    if (corner == 0)
+                        first = index;
+                    if (corner >= 2) {
+                        *target++ = first;
+                        *target++ = previous;
+                        *target++ = index;
+                    }
+                    previous = index;
+                }
+                recordSize(element, record, size);
+                record += size;
+            }
+        });
+        return valid;
+    }
+
+    /**
+     * Start of every kMeshBinaryChunk-th of the next count lines, followed by the end of the last one
+     * @return false if there are fewer lines
+     */
+    bool splitRecords(size_t count, std::vector<const char *> &starts) {
+        for (size_t k = 0; k < count; k++) {
+            if (p >= end)
+                return false;
+            if (k % kMeshBinaryChunk == 0)
+                starts.push_back(p);
+            p = nextLine(p, end);
+        }
+        starts.push_back(p);
+        return true;
+    }
+
+    bool parseAsciiVertices(const PlyElement &element) {
+        int positions[3];
+        if (!findPositions(element, positions) || element.hasLists())
+            return false;
+        std::vector<const char *> starts;
+        if (!splitRecords(element.count, starts))
+            return false;
+        const size_t first = mesh.vertices.size();
+        mesh.vertices.resize(first + element.count);
+        std::atomic<bool> valid = true;
+        pool.parallelFor(starts.size() - 1, [&](size_t chunk) {
+            const char *line = starts[chunk];
+            const size_t last = min(element.count, (chunk + 1) * kMeshBinaryChunk);
+            for (size_t k = chunk * kMeshBinaryChunk; k < last; k++) {
+                const char *lineEnd = nextLine(line, end);
+                float xyz[3] = {};
+                const char *value = line;
+                for (size_t property = 0; property < element.properties.size(); property++) {
+                    double number = 0;
+                    if (!parseLineNumber(value, lineEnd, number)) {
+                        valid = false;
+                        return;
+                    }
+                    for (int axis = 0; axis < 3; axis++) {
+                        if (positions[axis] == (int) property)
+                            xyz[axis] = (float) number;
+                    }
+                }
+                mesh.vertices[first + k] = Vec3f(xyz[0], xyz[1], xyz[2]);
+                line = lineEnd;
+            }
+        });
+        return valid;
+    }
+
+    bool parseAsciiFaces(const PlyElement &element) {
+        const int list = findIndexList(element);
+        if (list < 0)
+            return false;
+        std::vector<const char *> starts;
+        if (!splitRecords(element.count, starts))
+            return false;
+        std::vector<std::vector<uint32_t>> chunks(starts.size() - 1);
+        const size_t verticesCount = mesh.vertices.size();
+        std::atomic<bool> valid = true;
+        pool.parallelFor(chunks.size(), [&](size_t chunk) {
+            std::vector<uint32_t> &indices = chunks[chunk];
+            std::vector<uint32_t> polygon;
+            for (const char *line = starts[chunk]; line < starts[chunk + 1]; line = nextLine(line, end)) {
+                const char *lineEnd = nextLine(line, end);
+                const char *value = line;
+                for (size_t property = 0; property < element.properties.size(); property++) {
+                    const bool isList = element.properties[property].countType != PlyType::Invalid;
+                    double number = 0;
+                    size_t count = 1;
+                    if (isList) {
+                        // every item takes at least one character of the line
+                        if (!parseLineNumber(value, lineEnd, number) || !(number >= 0) ||
+                            number > (double) (lineEnd - value)) {
+                            valid = false;
+                            return;
+                        }
+                        count = (size_t) number;
+                    }
+                    polygon.clear();
+                    for (size_t k = 0; k < count; k++) {
+                        uint32_t index = 0;
+                        if (!parseLineNumber(value, lineEnd, number) ||
+                            ((int) property == list && !toVertexIndex(number, verticesCount, index))) {
+                            valid = false;
+                            return;
+                        }
+                        if ((int) property == list)
+                            polygon.push_back(index);
+                    }
+                    if ((int) property != list)
+                        continue;
+                    for (size_t corner = 2; corner < polygon.size(); corner++) {
+                        indices.push_back(polygon[0]);
+                        indices.push_back(polygon[corner - 1]);
+                        indices.push_back(polygon[corner]);
+                    }
+                }
+            }
+        });
+        if (!valid)
+            return false;
+        return mergeIndices(chunks, mesh, pool, [](size_t, uint32_t index) {
+            return (int64_t) index;
+        });
+    }
+
+    const char *p;
+    const char *const end;
+    MeshData &mesh;
+    ThreadPool &pool;
+    std::vector<PlyElement> elements;
+    bool ascii = false;
+    bool bigEndian = false;
+};
+
+/**
+ * Load an OBJ or PLY file, picked by the extension. The hierarchy is not built,
+ * so the vertices can still be transformed, see MeshData::build().
+ * @return null if the file can't be read or parsed
+ */
+inline std::shared_ptr<MeshData> loadMesh(const char *path, ThreadPool &pool) {
+    const MappedFile file(path);
+    if (!file.isOpen()) {
+        fprintf(stderr, "Can't read mesh %s\n", path);
+        return nullptr;
+    }
+    auto mesh = std::make_shared<MeshData>();
+    const char *begin = file.begin(), *end = file.end();
+    const char *extension = strrchr(path, '.');
+    const bool parsed = (extension != nullptr && strcasecmp(extension, ".ply") == 0) ?
+                        PlyParser(begin, end, *mesh, pool).parse() :
+                        parseObj(begin, end, *mesh, pool);
+    if (!parsed || mesh->indices.empty()) {
+        fprintf(stderr, "Can't parse mesh %s\n", path);
+        return nullptr;
+    }
+    return mesh;
+}
+
+/**
+ * Scale and move the mesh so its largest side is size and its box is centered at center
+ */
+inline void fitMesh(MeshData &mesh, const Vec3f &center, float size) {
+    AABB box;
+    for (const Vec3f &vertex : mesh.vertices)
+        box.extend(vertex);
+    const Vec3f extent = box.high - box.low;
+    const float largest = max(extent[0], max(extent[1], extent[2]));
+    const float scale = largest > 0 ? size / largest : 1;
+    Matrix4x4f transform;
+    for (int axis = 0; axis < 3; axis++)
+        transform.set(axis, axis, scale);
+    transform = transform * Matrix4x4f::translate(center - box.centroid() * scale);
+    kernels().transformPoints(transform, mesh.vertices.data(), mesh.vertices.size());
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * Stream sockets on "unix:PATH" or "HOST:PORT" addresses. HOST may be empty
+ * when listening to accept connections on every interface.
+ * Functions print the reason of a failure and return -1 or false.
+ */
+
+inline bool isUnixAddress(const char *address) {
+    return strncmp(address, "unix:", 5) == 0;
+}
+
+inline bool splitHostPort(const char *address, std::string &host, std::string &port) {
+    const char *colon = strrchr(address, ':');
+    if (colon == nullptr || colon[1] == '\0') {
+        fprintf(stderr, "Address %s has no port\n", address);
+        return false;
+    }
+    host.assign(address, colon - address);
+    port.assign(colon + 1);
+    return true;
+}
+
+inline bool makeUnixAddress(const char *address, sockaddr_un &unixAddress) {
+    const char *path = address + 5;
+    if (strlen(path) >= sizeof(unixAddress.sun_path)) {
+        fprintf(stderr, "Socket path %s is too long\n", path);
+        return false;
+    }
+    memset(&unixAddress, 0, sizeof(unixAddress));
+    unixAddress.sun_family = AF_UNIX;
+    strcpy(unixAddress.sun_path, path);
+    return true;
+}
+
+/**
+ * @return listening socket or -1
+ */
+inline int listenSocket(const char *address) {
+    if (isUnixAddress(address)) {
+        sockaddr_un unixAddress = {};
+        if (!makeUnixAddress(address, unixAddress))
+            return -1;
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(unixAddress.sun_path);
+        if (fd < 0 || bind(fd, (const sockaddr *) &unixAddress, sizeof(unixAddress)) != 0 || listen(fd, 1) != 0) {
+            fprintf(stderr, "Can't listen on %s: %s\n", address, strerror(errno));
+            if (fd >= 0)
+                close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    std::string host, port;
+    if (!splitHostPort(address, host, port))
+        return -1;
+    addrinfo hints = {}, *found = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    const int status = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found);
+    if (status != 0) {
+        fprintf(stderr, "Can't resolve %s: %s\n", address, gai_strerror(status));
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo *candidate = found; candidate != nullptr && fd < 0; candidate = candidate->ai_next) {
+        fd = socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+        if (fd < 0)
+            continue;
+        const int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(fd, candidate->ai_addr, candidate->ai_addrlen) != 0 || listen(fd, 1) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    if (fd < 0)
+        fprintf(stderr, "Can't listen on %s: %s\n", address, strerror(errno));
+    return fd;
+}
+
+inline void disableNagle(int fd) {
+    const int enabled = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+}
+
+/**
+ * Blocks until a client connects
+ * @return connected socket or -1
+ */
+inline int acceptSocket(int listener) {
+    const int fd = accept(listener, nullptr, nullptr);
+    if (fd < 0) {
+        fprintf(stderr, "Can't accept a client: %s\n", strerror(errno));
+        return -1;
+    }
+    disableNagle(fd);
+    return fd;
+}
+
+/**
+ * @return connected socket or -1
+ */
+inline int connectSocket(const char *address) {
+    if (isUnixAddress(address)) {
+        sockaddr_un unixAddress = {};
+        if (!makeUnixAddress(address, unixAddress))
+            return -1;
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (const sockaddr *) &unixAddress, sizeof(unixAddress)) != 0) {
+            fprintf(stderr, "Can't connect to %s: %s\n", address, strerror(errno));
+            if (fd >= 0)
+                close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    std::string host, port;
+    if (!splitHostPort(address, host, port))
+        return -1;
+    addrinfo hints = {}, *found = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    const int status = getaddrinfo(host.empty() ? "localhost" : host.c_str(), port.c_str(), &hints, &found);
+    if (status != 0) {
+        fprintf(stderr, "Can't resolve %s: %s\n", address, gai_strerror(status));
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo *candidate = found; candidate != nullptr && fd < 0; candidate = candidate->ai_next) {
+        fd = socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+        if (fd >= 0 && connect(fd, candidate->ai_addr, candidate->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    if (fd < 0) {
+        fprintf(stderr, "Can't connect to %s: %s\n", address, strerror(errno));
+        return -1;
+    }
+    disableNagle(fd);
+    return fd;
+}
+
+inline bool sendAll(int fd, const void *data, size_t size) {
+    const auto *bytes = (const uint8_t *) data;
+    while (size > 0) {
+        const ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        bytes += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+inline bool receiveAll(int fd, void *data, size_t size) {
+    auto *bytes = (uint8_t *) data;
+    while (size > 0) {
+        const ssize_t received = recv(fd, bytes, size, 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+        bytes += received;
+        size -= received;
+    }
+    return true;
+}
+
+/**
+ * @return true if data (or a hang-up) is waiting, false after timeoutMs
+ */
+inline bool waitReadable(int fd, int timeoutMs) {
+    pollfd request = {fd, POLLIN, 0};
+    return poll(&request, 1, timeoutMs) > 0;
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Network.h"
+
+/**
+ * Render server protocol. Every message is a MessageHeader followed by size
+ * bytes of payload. Integers and floats are in the byte order of the host:
+ * both ends are expected to run on the same kind of machine.
+ *
+ * Client to server: Hello once, then Camera, Material, Light and Ack in any order.
+ * Server to client: Frame, each followed by an Ack from the client.
+ *
+ * Coordinator to worker: Scene once, then Jobs. Worker to coordinator: SceneHash
+ * once the scene is built, then a Result per Job, in the order of the jobs.
+ */
+enum class MessageType : uint32_t {
+    Hello = 1,
+    Camera,
+    Material,
+    Light,
+    Ack,
+    Frame,
+    Scene,
+    Job,
+    Result,
+    SceneHash,
+};
+
+struct MessageHeader {
+    uint32_t type;
+    uint32_t size;
+};
+
+/**
+ * Requested frame size
+ */
+struct HelloMessage {
+    uint32_t width, height;
+};
+
+/**
+ * One of the CameraMove values and its step
+ */
+struct CameraMessage {
+    uint32_t move;
+    float step;
+};
+
+/**
+ * New color of a material of the scene
+ */
+struct MaterialMessage {
+    uint32_t id;
+    float r, g, b;
+};
+
+/**
+ * New color of a light; a negative intensity keeps the current one
+ */
+struct LightMessage {
+    uint32_t index;
+    float r, g, b;
+    float intensity;
+};
+
+struct AckMessage {
+    uint64_t frame;
+};
+
+/**
+ * Followed by tiles TileMessage records, each followed by its size bytes of pixels
+ */
+struct FrameMessage {
+    uint64_t frame;
+    uint32_t width, height;
+    uint32_t tiles;
+    uint32_t reserved;  // 0, so no padding bytes of the sender reach the wire
+};
+
+static_assert(sizeof(FrameMessage) == 24);
+
+enum class TileEncoding : uint32_t {
+    Raw,    // rows of 32-bit pixels
+    Qoi,
+};
+
+struct TileMessage {
+    uint32_t x, y, width, height;
+    uint32_t encoding;
+    uint32_t size;
+};
+
+/**
+ * Followed by arguments NUL-terminated command line arguments that rebuild the scene
+ * once the random generator is seeded with seed
+ */
+struct SceneMessage {
+    uint32_t width, height;
+    uint32_t seed;
+    uint32_t arguments;
+};
+
+/**
+ * SceneHash of the scene a worker built from a SceneMessage, jobs only go to workers
+ * whose scene matches the one of the coordinator
+ */
+struct SceneHashMessage {
+    uint64_t hash;
+};
+
+/**
+ * Render the rectangle of a frame
+ */
+struct JobMessage {
+    uint64_t job;
+    uint64_t frame;
+    uint32_t x, y, width, height;
+};
+
+/**
+ * Followed by one TileMessage with the pixels of the job
+ */
+struct ResultMessage {
+    uint64_t job;
+    float renderTime; // ms
+    uint32_t reserved;  // 0
+};
+
+static_assert(sizeof(ResultMessage) == 16);
+
+constexpr uint32_t kMaxMessageSize = 1u << 28;
+
+/**
+ * Whether a width x height frame of 32-bit pixels fits one message. Frame sizes come
+ * from the peer, so this bounds what it can make us allocate.
+ */
+inline bool frameFitsMessage(uint32_t width, uint32_t height) {
+    return width > 0 && height > 0 && (uint64_t) width * height * 4 <= kMaxMessageSize;
+}
+
+inline bool sendMessage(int fd, MessageType type, const void *payload, size_t size) {
+    const MessageHeader header = {(uint32_t) type, (uint32_t) size};
+    return sendAll(fd, &header, sizeof(header)) && sendAll(fd, payload, size);
+}
+
+template<typename T>
+inline bool sendMessage(int fd, MessageType type, const T &payload) {
+    return sendMessage(fd, type, &payload, sizeof(payload));
+}
+
+/**
+ * Blocks until a whole message arrives
+ * @return false when the connection is closed or the message is malformed
+ */
+inline bool receiveMessage(int fd, MessageType &type, std::vector<uint8_t> &payload) {
+    MessageHeader header = {};
+    if (!receiveAll(fd, &header, sizeof(header)))
+        return false;
+    if (header.size > kMaxMessageSize) {
+        fprintf(stderr, "Message of %u bytes is too large\n", header.size);
+        return false;
+    }
+    type = (MessageType) header.type;
+    payload.resize(header.size);
+    return receiveAll(fd, payload.data(), header.size);
+}
+
+/**
+ * Copy a fixed-size message out of payload
+ * @return false if the sizes differ
+ */
+template<typename T>
+inline bool readMessage(const std::vector<uint8_t> &payload, T &message) {
+    if (payload.size() != sizeof(T))
+        return false;
+    memcpy(&message, payload.data(), sizeof(T));
+    return true;
+}
+
+template<typename T>
+inline void appendRecord(std::vector<uint8_t> &out, const T &record) {
+    const auto *bytes = (const uint8_t *) &record;
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * QOI image format (qoiformat.org), 4 channels. Pixels are 32-bit words
+ * whose bytes in memory are r, g, b, a, as produced by packColor().
+ * Rows are stride pixels apart, so a tile can be encoded in place.
+ */
+constexpr uint8_t kQoiIndex = 0x00, kQoiDiff = 0x40, kQoiLuma = 0x80, kQoiRun = 0xc0, kQoiRgb = 0xfe, kQoiRgba = 0xff;
+constexpr uint8_t kQoiMask = 0xc0;
+constexpr uint8_t kQoiPadding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+struct QoiPixel {
+    uint8_t r, g, b, a;
+
+    [[nodiscard]] int hash() const {
+        return (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+    }
+
+    bool operator==(const QoiPixel &other) const {
+        return r == other.r && g == other.g && b == other.b && a == other.a;
+    }
+};
+
+inline void putBigEndian(std::vector<uint8_t> &out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back((uint8_t) (value >> shift));
+}
+
+inline uint32_t getBigEndian(const uint8_t *bytes) {
+    return (uint32_t) bytes[0] << 24 | (uint32_t) bytes[1] << 16 | (uint32_t) bytes[2] << 8 | bytes[3];
+}
+
+/**
+ * Append the encoded image to out
+ */
+inline void encodeQoi(const uint32_t *pixels, int width, int height, int stride, std::vector<uint8_t> &out) {
+    out.reserve(out.size() + 14 + (size_t) width * height * 2 + sizeof(kQoiPadding));
+    out.insert(out.end(), {'q', 'o', 'i', 'f'});
+    putBigEndian(out, width);
+    putBigEndian(out, height);
+    out.push_back(4);
+    out.push_back(0);
+
+    QoiPixel seen[64] = {};
+    QoiPixel previous = {0, 0, 0, 255};
+    int run = 0;
+    for (int y = 0; y < height; y++) {
+        const uint32_t *row = pixels + (size_t) y * stride;
+        for (int x = 0; x < width; x++) {
+            QoiPixel pixel;
+            memcpy(&pixel, &row[x], 4);
+            if (pixel == previous) {
+                if (++run == 62) {
+                    out.push_back(kQoiRun | (run - 1));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                out.push_back(kQoiRun | (run - 1));
+                run = 0;
+            }
+            const int slot = pixel.hash();
+            if (seen[slot] == pixel) {
+                out.push_back(kQoiIndex | slot);
+            } else {
+                seen[slot] = pixel;
+                if (pixel.a == previous.a) {
+                    const int8_t dr = (int8_t) (pixel.r - previous.r);
+                    const int8_t dg = (int8_t) (pixel.g - previous.g);
+                    const int8_t db = (int8_t) (pixel.b - previous.b);
+                    const int8_t drg = (int8_t) (dr - dg), dbg = (int8_t) (db - dg);
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                        out.push_back(kQoiDiff | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                    } else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+                        out.push_back(kQoiLuma | (dg + 32));
+                        out.push_back((drg + 8) << 4 | (dbg + 8));
+                    } else {
+                        out.insert(out.end(), {kQoiRgb, pixel.r, pixel.g, pixel.b});
+                    }
+                } else {
+                    out.insert(out.end(), {kQoiRgba, pixel.r, pixel.g, pixel.b, pixel.a});
+                }
+            }
+            previous = pixel;
+        }
+    }
+    if (run > 0)
+        out.push_back(kQoiRun | (run - 1));
+    out.insert(out.end(), kQoiPadding, kQoiPadding + sizeof(kQoiPadding));
+}
+
+/**
+ * Decode an image of exactly width x height
+ * @return false on malformed data or a size mismatch
+ */
+inline bool decodeQoi(const uint8_t *data, size_t size, uint32_t *pixels, int width, int height, int stride) {
+    if (size < 14 + sizeof(kQoiPadding) || memcmp(data, "qoif", 4) != 0 ||
+        getBigEndian(data + 4) != (uint32_t) width || getBigEndian(data + 8) != (uint32_t) height)
+        return false;
+    const uint8_t *p = data + 14, *end = data + size - sizeof(kQoiPadding);
+    QoiPixel seen[64] = {};
+    QoiPixel pixel = {0, 0, 0, 255};
+    int run = 0;
+    for (int y = 0; y < height; y++) {
+        uint32_t *row = pixels + (size_t) y * stride;
+        for (int x = 0; x < width; x++) {
+            if (run > 0) {
+                run--;
+            } else {
+                if (p >= end)
+                    return false;
+                const uint8_t op = *p++;
+                if (op == kQoiRgb) {
+                    if (end - p < 3)
+                        return false;
+                    pixel.r = p[0], pixel.g = p[1], pixel.b = p[2];
+                    p += 3;
+                } else if (op == kQoiRgba) {
+                    if (end - p < 4)
+                        return false;
+                    pixel.r = p[0], pixel.g = p[1], pixel.b = p[2], pixel.a = p[3];
+                    p += 4;
+                } else if ((op & kQoiMask) == kQoiIndex) {
+                    pixel = seen[op];
+                } else if ((op & kQoiMask) == kQoiDiff) {
+                    pixel.r += ((op >> 4) & 3) - 2;
+                    pixel.g += ((op >> 2) & 3) - 2;
+                    pixel.b += (op & 3) - 2;
+                } else if ((op & kQoiMask) == kQoiLuma) {
+                    if (p >= end)
+                        return false;
+                    const int dg = (op & 0x3f) - 32;
+                    const uint8_t second = *p++;
+                    pixel.r += dg - 8 + (second >> 4);
+                    pixel.g += dg;
+                    pixel.b += dg - 8 + (second & 0x0f);
+                } else {
+                    run = op & 0x3f;
+                }
+                seen[pixel.hash()] = pixel;
+            }
+            memcpy(&row[x], &pixel, 4);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * PCG hash, good enough to decorrelate per-pixel seeds
+ */
+inline uint32_t hashSeed(uint32_t value) {
+    const uint32_t state = value * 747796405u + 2891336453u;
+    const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+/**
+ * Independent random sequences of one pixel and frame. Each use draws from its own,
+ * so that e.g. the lens position doesn't choose the light samples along with it.
+ */
+enum class SampleStream : uint32_t {
+    Lens = 1,
+    Lighting = 2,
+};
+
+/**
+ * Tiny per-thread random generator. Unlike rand() it has no shared state,
+ * so it is safe and reproducible inside render workers.
+ */
+class Sampler {
+public:
+    explicit Sampler(uint32_t seed) : state(hashSeed(seed) | 1) {}
+
+    Sampler(uint32_t x, uint32_t y, uint32_t frame, SampleStream stream) :
+            state(hashSeed(x ^ hashSeed(y ^ hashSeed(frame ^ hashSeed((uint32_t) stream)))) | 1) {}
+
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    /**
+     * @return uniform float in [0, 1)
+     */
+    float nextFloat() {
+        return (next() >> 8) * (1.0f / 16777216.0f);
+    }
+
+private:
+    uint32_t state;
+};
@@ -1,4 +1,8 @@
 #pragma once
+
+#include <cmath>
+#include <limits>
+
 #include "Vector.h"
 
 class Ray {
@@ -9,4 +13,35 @@ public:
     Vec3f origin;
 
     Ray(const Vec3f& origin, const Vec3f& direction) :origin(origin), direction(direction) {}
-};
\ No newline at end of file
+};
+
+constexpr float kHitErrorUlps = 16; // rounding error of a hit point, in ulps of its largest term
+
+/**
+ * Bound of the distance of orig + dir * t to the surface it was computed for,
+ * from the rounding of the intersection and of the point itself
+ */
+inline float hitPointError(const Vec3f &orig, const Vec3f &dir, float t) {
+    const Vec3f origMagnitude(fabsf(orig[0]), fabsf(orig[1]), fabsf(orig[2]));
+    const Vec3f dirMagnitude(fabsf(dir[0]), fabsf(dir[1]), fabsf(dir[2]));
+    const float magnitude = origMagnitude.maxComponent() + fabsf(t) * dirMagnitude.maxComponent();
+    return magnitude * kHitErrorUlps * std::numeric_limits<float>::epsilon();
+}
+
+/**
+ * Move point off its surface along the unit normal by error, then one more ulp away
+ * on every axis, so the move survives rounding at any distance from the origin
+ */
+inline Vec3f offsetRayOrigin(const Vec3f &point, const Vec3f &normal, float error) {
+    const Vec3f offset = normal * (error * (fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2])));
+    const Vec3f moved = point + offset;
+    float result[3];
+    for (int axis = 0; axis < 3; axis++) {
+        result[axis] = moved[axis];
+        if (offset[axis] > 0)
+            result[axis] = nextafterf(result[axis], std::numeric_limits<float>::infinity());
+        else if (offset[axis] < 0)
+            result[axis] = nextafterf(result[axis], -std::numeric_limits<float>::infinity());
+    }
+    return {result[0], result[1], result[2]};
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <memory>
@@ -8,6 +9,8 @@
 #include <cmath>
 #include <chrono>
 #include <thread>
+#include <mutex>
+#include <vector>
 
 #include "FastList.h"
 #include "Matrix.h"
@@ -16,60 +19,46 @@
 #include "SceneObject.h"
 #include "SceneProperties.h"
 #include "Light.h"
+#include "SceneSnapshot.h"
+#include "Camera.h"
+#include "Tracing.h"
+#include "Shading.h"
+#include "Accumulator.h"
+#include "Random.h"
+#include "RenderStats.h"
+#include "SDF.h"
 #include "SDLHelpers.h"
-
-HittableObject *trace(const Vec3f &orig, const Vec3f &dir, const FastList<HittableObject *> &objects, float &tNear) {
-    float nearest = kInfinity;
-    HittableObject * nearestObj = nullptr;
-    for (size_t objectIndex = objects.begin(); objectIndex != objects.end(); objects.nextIterator(&objectIndex)) {
-        HittableObject *object = nullptr;
-        objects.get(objectIndex, &object);
-        if (object->intersect({orig, dir}, tNear)) {
-            if (tNear < nearest) {
-                nearestObj = object;
-                nearest = tNear;
-            }
-        }
-    }
-    tNear = nearest;
-    return nearestObj;
-}
-
-inline Vec3f reflect(const Vec3f &I, const Vec3f &N) {
-    return I - 2 * I.dotProduct(N) * N;
-}
+#include "ThreadPool.h"
+#include "Kernels.h"
 
 RGBColor castRay(
         const Vec3f &orig, const Vec3f &dir,
-        const FastList<HittableObject *> &objects,
-        const FastList<Light *> &lights,
-        const SceneOptions &options,
+        const SceneSnapshot &scene,
+        Sampler &sampler,
         const uint32_t &depth = 0) {
+    const SceneOptions &options = scene.getOptions();
     if (depth > options.maxDepth)
         return options.backgroundColor;
 
-    HittableObject *object = nullptr;
+    const HittableObject *object = nullptr;
     float tNear = 0;
+    uint32_t primitive = 0;
     RGBColor hitColor = {};
-    if ((object = trace(orig, dir, objects, tNear))) {
-        Vec3f hitPoint = orig + dir * tNear;
-        Vec3f hitNormal = object->getSurfaceNormal(hitPoint, dir);
-        Vec3f diffuse = 0, specular = 0;
-        for (size_t lightIndex = lights.begin(); lightIndex != lights.end(); lights.nextIterator(&lightIndex)) {
-            Light *light = nullptr;
-            lights.get(lightIndex, &light);
-            RGBColor lightDir, lightIntensity; // not initialized on point
-            light->illuminate(hitPoint, lightDir, lightIntensity, tNear);
-
-            bool vis = !trace(hitPoint, -lightDir, objects, tNear);
-
-            diffuse += vis * lightIntensity *
-                       max(0.f, hitNormal.dotProduct(-lightDir));
-
-            RGBColor R = reflect(lightDir, hitNormal);
-            specular += vis * lightIntensity * binpow(max(0.f, R.dotProduct(-dir)), (int) object->n);
-        }
-        hitColor = object->albedo * diffuse * object->Kd * object->color + specular * object->Ks * object->color + object->ambient;
+    if ((object = trace(orig, dir, scene.getGeometry(), tNear, &primitive))) {
+        const MaterialTable &materials = scene.getMaterials();
+        SurfaceHit hit = {};
+        const Vec3f point = hitPoint(*object, orig, dir, tNear, options.precision);
+        hit.normal = object->getPrimitiveNormal(point, dir, primitive);
+        hit.point = secondaryRayOrigin(*object, orig, dir, tNear, point, hit.normal);
+        hit.viewDir = dir;
+        hit.object = object;
+        hit.material = &materials.get(object->materialId);
+        // secondary rays have no pixel footprint, so textures are looked up unfiltered
+        hit.color = materials.surfaceColor(*hit.material, *object, point, primitive, 0);
+        hit.sampler = &sampler;
+        hit.occluders = nullptr;
+        const std::vector<uint32_t> &lights = scene.getAllPointLights();
+        hitColor = kernels().shadeHit(hit, scene, {lights.data(), lights.size()});
     } else {
         hitColor = options.backgroundColor;
     }
@@ -77,44 +66,182 @@ RGBColor castRay(
     return hitColor;
 }
 
-void threadedRend(const SceneOptions &options, const FastList<HittableObject *> &objects,
-                  const FastList<Light *> &lights, SDL_Surface *surface, int id=0, int threadsCount=8) {
-    const float scale = tan(deg2rad(options.fov * 0.5));
-    const float imageAspectRatio = options.width / (float) options.height;
-    const Vec3f orig = options.cameraToWorld.multVecMatrix(Vec3f(0));
-    for (int j = id; j < options.height; j+=threadsCount) {
-        for (int i = 0; i < options.width; ++i) {
-            float x = (2 * (i + 0.5f) / (float) options.width - 1) * imageAspectRatio * scale;
-            float y = (1 - 2 * (j + 0.5f) / (float) options.height) * scale;
-            Vec3f dir = options.cameraToWorld.multDirMatrix(Vec3f(x, y, -1));
-            dir.normalize();
-            RGBColor color = castRay(orig, dir, objects, lights, options);
-            const float deltaAdjustment = 0.55;
-            color = RGBColor(pow(color[0], deltaAdjustment), pow(color[1], deltaAdjustment), pow(color[2], deltaAdjustment) ) * 255;
-            setPixel(surface, i, j, ColorToUint(
-                    clamp(0, 255, color[0]),
-                    clamp(0, 255, color[1]),
-                    clamp(0, 255, color[2]),
-                    255)
-            );
-        }
-        if (id == 0) {
-            fprintf(stderr, "\rCompletion: %.2f", 100.0f * j / options.height);
+constexpr int kTileSize = 16;
+
+static_assert(kTileSize <= kRayRowCapacity, "tile row must fit into a RayRow");
+
+constexpr float kPackGamma = 0.55;   // exponent of the gamma packColor() applies
+
+inline Uint32 packColor(RGBColor color) {
+    color = RGBColor(pow(color[0], kPackGamma), pow(color[1], kPackGamma), pow(color[2], kPackGamma)) * 255;
+    return ColorToUint(
+            clamp(0, 255, color[0]),
+            clamp(0, 255, color[1]),
+            clamp(0, 255, color[2]),
+            255);
+}
+
+/**
+ * Collect the point lights whose influence sphere reaches the box of tile hit points
+ */
+LightList cullLights(const SceneSnapshot &scene, const Vec3f &low, const Vec3f &high, std::vector<uint32_t> &storage) {
+    const std::vector<PointLight> &lights = scene.getPointLights();
+    const std::vector<float> &radii2 = scene.getPointLightRadii2();
+    storage.clear();
+    for (uint32_t i = 0; i < lights.size(); i++) {
+        const Vec3f &position = lights[i].getPosition();
+        float distance2 = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            const float outside = max(0.f, max(low[axis] - position[axis], position[axis] - high[axis]));
+            distance2 += outside * outside;
         }
+        if (distance2 <= radii2[i])
+            storage.push_back(i);
     }
+    return {storage.data(), storage.size()};
 }
 
-void render(const SceneOptions &options, const FastList<HittableObject *> &objects,
-            const FastList<Light *> &lights, SDL_Surface *surface, int threadsCount=8) {
-    using std::thread;
-    auto** threads = static_cast<thread**>(calloc(threadsCount, sizeof(thread*)));
+struct TileSample {
+    const HittableObject *object;
+    Vec3f point;
+    Vec3f rayOrigin; // of the shadow rays, see secondaryRayOrigin()
+    Vec3f normal;
+    Vec3f dir;
+    float distance;
+    uint32_t primitive;
+};
 
-    for (int i=0; i < threadsCount; i++) {
-        threads[i] = new thread(threadedRend, options, objects, lights, surface, i, threadsCount);
+/**
+ * Renders a tile in two passes: visibility of every pixel first, then shading
+ * with only the point lights that can affect the tile's visible points
+ */
+void renderTile(const SceneSnapshot &scene, const Camera &camera, SDL_Surface *surface,
+                FrameAccumulator *accumulator, RenderStats &stats, int tileX, int tileY) {
+    const SceneOptions &options = scene.getOptions();
+    const int x0 = tileX * kTileSize, y0 = tileY * kTileSize;
+    const int width = min(kTileSize, (int) options.width - x0);
+    const int height = min(kTileSize, (int) options.height - y0);
+    TileSample samples[kTileSize * kTileSize];
+    const SdfCounters sdfBefore = sdfCounters();
+    Vec3f low(kInfinity), high(-kInfinity);
+    RayRow rays;
+    for (int j = 0; j < height; ++j) {
+        camera.generateRow(y0 + j, x0, width, rays, scene.getFrame());
+        for (int k = 0; k < width; ++k) {
+            TileSample &sample = samples[j * kTileSize + k];
+            const Vec3f orig = rays.perRayOrigin ? rays.origin(k) : camera.getOrigin();
+            sample.dir = rays.direction(k);
+            sample.distance = 0;
+            sample.primitive = 0;
+            sample.object = trace(orig, sample.dir, scene.getGeometry(), sample.distance, &sample.primitive);
+            if (sample.object == nullptr)
+                continue;
+            sample.point = hitPoint(*sample.object, orig, sample.dir, sample.distance, options.precision);
+            sample.normal = sample.object->getPrimitiveNormal(sample.point, sample.dir, sample.primitive);
+            sample.rayOrigin = secondaryRayOrigin(*sample.object, orig, sample.dir, sample.distance, sample.point,
+                                                  sample.normal);
+            const Vec3f &p = sample.point;
+            low = Vec3f(min(low[0], p[0]), min(low[1], p[1]), min(low[2], p[2]));
+            high = Vec3f(max(high[0], p[0]), max(high[1], p[1]), max(high[2], p[2]));
+        }
     }
-    for (int i=0; i < threadsCount; i++) {
-        threads[i]->join();
-        delete threads[i];
+
+    thread_local std::vector<uint32_t> tileLights;
+    const LightList visible = cullLights(scene, low, high, tileLights);
+    thread_local OccluderCache occluders;
+    occluders.reset(scene.getLights().getSize());
+    occluders.stats = {};
+    const MaterialTable &materials = scene.getMaterials();
+
+    RGBColor colors[kTileSize];
+    for (int j = 0; j < height; ++j) {
+        for (int k = 0; k < width; ++k) {
+            const TileSample &sample = samples[j * kTileSize + k];
+            RGBColor color = options.backgroundColor;
+            if (sample.object != nullptr) {
+                Sampler sampler(x0 + k, y0 + j, scene.getFrame(), SampleStream::Lighting);
+                const Material &material = materials.get(sample.object->materialId);
+                const RGBColor albedo = materials.surfaceColor(material, *sample.object, sample.point, sample.primitive,
+                                                                camera.footprint(sample.distance));
+                const SurfaceHit hit = {sample.rayOrigin, sample.normal, sample.dir, sample.object, &material, albedo,
+                                        &sampler, &occluders};
+                color = kernels().shadeHit(hit, scene, visible);
+            }
+            if (accumulator != nullptr)
+                color = accumulator->add(x0 + k, y0 + j, color, options.accumulatedFrames);
+            colors[k] = color;
+        }
+        kernels().packRow(colors, width, getPixelPtr(surface, x0, y0 + j));
+    }
+    stats = occluders.stats;
+    stats.sdfMarches = sdfCounters().marches - sdfBefore.marches;
+    stats.sdfSteps = sdfCounters().steps - sdfBefore.steps;
+}
+
+/**
+ * Renders the width x height rectangle at x, y of the frame into the same place of surface,
+ * tile by tile on the pool. x and y are multiples of kTileSize.
+ */
+void renderRegion(const SceneSnapshot &scene, const Camera &camera, SDL_Surface *surface, ThreadPool &pool,
+                  int x, int y, int width, int height, FrameAccumulator *accumulator = nullptr,
+                  RenderStats *stats = nullptr) {
+    const int tileX0 = x / kTileSize, tileY0 = y / kTileSize;
+    const int tilesX = (x + width + kTileSize - 1) / kTileSize - tileX0;
+    const int tilesY = (y + height + kTileSize - 1) / kTileSize - tileY0;
+    std::mutex statsLock;
+    pool.parallelFor(tilesX * tilesY, [&, surface, accumulator, stats, tilesX](size_t tile) {
+        RenderStats tileStats;
+        renderTile(scene, camera, surface, accumulator, tileStats, tileX0 + (int) tile % tilesX,
+                   tileY0 + (int) tile / tilesX);
+        if (stats != nullptr) {
+            std::lock_guard<std::mutex> guard(statsLock);
+            *stats += tileStats;
+        }
+    });
+}
+
+/**
+ * Renders the snapshot into surface on the pool, tile by tile. Workers share the snapshot
+ * by const reference; the local reference keeps it alive until every tile is finished.
+ * With an accumulator the frame is averaged with the previous frames of the same scene.
+ */
+void render(const SceneSnapshotPtr &scene, SDL_Surface *surface, ThreadPool &pool,
+            FrameAccumulator *accumulator = nullptr, RenderStats *stats = nullptr) {
+    const SceneSnapshotPtr keepAlive = scene;
+    const SceneOptions &options = scene->getOptions();
+    renderRegion(*keepAlive, Camera(options), surface, pool, 0, 0, (int) options.width, (int) options.height,
+                 accumulator, stats);
+}
+
+/**
+ * Renders several frames in one loop over the tiles of all of them, so that
+ * frames too small to occupy every thread on their own still keep the pool busy.
+ * scenes[i] is rendered into surfaces[i], and into accumulators[i] if there are accumulators.
+ */
+void renderFrames(const std::vector<SceneSnapshotPtr> &scenes, const std::vector<SDL_Surface *> &surfaces,
+                  ThreadPool &pool, const std::vector<FrameAccumulator *> &accumulators = {},
+                  RenderStats *stats = nullptr) {
+    std::vector<Camera> cameras;
+    std::vector<size_t> firstTiles = {0};   // index of the first tile of every frame, then the total
+    std::vector<int> tilesX;
+    for (const SceneSnapshotPtr &scene: scenes) {
+        const SceneOptions &options = scene->getOptions();
+        cameras.emplace_back(options);
+        tilesX.push_back(((int) options.width + kTileSize - 1) / kTileSize);
+        const int tilesY = ((int) options.height + kTileSize - 1) / kTileSize;
+        firstTiles.push_back(firstTiles.back() + tilesX.back() * tilesY);
     }
-    free(threads);
-}
\ No newline at end of file
+    std::mutex statsLock;
+    pool.parallelFor(firstTiles.back(), [&, stats](size_t tile) {
+        const size_t frame = std::upper_bound(firstTiles.begin(), firstTiles.end(), tile) - firstTiles.begin() - 1;
+        const int index = (int) (tile - firstTiles[frame]);
+        RenderStats tileStats;
+        FrameAccumulator *accumulator = accumulators.empty() ? nullptr : accumulators[frame];
+        renderTile(*scenes[frame], cameras[frame], surfaces[frame], accumulator, tileStats, index % tilesX[frame],
+                   index / tilesX[frame]);
+        if (stats != nullptr) {
+            std::lock_guard<std::mutex> guard(statsLock);
+            *stats += tileStats;
+        }
+    });
+}
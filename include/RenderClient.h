@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "CameraControl.h"
+#include "Protocol.h"
+#include "TileCodec.h"
+
+/**
+ * Connection to a render server. Keeps the last full frame: every received
+ * frame patches its changed tiles into it and is acknowledged right away.
+ */
+class RenderClient {
+public:
+    RenderClient() = default;
+
+    RenderClient(const RenderClient &other) = delete;
+
+    RenderClient &operator=(const RenderClient &other) = delete;
+
+    ~RenderClient() {
+        if (server >= 0)
+            close(server);
+    }
+
+    /**
+     * Connect and request frames of width x height
+     */
+    bool connect(const char *address, int width, int height) {
+        server = connectSocket(address);
+        if (server < 0)
+            return false;
+        return sendMessage(server, MessageType::Hello, HelloMessage{(uint32_t) width, (uint32_t) height});
+    }
+
+    /**
+     * @return true if a frame is waiting, false after timeoutMs
+     */
+    [[nodiscard]] bool frameReady(int timeoutMs) const {
+        return waitReadable(server, timeoutMs);
+    }
+
+    /**
+     * Block until the next frame arrives, apply it and acknowledge it
+     * @return false when the connection is closed or the frame is malformed
+     */
+    bool receiveFrame() {
+        MessageType type;
+        FrameMessage header = {};
+        if (!receiveMessage(server, type, payload) || type != MessageType::Frame || payload.size() < sizeof(header))
+            return false;
+        memcpy(&header, payload.data(), sizeof(header));
+        if (!frameFitsMessage(header.width, header.height))
+            return false;
+        if (header.width != (uint32_t) width || header.height != (uint32_t) height) {
+            width = (int) header.width;
+            height = (int) header.height;
+            pixels.assign((size_t) width * height, 0);
+        }
+        size_t offset = sizeof(header);
+        for (uint32_t i = 0; i < header.tiles; i++) {
+            TileMessage tile = {};
+            if (payload.size() - offset < sizeof(tile))
+                return false;
+            memcpy(&tile, payload.data() + offset, sizeof(tile));
+            offset += sizeof(tile);
+            // written so that x + width can't wrap around
+            if (payload.size() - offset < tile.size || tile.width > (uint32_t) width ||
+                tile.x > (uint32_t) width - tile.width || tile.height > (uint32_t) height ||
+                tile.y > (uint32_t) height - tile.height ||
+                !decodeTile(tile, payload.data() + offset, &pixels[(size_t) tile.y * width + tile.x], width))
+                return false;
+            offset += tile.size;
+        }
+        frame = header.frame;
+        lastTiles = header.tiles;
+        lastBytes = payload.size();
+        return sendMessage(server, MessageType::Ack, AckMessage{frame});
+    }
+
+    bool sendCameraMove(CameraMove move, float step) {
+        return sendMessage(server, MessageType::Camera, CameraMessage{(uint32_t) move, step});
+    }
+
+    bool sendMaterialColor(uint32_t id, float r, float g, float b) {
+        return sendMessage(server, MessageType::Material, MaterialMessage{id, r, g, b});
+    }
+
+    bool sendLightColor(uint32_t index, float r, float g, float b, float intensity = -1) {
+        return sendMessage(server, MessageType::Light, LightMessage{index, r, g, b, intensity});
+    }
+
+    /**
+     * Last frame: rows of width 32-bit pixels, bytes r, g, b, a
+     */
+    [[nodiscard]] const std::vector<uint32_t> &getPixels() const {
+        return pixels;
+    }
+
+    [[nodiscard]] int getWidth() const {
+        return width;
+    }
+
+    [[nodiscard]] int getHeight() const {
+        return height;
+    }
+
+    [[nodiscard]] uint64_t getFrame() const {
+        return frame;
+    }
+
+    /**
+     * Changed tiles and bytes of the last frame
+     */
+    [[nodiscard]] uint32_t getLastTiles() const {
+        return lastTiles;
+    }
+
+    [[nodiscard]] size_t getLastBytes() const {
+        return lastBytes;
+    }
+
+private:
+    int server = -1;
+    int width = 0, height = 0;
+    uint64_t frame = 0;
+    uint32_t lastTiles = 0;
+    size_t lastBytes = 0;
+    std::vector<uint32_t> pixels;
+    std::vector<uint8_t> payload;
+};
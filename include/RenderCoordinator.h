@@ -0,0 +1,312 @@
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+
+#include "GeometryHelpers.h"
+#include "ImageEncoder.h"
+#include "Protocol.h"
+#include "SDLHelpers.h"
+#include "Settings.h"
+#include "TileCodec.h"
+
+constexpr size_t kJobsPerWorker = 2;    // queued at every worker, so it never waits for its next job
+constexpr uint32_t kJobAttempts = 3;    // workers lost on a job before the whole render fails
+constexpr uint32_t kSceneSeed = 1;      // rand() starts from seed 1 without srand(), as in the interactive mode
+
+/**
+ * Splits settings.frames frames of settings.width x settings.height into square
+ * jobs of settings.jobSize pixels, rounded up to whole render tiles, hands them out to the worker processes that
+ * connect and saves every frame to settings.output as soon as it is complete.
+ *
+ * Jobs are handed out in frame order. A worker that runs out of jobs steals the
+ * oldest unfinished job of another worker, whichever result comes first wins:
+ * slow or stuck workers don't hold up the last frames. The jobs of a worker that
+ * disconnects go back to the front of the queue.
+ *
+ * Workers rebuild the scene from the command line arguments of the coordinator, a
+ * seed and the asset files they find at the same paths. A worker only gets jobs
+ * once the SceneHash of what it built matches the one of the coordinator.
+ */
+class RenderCoordinator {
+public:
+    /**
+     * @param tileSize - edge of the tiles of the renderer, jobs are made of whole tiles
+     */
+    RenderCoordinator(const RenderSettings &settings, int tileSize) :
+            settings(settings), jobSize((int) max((size_t) 1, (settings.jobSize + tileSize - 1) / tileSize) * tileSize),
+            arguments(sceneArguments(settings)) {}
+
+    RenderCoordinator(const RenderCoordinator &other) = delete;
+
+    RenderCoordinator &operator=(const RenderCoordinator &other) = delete;
+
+    ~RenderCoordinator() {
+        for (Worker &worker: workers)
+            close(worker.fd);
+        for (Frame &frame: frames) {
+            if (frame.surface != nullptr)
+                freeSurface(frame.surface);
+        }
+        if (listener >= 0)
+            close(listener);
+    }
+
+    bool listen(const char *address) {
+        listener = listenSocket(address);
+        return listener >= 0;
+    }
+
+    /**
+     * Render every frame
+     * @param encoder - saves the frames in the background
+     * @param sceneHash - SceneHash of the scene built from settings after seeding rand() with kSceneSeed
+     * @param waiting - called while no worker is connected, returns false to give up
+     * @return false if the frames could not be rendered
+     */
+    bool run(ImageEncoder &encoder, uint64_t sceneHash, const std::function<bool()> &waiting) {
+        this->encoder = &encoder;
+        this->sceneHash = sceneHash;
+        const int width = (int) settings.width, height = (int) settings.height, size = jobSize;
+        for (uint64_t frame = 0; frame < settings.frames; frame++) {
+            for (int y = 0; y < height; y += size) {
+                for (int x = 0; x < width; x += size)
+                    jobs.push_back({frame, (uint32_t) x, (uint32_t) y, (uint32_t) min(size, width - x),
+                                    (uint32_t) min(size, height - y)});
+            }
+        }
+        frames.resize(settings.frames);
+        const size_t jobsPerFrame = jobs.size() / settings.frames;
+        for (Frame &frame: frames)
+            frame.remaining = jobsPerFrame;
+        for (size_t i = 0; i < jobs.size(); i++)
+            pending.push_back(i);
+
+        const auto timeStart = std::chrono::high_resolution_clock::now();
+        std::vector<pollfd> requests;
+        while (savedFrames < settings.frames && !failed) {
+            for (size_t i = 0; i < workers.size(); i++) {
+                if (workers[i].ready && !assignJobs(workers[i]))
+                    dropWorker(i--);
+            }
+            requests.assign(1, {listener, POLLIN, 0});
+            for (const Worker &worker: workers)
+                requests.push_back({worker.fd, POLLIN, 0});
+            const int ready = poll(requests.data(), requests.size(), 1000);
+            if (ready < 0 && errno != EINTR) {
+                fprintf(stderr, "Can't wait for workers: %s\n", strerror(errno));
+                return false;
+            }
+            if (ready <= 0) {
+                if (workers.empty() && !waiting()) {
+                    fprintf(stderr, "No workers left\n");
+                    return false;
+                }
+                continue;
+            }
+            // dropping a worker moves the ones after it: walk backwards, accept new workers last
+            for (size_t i = requests.size() - 1; i > 0; i--) {
+                if (requests[i].revents == 0)
+                    continue;
+                Worker &worker = workers[i - 1];
+                if (!(worker.ready ? receiveResult(worker) : receiveSceneHash(worker)))
+                    dropWorker(i - 1);
+            }
+            if (requests[0].revents != 0)
+                addWorker();
+        }
+        if (failed)
+            return false;
+
+        const auto passedTime = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - timeStart);
+        fprintf(stderr, "\n%zu frames in %.2f s, %.2f frames/s, %zu jobs, %zu stolen, %zu retried\n",
+                (size_t) settings.frames, passedTime.count(), settings.frames / passedTime.count(), jobs.size(),
+                stolenJobs, retriedJobs);
+        for (const Worker &worker: workers)
+            fprintf(stderr, "Worker %zu: %zu jobs, %.1f ms rendering\n", worker.id, worker.completed,
+                    worker.renderTime);
+        return true;
+    }
+
+private:
+    struct Job {
+        uint64_t frame;
+        uint32_t x, y, width, height;
+        uint32_t holders = 0;   // workers with the job queued
+        uint32_t failures = 0;  // workers lost while holding it
+        bool done = false;
+    };
+
+    struct Worker {
+        int fd;
+        size_t id;
+        std::deque<size_t> jobs;    // in the order the worker renders them
+        size_t completed = 0;
+        float renderTime = 0;       // ms
+        bool ready = false;         // built the scene of the coordinator
+    };
+
+    struct Frame {
+        SDL_Surface *surface = nullptr;
+        size_t remaining = 0;
+    };
+
+    void addWorker() {
+        const int fd = acceptSocket(listener);
+        if (fd < 0)
+            return;
+        std::vector<uint8_t> message;
+        SceneMessage scene = {(uint32_t) settings.width, (uint32_t) settings.height, kSceneSeed,
+                              (uint32_t) arguments.size()};
+        appendRecord(message, scene);
+        for (const std::string &argument: arguments)
+            message.insert(message.end(), argument.c_str(), argument.c_str() + argument.size() + 1);
+        if (!sendMessage(fd, MessageType::Scene, message.data(), message.size())) {
+            close(fd);
+            return;
+        }
+        workers.push_back({fd, connectedWorkers++});
+        fprintf(stderr, "Worker %zu connected\n", workers.back().id);
+    }
+
+    bool receiveSceneHash(Worker &worker) {
+        MessageType type;
+        SceneHashMessage message = {};
+        if (!receiveMessage(worker.fd, type, payload) || type != MessageType::SceneHash ||
+            !readMessage(payload, message))
+            return false;
+        if (message.hash != sceneHash) {
+            fprintf(stderr, "\nWorker %zu built a different scene, check its version and asset files\n", worker.id);
+            return false;
+        }
+        worker.ready = true;
+        return true;
+    }
+
+    /**
+     * Fill the queue of worker: from the pending jobs, or an idle worker steals
+     * the oldest unfinished job that only one other worker holds
+     */
+    bool assignJobs(Worker &worker) {
+        while (worker.jobs.size() < kJobsPerWorker) {
+            size_t id = jobs.size();
+            if (!pending.empty()) {
+                id = pending.front();
+                pending.pop_front();
+            } else if (worker.jobs.empty()) {
+                while (firstUnfinished < jobs.size() && jobs[firstUnfinished].done)
+                    firstUnfinished++;
+                for (size_t i = firstUnfinished; i < jobs.size() && id == jobs.size(); i++) {
+                    if (!jobs[i].done && jobs[i].holders == 1)
+                        id = i;
+                }
+                if (id != jobs.size())
+                    stolenJobs++;
+            }
+            if (id == jobs.size())
+                return true;
+            Job &job = jobs[id];
+            job.holders++;
+            worker.jobs.push_back(id);
+            if (!sendMessage(worker.fd, MessageType::Job,
+                             JobMessage{id, job.frame, job.x, job.y, job.width, job.height}))
+                return false;
+        }
+        return true;
+    }
+
+    bool receiveResult(Worker &worker) {
+        MessageType type;
+        ResultMessage result = {};
+        TileMessage tile = {};
+        if (!receiveMessage(worker.fd, type, payload) || type != MessageType::Result ||
+            payload.size() < sizeof(result) + sizeof(tile))
+            return false;
+        memcpy(&result, payload.data(), sizeof(result));
+        memcpy(&tile, payload.data() + sizeof(result), sizeof(tile));
+        if (worker.jobs.empty() || result.job != worker.jobs.front())
+            return false;
+        Job &job = jobs[result.job];
+        if (tile.x != job.x || tile.y != job.y || tile.width != job.width || tile.height != job.height ||
+            tile.size != payload.size() - sizeof(result) - sizeof(tile))
+            return false;
+        Frame &frame = frames[job.frame];
+        if (!job.done) {
+            if (frame.surface == nullptr)
+                frame.surface = createSurface((int) settings.width, (int) settings.height);
+            if (!decodeTile(tile, payload.data() + sizeof(result) + sizeof(tile),
+                            getPixelPtr(frame.surface, (int) tile.x, (int) tile.y), frame.surface->pitch / 4))
+                return false;
+        }
+        worker.jobs.pop_front();
+        job.holders--;
+        worker.completed++;
+        worker.renderTime += result.renderTime;
+        // the result of a stolen job that arrived second
+        if (job.done)
+            return true;
+        job.done = true;
+        if (--frame.remaining == 0)
+            saveFrame(job.frame);
+        return true;
+    }
+
+    void saveFrame(uint64_t index) {
+        Frame &frame = frames[index];
+        const std::string path = formatFramePath(settings.output, index);
+        encoder->save(frame.surface, frame.surface->w, frame.surface->h, path);
+        freeSurface(frame.surface);
+        frame.surface = nullptr;
+        savedFrames++;
+        fprintf(stderr, "\rSaved %s, %zu of %zu frames ", path.c_str(), savedFrames, (size_t) settings.frames);
+    }
+
+    /**
+     * Forget the worker at index and queue its unfinished jobs again
+     */
+    void dropWorker(size_t index) {
+        Worker &worker = workers[index];
+        fprintf(stderr, "\nWorker %zu disconnected with %zu jobs\n", worker.id, worker.jobs.size());
+        // front first, so the jobs keep their order at the front of the queue
+        for (auto id = worker.jobs.rbegin(); id != worker.jobs.rend(); ++id) {
+            Job &job = jobs[*id];
+            if (job.done || --job.holders > 0)
+                continue;
+            if (++job.failures >= kJobAttempts) {
+                fprintf(stderr, "Job %zu of frame %llu failed on %u workers\n", *id,
+                        (unsigned long long) job.frame, job.failures);
+                failed = true;
+            }
+            pending.push_front(*id);
+            retriedJobs++;
+        }
+        close(worker.fd);
+        workers.erase(workers.begin() + (ptrdiff_t) index);
+    }
+
+    const RenderSettings settings;
+    const int jobSize;
+    const std::vector<std::string> arguments;
+    ImageEncoder *encoder = nullptr;
+    uint64_t sceneHash = 0;
+    int listener = -1;
+    std::vector<Worker> workers;
+    std::vector<Job> jobs;
+    std::deque<size_t> pending;
+    std::vector<Frame> frames;
+    size_t firstUnfinished = 0;
+    size_t savedFrames = 0;
+    size_t connectedWorkers = 0;
+    size_t stolenJobs = 0, retriedJobs = 0;
+    bool failed = false;
+    std::vector<uint8_t> payload;
+};
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "FastList.h"
+#include "GeometryHelpers.h"
+#include "Light.h"
+#include "Material.h"
+#include "SceneProperties.h"
+#include "CameraControl.h"
+#include "Protocol.h"
+#include "TileCodec.h"
+#include "SDLHelpers.h"
+#include "ThreadPool.h"
+
+constexpr int kStreamTile = 32;
+
+/**
+ * Serves rendered frames to one client at a time. Only the tiles that differ
+ * from the previous frame sent are transmitted, QOI-compressed. At most window
+ * frames may wait for an acknowledgement; while the window is full the caller
+ * should stop rendering, so a slow client slows the server down instead of
+ * queueing frames.
+ */
+class RenderServer {
+public:
+    explicit RenderServer(size_t window) : window(window < 1 ? 1 : window) {}
+
+    RenderServer(const RenderServer &other) = delete;
+
+    RenderServer &operator=(const RenderServer &other) = delete;
+
+    ~RenderServer() {
+        dropClient();
+        if (listener >= 0)
+            close(listener);
+    }
+
+    bool listen(const char *address) {
+        listener = listenSocket(address);
+        return listener >= 0;
+    }
+
+    [[nodiscard]] bool hasClient() const {
+        return client >= 0;
+    }
+
+    /**
+     * Block until a client connects and says hello
+     */
+    bool acceptClient() {
+        dropClient();
+        client = acceptSocket(listener);
+        if (client < 0)
+            return false;
+        MessageType type;
+        std::vector<uint8_t> payload;
+        HelloMessage hello = {};
+        if (!receiveMessage(client, type, payload) || type != MessageType::Hello || !readMessage(payload, hello) ||
+            !frameFitsMessage(hello.width, hello.height) || hello.width > 8192 || hello.height > 8192) {
+            fprintf(stderr, "Client did not say hello\n");
+            dropClient();
+            return false;
+        }
+        width = (int) hello.width;
+        height = (int) hello.height;
+        fprintf(stderr, "Client connected, %d x %d\n", width, height);
+        return true;
+    }
+
+    /**
+     * Requested frame size
+     */
+    [[nodiscard]] int getWidth() const {
+        return width;
+    }
+
+    [[nodiscard]] int getHeight() const {
+        return height;
+    }
+
+    /**
+     * True while fewer than window frames wait for an acknowledgement
+     */
+    [[nodiscard]] bool canSend() const {
+        return hasClient() && sent - acknowledged < window;
+    }
+
+    /**
+     * Apply the messages of the client to the scene, waiting up to timeoutMs for the first one.
+     * Drops the client on a closed connection or a malformed message.
+     */
+    void poll(int timeoutMs, SceneOptions &options, MaterialTable &materials, FastList<Light *> &lights,
+              bool &paused) {
+        while (hasClient() && waitReadable(client, timeoutMs)) {
+            timeoutMs = 0;
+            MessageType type;
+            if (!receiveMessage(client, type, payload) || !handle(type, options, materials, lights, paused)) {
+                fprintf(stderr, "Client disconnected\n");
+                dropClient();
+            }
+        }
+    }
+
+    /**
+     * Send the top-left width x height corner of surface as frame.
+     * Tiles are compared and compressed in parallel on pool.
+     */
+    bool sendFrame(SDL_Surface *surface, uint64_t frame, ThreadPool &pool) {
+        if (!hasClient())
+            return false;
+        const int tilesX = (width + kStreamTile - 1) / kStreamTile;
+        const int tilesY = (height + kStreamTile - 1) / kStreamTile;
+        const bool full = previous.size() != (size_t) width * height;
+        if (full)
+            previous.assign((size_t) width * height, 0);
+        encoded.resize(tilesX * tilesY);
+        pool.parallelFor(tilesX * tilesY, [&, tilesX, full](size_t tile) {
+            encodeTile(surface, (int) tile % tilesX * kStreamTile, (int) tile / tilesX * kStreamTile, full,
+                       encoded[tile]);
+        });
+
+        message.clear();
+        FrameMessage header = {frame, (uint32_t) width, (uint32_t) height, 0, 0};
+        appendRecord(message, header);
+        for (const std::vector<uint8_t> &tile: encoded) {
+            if (tile.empty())
+                continue;
+            message.insert(message.end(), tile.begin(), tile.end());
+            header.tiles++;
+        }
+        memcpy(message.data(), &header, sizeof(header));
+        if (!sendMessage(client, MessageType::Frame, message.data(), message.size())) {
+            fprintf(stderr, "Client disconnected\n");
+            dropClient();
+            return false;
+        }
+        sent++;
+        lastTiles = header.tiles;
+        lastBytes = message.size();
+        return true;
+    }
+
+    /**
+     * Tiles and bytes of the last frame sent
+     */
+    [[nodiscard]] uint32_t getLastTiles() const {
+        return lastTiles;
+    }
+
+    [[nodiscard]] size_t getLastBytes() const {
+        return lastBytes;
+    }
+
+private:
+    bool handle(MessageType type, SceneOptions &options, MaterialTable &materials, FastList<Light *> &lights,
+                bool &paused) {
+        switch (type) {
+            case MessageType::Camera: {
+                CameraMessage camera = {};
+                if (!readMessage(payload, camera) || camera.move > (uint32_t) CameraMove::Pause)
+                    return false;
+                applyCameraMove((CameraMove) camera.move, camera.step, options, paused);
+                return true;
+            }
+            case MessageType::Material: {
+                MaterialMessage material = {};
+                if (!readMessage(payload, material))
+                    return false;
+                if (material.id < materials.getSize())
+                    materials.get(material.id).color = {material.r, material.g, material.b};
+                return true;
+            }
+            case MessageType::Light: {
+                LightMessage edit = {};
+                if (!readMessage(payload, edit))
+                    return false;
+                Light *light = nullptr;
+                size_t i = lights.begin();
+                for (uint32_t skipped = 0; i != lights.end() && skipped < edit.index; lights.nextIterator(&i))
+                    skipped++;
+                if (i != lights.end())
+                    lights.get(i, &light);
+                if (light != nullptr) {
+                    light->color = {edit.r, edit.g, edit.b};
+                    if (edit.intensity >= 0)
+                        light->intensity = edit.intensity;
+                }
+                return true;
+            }
+            case MessageType::Ack: {
+                AckMessage ack = {};
+                if (!readMessage(payload, ack) || acknowledged >= sent)
+                    return false;
+                acknowledged++;
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+
+    /**
+     * Leave out empty if the tile did not change since the previous frame
+     */
+    void encodeTile(SDL_Surface *surface, int x0, int y0, bool full, std::vector<uint8_t> &out) {
+        out.clear();
+        const int tileWidth = min(kStreamTile, width - x0), tileHeight = min(kStreamTile, height - y0);
+        const auto *pixels = (const uint32_t *) getPixelPtr(surface, x0, y0);
+        const int stride = surface->pitch / 4;
+        bool changed = full;
+        for (int j = 0; j < tileHeight && !changed; j++)
+            changed = memcmp(pixels + (size_t) j * stride, &previous[(size_t) (y0 + j) * width + x0],
+                             tileWidth * 4) != 0;
+        if (!changed)
+            return;
+        for (int j = 0; j < tileHeight; j++)
+            memcpy(&previous[(size_t) (y0 + j) * width + x0], pixels + (size_t) j * stride, tileWidth * 4);
+
+        appendEncodedTile(out, pixels, x0, y0, tileWidth, tileHeight, stride);
+    }
+
+    void dropClient() {
+        if (client >= 0)
+            close(client);
+        client = -1;
+        sent = acknowledged = 0;
+        previous.clear();
+    }
+
+    const size_t window;
+    int listener = -1;
+    int client = -1;
+    int width = 0, height = 0;
+    size_t sent = 0, acknowledged = 0;
+    uint32_t lastTiles = 0;
+    size_t lastBytes = 0;
+    std::vector<uint32_t> previous;                 // pixels the client has
+    std::vector<std::vector<uint8_t>> encoded;      // per tile, empty if unchanged
+    std::vector<uint8_t> message;
+    std::vector<uint8_t> payload;
+};
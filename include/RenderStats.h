@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Per-frame counters. Workers fill a local copy per tile and merge it once.
+ */
+struct RenderStats {
+    uint64_t shadowRays = 0;
+    uint64_t occluderCacheHits = 0;     // cached blocker confirmed the shadow
+    uint64_t occluderCacheMisses = 0;   // cached blocker did not block, full query needed
+    uint64_t penumbraSkips = 0;         // area light evaluations settled by the probe rays alone
+    uint64_t sdfMarches = 0;            // sphere traced rays
+    uint64_t sdfSteps = 0;              // distance evaluations of those rays
+    float visibilityTime = 0;           // ms, deferred shading only: G-buffer pass
+    float shadingTime = 0;              // ms, deferred shading only: lighting pass
+    float denoiseTime = 0;              // ms, deferred shading only: denoiser and gamma packing
+
+    RenderStats &operator+=(const RenderStats &other) {
+        shadowRays += other.shadowRays;
+        occluderCacheHits += other.occluderCacheHits;
+        occluderCacheMisses += other.occluderCacheMisses;
+        penumbraSkips += other.penumbraSkips;
+        sdfMarches += other.sdfMarches;
+        sdfSteps += other.sdfSteps;
+        visibilityTime += other.visibilityTime;
+        shadingTime += other.shadingTime;
+        denoiseTime += other.denoiseTime;
+        return *this;
+    }
+
+    [[nodiscard]] float occluderCacheHitRate() const {
+        const uint64_t lookups = occluderCacheHits + occluderCacheMisses;
+        return lookups == 0 ? 0 : occluderCacheHits / (float) lookups;
+    }
+
+    [[nodiscard]] float averageSdfSteps() const {
+        return sdfMarches == 0 ? 0 : sdfSteps / (float) sdfMarches;
+    }
+};
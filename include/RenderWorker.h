@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Protocol.h"
+#include "SDLHelpers.h"
+#include "TileCodec.h"
+
+/**
+ * Connection of a worker process to a render coordinator: receives the scene
+ * once and reports the hash of what it built, then renders jobs and returns
+ * their pixels in order.
+ */
+class RenderWorker {
+public:
+    RenderWorker() = default;
+
+    RenderWorker(const RenderWorker &other) = delete;
+
+    RenderWorker &operator=(const RenderWorker &other) = delete;
+
+    ~RenderWorker() {
+        if (coordinator >= 0)
+            close(coordinator);
+    }
+
+    /**
+     * Connect and receive the scene
+     */
+    bool connect(const char *address) {
+        coordinator = connectSocket(address);
+        if (coordinator < 0)
+            return false;
+        MessageType type;
+        SceneMessage scene = {};
+        if (!receiveMessage(coordinator, type, payload) || type != MessageType::Scene ||
+            payload.size() < sizeof(scene)) {
+            fprintf(stderr, "Coordinator did not send a scene\n");
+            return false;
+        }
+        memcpy(&scene, payload.data(), sizeof(scene));
+        if (scene.width == 0 || scene.height == 0 || scene.width > 16384 || scene.height > 16384) {
+            fprintf(stderr, "Frame size %u x %u is not supported\n", scene.width, scene.height);
+            return false;
+        }
+        const char *text = (const char *) payload.data() + sizeof(scene);
+        const char *end = (const char *) payload.data() + payload.size();
+        for (uint32_t i = 0; i < scene.arguments; i++) {
+            const char *terminator = (const char *) memchr(text, '\0', end - text);
+            if (terminator == nullptr) {
+                fprintf(stderr, "Malformed scene arguments\n");
+                return false;
+            }
+            arguments.emplace_back(text, terminator);
+            text = terminator + 1;
+        }
+        width = scene.width;
+        height = scene.height;
+        seed = scene.seed;
+        return true;
+    }
+
+    /**
+     * Command line arguments that build the scene, after seeding rand() with getSeed()
+     */
+    [[nodiscard]] const std::vector<std::string> &getArguments() const {
+        return arguments;
+    }
+
+    [[nodiscard]] uint32_t getSeed() const {
+        return seed;
+    }
+
+    /**
+     * Frame size
+     */
+    [[nodiscard]] int getWidth() const {
+        return (int) width;
+    }
+
+    [[nodiscard]] int getHeight() const {
+        return (int) height;
+    }
+
+    /**
+     * Tell the coordinator which scene was built, see SceneHash
+     */
+    bool sendSceneHash(uint64_t hash) {
+        return sendMessage(coordinator, MessageType::SceneHash, SceneHashMessage{hash});
+    }
+
+    /**
+     * Block until the next job
+     * @return false when the coordinator is done or sent something else
+     */
+    bool receiveJob(JobMessage &job) {
+        MessageType type;
+        if (!receiveMessage(coordinator, type, payload) || type != MessageType::Job || !readMessage(payload, job))
+            return false;
+        return job.width > 0 && job.height > 0 && job.x < width && job.y < height && job.width <= width - job.x &&
+               job.height <= height - job.y;
+    }
+
+    /**
+     * Send the rectangle of job from surface
+     */
+    bool sendResult(const JobMessage &job, SDL_Surface *surface, float renderTime) {
+        message.clear();
+        appendRecord(message, ResultMessage{job.job, renderTime, 0});
+        appendEncodedTile(message, getPixelPtr(surface, (int) job.x, (int) job.y), (int) job.x, (int) job.y,
+                          (int) job.width, (int) job.height, surface->pitch / 4);
+        return sendMessage(coordinator, MessageType::Result, message.data(), message.size());
+    }
+
+private:
+    int coordinator = -1;
+    uint32_t width = 0, height = 0;
+    uint32_t seed = 0;
+    std::vector<std::string> arguments;
+    std::vector<uint8_t> payload;
+    std::vector<uint8_t> message;
+};
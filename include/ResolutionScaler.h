@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cmath>
+
+#include "GeometryHelpers.h"
+
+/**
+ * Picks the internal render resolution that holds a target frame time.
+ * Render times are smoothed, small deviations are ignored and each step is
+ * limited, so the resolution does not oscillate from frame to frame.
+ */
+class ResolutionScaler {
+public:
+    ResolutionScaler(int outputWidth, int outputHeight, float targetFrameTime,
+                     float minScale, float maxScale, float initialScale) :
+            outputWidth(outputWidth), outputHeight(outputHeight), targetFrameTime(targetFrameTime),
+            minScale(minScale), maxScale(maxScale), scale(clamp(minScale, maxScale, initialScale)) {
+    }
+
+    /**
+     * Feed the render time of a finished frame
+     * @param renderTime - ms spent rendering at the resolution returned earlier
+     */
+    void update(float renderTime) {
+        smoothedTime = (smoothedTime == 0) ? renderTime : smoothedTime * (1 - smoothing) + renderTime * smoothing;
+        const float ratio = targetFrameTime / smoothedTime;
+        if (fabs(1 - ratio) < deadBand)
+            return;
+        // render time is proportional to the pixel count, i.e. to scale squared
+        const float step = clamp(1 - maxStep, 1 + maxStep, sqrt(ratio));
+        scale = clamp(minScale, maxScale, scale * step);
+    }
+
+    [[nodiscard]] int getWidth() const {
+        return align(outputWidth * scale);
+    }
+
+    [[nodiscard]] int getHeight() const {
+        return align(outputHeight * scale);
+    }
+
+    [[nodiscard]] int getMaxWidth() const {
+        return align(outputWidth * maxScale);
+    }
+
+    [[nodiscard]] int getMaxHeight() const {
+        return align(outputHeight * maxScale);
+    }
+
+    [[nodiscard]] float getScale() const {
+        return scale;
+    }
+
+private:
+    /**
+     * Snap to a multiple of granularity so the size changes in visible steps only
+     */
+    static int align(float size) {
+        const int aligned = ((int) size / granularity) * granularity;
+        return max(aligned, granularity);
+    }
+
+    constexpr static int granularity = 8;
+    constexpr static float smoothing = 0.2;
+    constexpr static float deadBand = 0.08;
+    constexpr static float maxStep = 0.1;
+
+    const int outputWidth, outputHeight;
+    const float targetFrameTime;
+    const float minScale, maxScale;
+    float scale;
+    float smoothedTime = 0;
+};
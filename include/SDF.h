@@ -0,0 +1,363 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "Vector.h"
+#include "GeometryHelpers.h"
+#include "BoundingBox.h"
+#include "SceneObject.h"
+#include "ThreadPool.h"
+
+/**
+ * Signed distance function: negative inside, at most the distance to the surface
+ * in absolute value. Nodes are immutable and shared between objects and snapshots.
+ */
+class SdfNode {
+public:
+    virtual ~SdfNode() = default;
+
+    [[nodiscard]] virtual float distance(const Vec3f &point) const = 0;
+
+    /**
+     * Box that contains the whole surface
+     */
+    [[nodiscard]] virtual AABB bounds() const = 0;
+};
+
+typedef std::shared_ptr<const SdfNode> SdfNodePtr;
+
+class SdfSphere final : public SdfNode {
+public:
+    SdfSphere(const Vec3f &center, float radius) : center(center), radius(radius) {}
+
+    [[nodiscard]] float distance(const Vec3f &point) const override {
+        return (point - center).length() - radius;
+    }
+
+    [[nodiscard]] AABB bounds() const override {
+        return {center - radius, center + radius};
+    }
+
+private:
+    Vec3f center;
+    float radius;
+};
+
+class SdfBox final : public SdfNode {
+public:
+    /**
+     * @param rounding - radius of the rounded edges, taken from halfSize
+     */
+    SdfBox(const Vec3f &center, const Vec3f &halfSize, float rounding = 0) :
+            center(center), halfSize(halfSize - rounding), rounding(rounding) {}
+
+    [[nodiscard]] float distance(const Vec3f &point) const override {
+        const Vec3f p = point - center;
+        const Vec3f q = Vec3f(fabs(p[0]), fabs(p[1]), fabs(p[2])) - halfSize;
+        const float outside = q.maxComponents(Vec3f(0)).length();
+        const float inside = min(q.maxComponent(), 0.f);
+        return outside + inside - rounding;
+    }
+
+    [[nodiscard]] AABB bounds() const override {
+        return {center - halfSize - rounding, center + halfSize + rounding};
+    }
+
+private:
+    Vec3f center;
+    Vec3f halfSize;
+    float rounding;
+};
+
+/**
+ * Torus around the y axis
+ */
+class SdfTorus final : public SdfNode {
+public:
+    SdfTorus(const Vec3f &center, float majorRadius, float minorRadius) :
+            center(center), majorRadius(majorRadius), minorRadius(minorRadius) {}
+
+    [[nodiscard]] float distance(const Vec3f &point) const override {
+        const Vec3f p = point - center;
+        const float ring = sqrt(p[0] * p[0] + p[2] * p[2]) - majorRadius;
+        return sqrt(ring * ring + p[1] * p[1]) - minorRadius;
+    }
+
+    [[nodiscard]] AABB bounds() const override {
+        const float extent = majorRadius + minorRadius;
+        return {center - Vec3f(extent, minorRadius, extent), center + Vec3f(extent, minorRadius, extent)};
+    }
+
+private:
+    Vec3f center;
+    float majorRadius, minorRadius;
+};
+
+/**
+ * Distance function moved by offset
+ */
+class SdfTranslation final : public SdfNode {
+public:
+    SdfTranslation(SdfNodePtr node, const Vec3f &offset) : node(std::move(node)), offset(offset) {}
+
+    [[nodiscard]] float distance(const Vec3f &point) const override {
+        return node->distance(point - offset);
+    }
+
+    [[nodiscard]] AABB bounds() const override {
+        const AABB box = node->bounds();
+        return {box.low + offset, box.high + offset};
+    }
+
+private:
+    SdfNodePtr node;
+    Vec3f offset;
+};
+
+enum class CsgOperation {
+    Union, Intersection, Subtraction
+};
+
+/**
+ * Boolean combination of two distance functions
+ * @param smoothness - blend radius of a smooth union, 0 for a sharp one
+ */
+class SdfCsg final : public SdfNode {
+public:
+    SdfCsg(CsgOperation operation, SdfNodePtr a, SdfNodePtr b, float smoothness = 0) :
+            operation(operation), a(std::move(a)), b(std::move(b)), smoothness(smoothness) {}
+
+    [[nodiscard]] float distance(const Vec3f &point) const override {
+        const float da = a->distance(point), db = b->distance(point);
+        switch (operation) {
+            case CsgOperation::Union: {
+                if (smoothness <= 0)
+                    return min(da, db);
+                const float h = clamp(0, 1, 0.5f + 0.5f * (db - da) / smoothness);
+                return db + (da - db) * h - smoothness * h * (1 - h);
+            }
+            case CsgOperation::Intersection:
+                return max(da, db);
+            case CsgOperation::Subtraction:
+                return max(da, -db);
+        }
+        return da;
+    }
+
+    [[nodiscard]] AABB bounds() const override {
+        AABB box = a->bounds();
+        switch (operation) {
+            case CsgOperation::Union:
+                box.extend(b->bounds());
+                box.low = box.low - smoothness;
+                box.high = box.high + smoothness;
+                break;
+            case CsgOperation::Intersection: {
+                const AABB other = b->bounds();
+                box.low = box.low.maxComponents(other.low);
+                box.high = box.high.minComponents(other.high);
+                break;
+            }
+            case CsgOperation::Subtraction:
+                break;
+        }
+        return box;
+    }
+
+private:
+    CsgOperation operation;
+    SdfNodePtr a, b;
+    float smoothness;
+};
+
+/**
+ * Distances sampled on a regular grid over a box, trilinearly interpolated.
+ * Outside the box the distance to the box is added to the nearest sample.
+ */
+class SdfGrid final : public SdfNode {
+public:
+    /**
+     * @param resolution - samples per side, raised to 2 so every cell has two corners per axis;
+     *                     samples missing from values are far outside the surface
+     */
+    SdfGrid(const AABB &box, int resolution, std::vector<float> values) :
+            box(box), resolution(max(resolution, 2)), values(std::move(values)) {
+        this->values.resize((size_t) this->resolution * this->resolution * this->resolution,
+                            std::numeric_limits<float>::max());
+        cellSize = (box.high - box.low) / (float) (this->resolution - 1);
+        inverseCellSize = 1.0f / cellSize;
+    }
+
+    /**
+     * Sample source on a resolution^3 grid over its bounds, padded by padding cells
+     * @param resolution - at least 2
+     */
+    static SdfNodePtr bake(const SdfNode &source, int resolution, ThreadPool &pool, float padding = 2) {
+        resolution = max(resolution, 2);
+        AABB box = source.bounds();
+        const Vec3f pad = (box.high - box.low) / (float) (resolution - 1) * padding;
+        box.low = box.low - pad;
+        box.high = box.high + pad;
+        const Vec3f step = (box.high - box.low) / (float) (resolution - 1);
+        std::vector<float> values((size_t) resolution * resolution * resolution);
+        pool.parallelFor(resolution, [&](size_t z) {
+            for (int y = 0; y < resolution; y++) {
+                for (int x = 0; x < resolution; x++) {
+                    const Vec3f point = box.low + step * Vec3f((float) x, (float) y, (float) z);
+                    values[(z * resolution + y) * resolution + x] = source.distance(point);
+                }
+            }
+        });
+        return std::make_shared<const SdfGrid>(box, resolution, std::move(values));
+    }
+
+    [[nodiscard]] float distance(const Vec3f &point) const override {
+        const Vec3f clamped = point.maxComponents(box.low).minComponents(box.high);
+        const float outside = (point - clamped).length();
+        const Vec3f cell = (clamped - box.low) * inverseCellSize;
+        const int x = min((int) cell[0], resolution - 2);
+        const int y = min((int) cell[1], resolution - 2);
+        const int z = min((int) cell[2], resolution - 2);
+        const float fx = cell[0] - x, fy = cell[1] - y, fz = cell[2] - z;
+        auto at = [&](int dx, int dy, int dz) {
+            return values[((size_t) (z + dz) * resolution + (y + dy)) * resolution + (x + dx)];
+        };
+        const float c00 = at(0, 0, 0) + (at(1, 0, 0) - at(0, 0, 0)) * fx;
+        const float c10 = at(0, 1, 0) + (at(1, 1, 0) - at(0, 1, 0)) * fx;
+        const float c01 = at(0, 0, 1) + (at(1, 0, 1) - at(0, 0, 1)) * fx;
+        const float c11 = at(0, 1, 1) + (at(1, 1, 1) - at(0, 1, 1)) * fx;
+        const float c0 = c00 + (c10 - c00) * fy, c1 = c01 + (c11 - c01) * fy;
+        return c0 + (c1 - c0) * fz + outside;
+    }
+
+    [[nodiscard]] AABB bounds() const override {
+        return box;
+    }
+
+private:
+    AABB box;
+    int resolution;
+    std::vector<float> values; // x fastest, then y, then z
+    Vec3f cellSize, inverseCellSize;
+};
+
+/**
+ * Sphere tracing counters of the current thread, read by the renderer around each tile
+ */
+struct SdfCounters {
+    uint64_t marches = 0;
+    uint64_t steps = 0;
+};
+
+inline SdfCounters &sdfCounters() {
+    thread_local SdfCounters counters;
+    return counters;
+}
+
+struct SphereTracing {
+    int maxSteps = 128;
+    float hitDistance = 1e-4;   // relative to the travelled distance
+    float relaxation = 1.6;     // over-relaxation factor, 1 for plain sphere tracing
+};
+
+/**
+ * Surface of a distance function, rendered by sphere tracing inside its bounds.
+ * With relaxation above 1 every step is stretched; when the unbounding spheres
+ * of two consecutive points stop overlapping, the step is taken back and
+ * tracing continues without relaxation (Keinert et al., Enhanced Sphere Tracing).
+ */
+class SdfObject : public HittableObject {
+public:
+    explicit SdfObject(SdfNodePtr node, const SphereTracing &tracing = {}) :
+            node(std::move(node)), tracing(tracing) {
+        box = this->node->bounds();
+    }
+
+    /**
+     * Distance function of the node moved by the offset of the object
+     */
+    [[nodiscard]] float distance(const Vec3f &point) const {
+        return node->distance(point - offset);
+    }
+
+    bool intersect(const Ray &ray, float &tNear) const override {
+        float tEntry = 0, tExit = 0;
+        if (!intersectSlabs(box.low, box.high, ray.origin, 1.0f / ray.direction, tEntry, tExit) || tExit < 0)
+            return false;
+        // distances are along a possibly unnormalized direction, steps are scaled into its units
+        const float scale = 1 / ray.direction.length();
+        float t = max(tEntry, 0.f);
+        const float side = distance(ray.origin + ray.direction * t) < 0 ? -1.f : 1.f;
+        float omega = tracing.relaxation, previousRadius = 0, step = 0;
+        SdfCounters &counters = sdfCounters();
+        counters.marches++;
+        for (int i = 0; i < tracing.maxSteps && t <= tExit; i++) {
+            counters.steps++;
+            const float signedRadius = side * distance(ray.origin + ray.direction * t) * scale;
+            const float radius = fabs(signedRadius);
+            const bool overshot = omega > 1 && radius + previousRadius < step;
+            if (overshot) {
+                t -= step - step / omega;
+                step = 0;
+                previousRadius = 0;
+                omega = 1;
+                continue;
+            }
+            if (signedRadius < tracing.hitDistance * max(1.f, t)) {
+                tNear = t;
+                return true;
+            }
+            step = signedRadius * omega;
+            previousRadius = radius;
+            t += step;
+        }
+        return false;
+    }
+
+    /**
+     * Tracing stops within hitDistance of the surface, and a secondary ray must start
+     * farther than that to get away from it
+     */
+    [[nodiscard]] float getHitTolerance(float distance) const override {
+        return 2 * tracing.hitDistance * max(1.f, distance);
+    }
+
+    /**
+     * Kept on the object: snapshots clone and move it every frame, so the node isn't wrapped again
+     */
+    void translate(const Vec3f &move) override {
+        offset += move;
+        box = {box.low + move, box.high + move};
+    }
+
+    [[nodiscard]] HittableObject *clone() const override {
+        return new SdfObject(*this);
+    }
+
+    [[nodiscard]] AABB bounds() const override {
+        return box;
+    }
+
+    /**
+     * Gradient from four samples on a tetrahedron
+     */
+    [[nodiscard]] Vec3f getSurfaceNormal(const Vec3f &hitPoint, const Vec3f &viewDirection) const override {
+        const float h = 1e-3;
+        const Vec3f a(1, -1, -1), b(-1, -1, 1), c(-1, 1, -1), d(1, 1, 1);
+        Vec3f normal = a * distance(hitPoint + a * h) + b * distance(hitPoint + b * h) +
+                       c * distance(hitPoint + c * h) + d * distance(hitPoint + d * h);
+        normal.normalize();
+        return normal;
+    }
+
+private:
+    SdfNodePtr node;
+    SphereTracing tracing;
+    AABB box;
+    Vec3f offset = 0;   // of the node
+};
@@ -90,10 +90,6 @@ inline void freeSurface(SDL_Surface *surface) {
     SDL_FreeSurface(surface);
 }
 
-inline void saveSurface(SDL_Surface *surface, const char *file) {
-    IMG_SavePNG(surface, file);
-}
-
 void SDLInit(SDL_Window *&win, int *w, int *h) {
     win = SDL_CreateWindow("Graph", // creates a window
                            SDL_WINDOWPOS_CENTERED,
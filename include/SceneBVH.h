@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+#include "FastList.h"
+#include "BVH.h"
+#include "SceneObject.h"
+
+/**
+ * Top-level hierarchy over the scene objects. Objects are stored in leaf order,
+ * so a leaf range indexes getObject() directly. The objects stay owned by the caller.
+ */
+class SceneBVH {
+public:
+    SceneBVH() = default;
+
+    explicit SceneBVH(const FastList<HittableObject *> &objects) {
+        std::vector<const HittableObject *> unordered;
+        std::vector<AABB> boxes;
+        for (size_t i = objects.begin(); i != objects.end(); objects.nextIterator(&i)) {
+            HittableObject *object = nullptr;
+            objects.get(i, &object);
+            unordered.push_back(object);
+            boxes.push_back(object->bounds());
+        }
+        tree.build(boxes, kMaxLeafObjects);
+        for (uint32_t index : tree.getOrder())
+            ordered.push_back(unordered[index]);
+    }
+
+    [[nodiscard]] const BVHTree &getTree() const {
+        return tree;
+    }
+
+    [[nodiscard]] const HittableObject *getObject(uint32_t index) const {
+        return ordered[index];
+    }
+
+private:
+    constexpr static uint32_t kMaxLeafObjects = 2;
+
+    BVHTree tree;
+    std::vector<const HittableObject *> ordered;
+};
@@ -1,10 +1,13 @@
 #pragma once
 
+#include <cstdint>
+
 #include "Matrix.h"
 #include "Linalg.h"
 #include "GeometryHelpers.h"
 #include "Ray.h"
 #include "Light.h"
+#include "BoundingBox.h"
 
 class HittableObject {
 public:
@@ -14,14 +17,106 @@ public:
 
     [[nodiscard]] virtual Vec3f getSurfaceNormal( const Vec3f &hitPoint, const Vec3f &viewDirection) const = 0;
 
-    Vec3f albedo = 0.12;
-    Vec3f ambient = 0.04;
-    float Kd = 0.7;  // phong model diffuse weight
-    float Ks = 0.9;  // phong model specular weight
-    int n  = 10;     // phong specular exponent
-    RGBColor color = {1, 1, 1};
+    [[nodiscard]] virtual HittableObject *clone() const = 0;
+
+    [[nodiscard]] virtual AABB bounds() const = 0;
+
+    /**
+     * Move by offset, e.g. into the camera-relative coordinates of a frame
+     */
+    virtual void translate(const Vec3f &offset) = 0;
+
+    /**
+     * Position in scene coordinates the float coordinates of the object are relative to,
+     * kept in double so objects far from the scene origin stay exact, see toRenderSpace()
+     */
+    [[nodiscard]] const Vec3d &getAnchor() const {
+        return anchor;
+    }
+
+    void setAnchor(const Vec3d &position) {
+        anchor = position;
+    }
+
+    /**
+     * Intersection of a ray given in double, for Precision::Double
+     * @param t - receives the distance in double
+     * @return false if the ray misses in double or the object has no double intersection
+     */
+    [[nodiscard]] virtual bool intersectDouble(const Vec3d &orig, const Vec3d &dir, double &t) const {
+        return false;
+    }
+
+    /**
+     * How far from the surface a hit at ray distance may be besides rounding,
+     * for surfaces that are only found approximately
+     */
+    [[nodiscard]] virtual float getHitTolerance(float distance) const {
+        return 0;
+    }
+
+    /**
+     * Intersection that also reports which primitive was hit, for objects made of many
+     */
+    [[nodiscard]] virtual bool intersectPrimitive(const Ray &ray, float &tNear, uint32_t &primitive) const {
+        primitive = 0;
+        return intersect(ray, tNear);
+    }
+
+    [[nodiscard]] virtual Vec3f getPrimitiveNormal(const Vec3f &hitPoint, const Vec3f &viewDirection,
+                                                   uint32_t primitive) const {
+        return getSurfaceNormal(hitPoint, viewDirection);
+    }
+
+    /**
+     * Point in a frame that moves and turns with the object, in world units, for
+     * procedural textures. By default relative to the bounds center, which is
+     * enough for objects that only move.
+     */
+    [[nodiscard]] virtual Vec3f toObjectSpace(const Vec3f &point) const {
+        return point - bounds().centroid();
+    }
+
+    /**
+     * Surface coordinates for image textures, by default a spherical mapping around the object origin
+     */
+    [[nodiscard]] virtual Vec2f getTextureCoordinates(const Vec3f &hitPoint, uint32_t primitive) const {
+        Vec3f direction = toObjectSpace(hitPoint);
+        direction.normalize();
+        return {0.5f + atan2f(direction[2], direction[0]) * (float) (0.5 / M_PI),
+                0.5f - asinf(clamp(-1, 1, direction[1])) * (float) (1 / M_PI)};
+    }
+
+    uint32_t materialId = 0; // entry of the scene MaterialTable
+
+private:
+    Vec3d anchor = 0;
 };
 
+/**
+ * Nearest non-negative distance along dir to the sphere, for any scalar type.
+ * The discriminant comes from the distance of the center to the ray line instead
+ * of b^2 - 4ac, which cancels for spheres small against their distance
+ * (Haines et al., Precision Improvements for Ray/Sphere Intersection).
+ */
+template<typename T>
+inline bool intersectSphere(const Vec3<T> &orig, const Vec3<T> &dir, const Vec3<T> &center, T radius2, T &t) {
+    const Vec3<T> L = orig - center;
+    const T a = dir.dotProduct(dir);
+    const T b = dir.dotProduct(L);
+    const Vec3<T> closest = L - dir * (b / a);
+    const T discr = radius2 - closest.dotProduct(closest);
+    if (discr < 0)
+        return false;
+    const T c = L.dotProduct(L) - radius2;
+    const T q = -(b + std::copysign(std::sqrt(a * discr), b));
+    T t0 = q / a, t1 = c / q;
+    if (t0 > t1)
+        swap(t0, t1);
+    t = t0 >= 0 ? t0 : t1;
+    return t >= 0;
+}
+
 class Sphere : public HittableObject {
 public:
     Sphere(const Matrix4x4f &o2w, const float &r) : radius2(r * r) {
@@ -31,28 +126,34 @@ public:
     Sphere(const Vec3f &centerNew, const float &r) : center(centerNew), radius2(r * r) {}
 
     bool intersect(const Ray& ray, float &tNear) const override {
-        const Vec3f& orig = ray.origin;
-        const Vec3f& dir = ray.direction;
-        float t0 = 0, t1 = 0;
-        Vec3f L = orig - center;
-        float a = dir.dotProduct(dir);
-        float b = 2 * dir.dotProduct(L);
-        float c = L.dotProduct(L) - radius2;
-        if (!solveQuadratic(a, b, c, t0, t1))
+        float t = 0;
+        if (!intersectSphere(ray.origin, ray.direction, center, radius2, t))
             return false;
+        tNear = t;
+        return true;
+    }
 
-        if (t0 > t1)
-            swap(t0, t1);
-
-        if (t0 < 0) {
-            t0 = t1;
-            if (t0 < 0)
-                return false;
-        }
-        tNear = t0 - kEpsilon * 10000;
+    bool intersectDouble(const Vec3d &orig, const Vec3d &dir, double &t) const override {
+        double distance = 0;
+        if (!intersectSphere(orig, dir, toDouble(center), (double) radius2, distance))
+            return false;
+        t = distance;
         return true;
     }
 
+    void translate(const Vec3f &offset) override {
+        center += offset;
+    }
+
+    [[nodiscard]] HittableObject *clone() const override {
+        return new Sphere(*this);
+    }
+
+    [[nodiscard]] AABB bounds() const override {
+        const float radius = sqrt(radius2);
+        return {center - radius, center + radius};
+    }
+
     [[nodiscard]] Vec3f getSurfaceNormal(
             const Vec3f &hitPoint,
             const Vec3f &viewDirection) const override {
@@ -74,28 +175,34 @@ public:
     MarkovaSphere(const Vec3f &centerNew, const float &r) : center(centerNew), radius2(r * r) {}
 
     bool intersect(const Ray& ray, float &tNear) const override {
-        const Vec3f& orig = ray.origin;
-        const Vec3f& dir = ray.direction;
-        float t0 = 0, t1 = 0;
-        Vec3f L = orig - center;
-        float a = dir.dotProduct(dir);
-        float b = 2 * dir.dotProduct(L);
-        float c = L.dotProduct(L) - radius2;
-        if (!solveQuadratic(a, b, c, t0, t1))
+        float t = 0;
+        if (!intersectSphere(ray.origin, ray.direction, center, radius2, t))
             return false;
+        tNear = t;
+        return true;
+    }
 
-        if (t0 > t1)
-            swap(t0, t1);
-
-        if (t0 < 0) {
-            t0 = t1;
-            if (t0 < 0)
-                return false;
-        }
-        tNear = t0 - kEpsilon * 10000;
+    bool intersectDouble(const Vec3d &orig, const Vec3d &dir, double &t) const override {
+        double distance = 0;
+        if (!intersectSphere(orig, dir, toDouble(center), (double) radius2, distance))
+            return false;
+        t = distance;
         return true;
     }
 
+    void translate(const Vec3f &offset) override {
+        center += offset;
+    }
+
+    [[nodiscard]] HittableObject *clone() const override {
+        return new MarkovaSphere(*this);
+    }
+
+    [[nodiscard]] AABB bounds() const override {
+        const float radius = sqrt(radius2);
+        return {center - radius, center + radius};
+    }
+
     [[nodiscard]] Vec3f getSurfaceNormal(
             const Vec3f &hitPoint,
             const Vec3f &viewDirection) const override {
@@ -116,9 +223,7 @@ public:
 
 class Cube : public HittableObject {
 public:
-    Cube(const Matrix4x4f &o2w, const float &side): side(side) {
-        Cube(o2w.multVecMatrix(Vec3f(0)), side);
-    }
+    Cube(const Matrix4x4f &o2w, const float &side) : Cube(o2w.multVecMatrix(Vec3f(0)), side) {}
 
     Cube(const Vec3f &centerNew, const float &side) : center(centerNew), side(side) {
         minCorner = centerNew - side / 2;
@@ -126,35 +231,33 @@ public:
     }
 
     bool intersect(const Ray& ray, float &tNear) const override {
-        Vec3f T_1 = (minCorner - ray.origin) / ray.direction,
-            T_2 = (maxCorner - ray.origin) / ray.direction;
-        double t_near = -kInfinity;
-        double t_far = kInfinity;
-
-        for (int i = 0; i < 3; i++){
-            if (ray.direction[i] == 0){
-                if ((ray.origin[i] < minCorner[i]) || (ray.origin[i] > maxCorner[i])) {
-                    return false;
-                }
-            } else {
-                if(T_1[i] > T_2[i]){
-                    swap(T_1,T_2);
-                }
-                if (T_1[i] > t_near){
-                    t_near = T_1[i];
-                }
-                if (T_2[i] < t_far){
-                    t_far = T_2[i];
-                }
-                if( (t_near > t_far) || (t_far < 0) ){
-                    return false;
-                }
-            }
-        }
-        tNear = t_near - kEpsilon * 10000;
+        float tEntry = 0, tExit = 0;
+        if (!intersectSlabs(minCorner, maxCorner, ray.origin, 1.0f / ray.direction, tEntry, tExit) || tExit < 0)
+            return false;
+        tNear = tEntry >= 0 ? tEntry : tExit;
         return true;
     }
 
+    bool intersectDouble(const Vec3d &orig, const Vec3d &dir, double &t) const override {
+        double tEntry = 0, tExit = 0;
+        if (!intersectSlabs(toDouble(minCorner), toDouble(maxCorner), orig, 1.0 / dir, tEntry, tExit) || tExit < 0)
+            return false;
+        t = tEntry >= 0 ? tEntry : tExit;
+        return true;
+    }
+
+    void translate(const Vec3f &offset) override {
+        setCenter(center + offset);
+    }
+
+    [[nodiscard]] HittableObject *clone() const override {
+        return new Cube(*this);
+    }
+
+    [[nodiscard]] AABB bounds() const override {
+        return {minCorner, maxCorner};
+    }
+
     [[nodiscard]] Vec3f getSurfaceNormal(
             const Vec3f &hitPoint,
             const Vec3f &viewDirection) const override {
@@ -182,4 +285,99 @@ private:
     float side;
     Vec3f minCorner, maxCorner;
     Vec3f center;
-};
\ No newline at end of file
+};
+
+/**
+ * Box of any rotation and scale: the unit cube [-0.5, 0.5]^3 placed by objectToWorld.
+ * Rays are intersected in the box frame, where it is axis aligned.
+ */
+class OrientedBox : public HittableObject {
+public:
+    explicit OrientedBox(const Matrix4x4f &objectToWorld) {
+        setTransform(objectToWorld);
+    }
+
+    void setTransform(const Matrix4x4f &newObjectToWorld) {
+        objectToWorld = newObjectToWorld;
+        worldToObject = objectToWorld.inverse();
+        normalToWorld = worldToObject.transposed();
+        box = transformBox({Vec3f(-0.5f), Vec3f(0.5f)}, objectToWorld);
+        for (int row = 0; row < 4; row++)
+            inverseRows[row] = Vec3f(worldToObject.get(row, 0), worldToObject.get(row, 1), worldToObject.get(row, 2));
+        sideLengths = axisLengths(objectToWorld);
+    }
+
+    [[nodiscard]] const Matrix4x4f &getTransform() const {
+        return objectToWorld;
+    }
+
+    bool intersect(const Ray &ray, float &tNear) const override {
+        // the direction is not normalized, so distances stay in world units
+        const Vec3f orig = toLocalDirection(ray.origin) + inverseRows[3];
+        const Vec3f invDir = 1.0f / toLocalDirection(ray.direction);
+        float tEntry = 0, tExit = 0;
+        if (!intersectSlabs(Vec3f(-0.5f), Vec3f(0.5f), orig, invDir, tEntry, tExit) || tExit < 0)
+            return false;
+        tNear = tEntry >= 0 ? tEntry : tExit;
+        return true;
+    }
+
+    bool intersectDouble(const Vec3d &orig, const Vec3d &dir, double &t) const override {
+        Vec3d rows[4];
+        for (int row = 0; row < 4; row++)
+            rows[row] = toDouble(inverseRows[row]);
+        const Vec3d localOrig = rows[0] * orig[0] + rows[1] * orig[1] + rows[2] * orig[2] + rows[3];
+        const Vec3d localDir = rows[0] * dir[0] + rows[1] * dir[1] + rows[2] * dir[2];
+        double tEntry = 0, tExit = 0;
+        if (!intersectSlabs(Vec3d(-0.5), Vec3d(0.5), localOrig, 1.0 / localDir, tEntry, tExit) || tExit < 0)
+            return false;
+        t = tEntry >= 0 ? tEntry : tExit;
+        return true;
+    }
+
+    void translate(const Vec3f &offset) override {
+        setTransform(objectToWorld * Matrix4x4f::translate(offset));
+    }
+
+    [[nodiscard]] HittableObject *clone() const override {
+        return new OrientedBox(*this);
+    }
+
+    [[nodiscard]] AABB bounds() const override {
+        return box;
+    }
+
+    /**
+     * The box frame scaled back to world units, so textures turn with the box
+     */
+    [[nodiscard]] Vec3f toObjectSpace(const Vec3f &point) const override {
+        return (toLocalDirection(point) + inverseRows[3]) * sideLengths;
+    }
+
+    [[nodiscard]] Vec3f getSurfaceNormal(
+            const Vec3f &hitPoint,
+            const Vec3f &viewDirection) const override {
+        // the face is the one of the largest local coordinate
+        const Vec3f local = toLocalDirection(hitPoint) + inverseRows[3];
+        const Vec3f magnitude(fabs(local[0]), fabs(local[1]), fabs(local[2]));
+        const float largest = magnitude.maxComponent();
+        Vec3f normal = local * Vec3f(magnitude[0] == largest, magnitude[1] == largest, magnitude[2] == largest);
+        normal = normalToWorld.multDirMatrix(normal);
+        normal.normalize();
+        return normal;
+    }
+
+private:
+    /**
+     * Affine transform to the box frame as three vector multiply-adds,
+     * cheaper than the projective Matrix4x4f::multVecMatrix()
+     */
+    [[nodiscard]] Vec3f toLocalDirection(const Vec3f &v) const {
+        return inverseRows[0] * v[0] + inverseRows[1] * v[1] + inverseRows[2] * v[2];
+    }
+
+    Matrix4x4f objectToWorld, worldToObject, normalToWorld;
+    Vec3f inverseRows[4]; // rows of worldToObject, the last one is the translation
+    Vec3f sideLengths;    // world lengths of the box edges
+    AABB box;
+};
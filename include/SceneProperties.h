@@ -1,11 +1,45 @@
 #pragma once
 #include "Matrix.h"
 
+enum class Projection {
+    Pinhole,
+    ThinLens,
+    Orthographic
+};
+
+/**
+ * Coordinates a frame is rendered in. Scenes are stored in float relative to
+ * SceneOptions::worldOrigin and the anchors of their objects, which are kept
+ * in double like the eye.
+ */
+enum class Precision {
+    Float,          // world coordinates: far from the world origin hits lose their low bits
+    CameraRelative, // the eye at the origin, anchors rebased in double every frame
+    Double,         // camera-relative, and each nearest hit intersected again and its point rebuilt in double
+};
+
 struct SceneOptions {
     uint32_t width = 640, height = 480;
     float fov = 55;
     RGBColor backgroundColor = Vec3f(0.01, 0.01, 0.01);
     uint32_t maxDepth = 5;
 
-    Matrix4x4f cameraToWorld;
+    Matrix4x4f cameraToWorld;   // camera orientation, its translation is left to eye
+    Vec3d eye = 0;              // camera position in scene coordinates
+    Vec3d worldOrigin = 0;      // world position of the scene coordinates
+    Precision precision = Precision::Float;
+    Projection projection = Projection::Pinhole;
+    float aperture = 0;         // thin lens diameter
+    float focusDistance = 10;   // thin lens plane in focus
+    float orthoHeight = 10;     // orthographic view height in world units
+
+    // point light irradiance below one 8-bit step of the output, whose white is a linear 1
+    float lightCutoff = 1.0f / 255;
+    uint32_t manyLightsThreshold = 32;  // sample point lights through the light tree from this count on
+    uint32_t lightSamples = 4;          // point lights sampled per shading point in many-lights mode
+    uint32_t areaLightSamples = 4;      // area light shadow rays per shading point: squared, stratified
+    bool penumbraDetection = true;      // skip the remaining area light rays when the probe rays agree
+    uint32_t accumulatedFrames = 0;     // previous frames of the very same scene, 0 restarts accumulation
+    bool deferredShading = false;       // fill a G-buffer first, then light it row by row
+    uint32_t denoiseIterations = 0;     // a-trous passes over the lit frame, implies deferred shading
 };
\ No newline at end of file
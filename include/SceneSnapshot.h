@@ -0,0 +1,327 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <typeinfo>
+#include <vector>
+
+#include "FastList.h"
+#include "SceneObject.h"
+#include "SceneProperties.h"
+#include "Light.h"
+#include "LightTree.h"
+#include "SceneBVH.h"
+#include "Material.h"
+
+/**
+ * Render coordinates of a position in scene coordinates. Float precision renders in world
+ * coordinates; camera-relative precision takes the eye away while both are still double,
+ * so geometry around the eye keeps all float bits however far from the world origin it is.
+ */
+inline Vec3f toRenderSpace(const SceneOptions &options, const Vec3d &position) {
+    const Vec3d render = options.precision == Precision::Float ? options.worldOrigin + position
+                                                               : position - options.eye;
+    return {(float) render[0], (float) render[1], (float) render[2]};
+}
+
+/**
+ * Options with the eye narrowed into the translation of cameraToWorld
+ */
+inline SceneOptions toRenderSpace(SceneOptions options) {
+    const Vec3f eye = toRenderSpace(options, options.eye);
+    for (int axis = 0; axis < 3; axis++)
+        options.cameraToWorld.set(3, axis, eye[axis]);
+    return options;
+}
+
+/**
+ * Immutable copy of everything a frame needs to be rendered.
+ * Objects and lights are cloned on construction, so the main thread is free
+ * to mutate its own scene while render workers read the snapshot.
+ * The copies are in render coordinates: each object moves to its anchor and lights,
+ * which have none, to the scene origin, see toRenderSpace().
+ */
+class SceneSnapshot {
+public:
+    SceneSnapshot(const SceneOptions &options,
+                  const FastList<HittableObject *> &objects,
+                  const FastList<Light *> &lights,
+                  const MaterialTable &materials,
+                  uint64_t frame = 0) : options(toRenderSpace(options)), materials(materials), frame(frame) {
+        for (size_t i = objects.begin(); i != objects.end(); objects.nextIterator(&i)) {
+            HittableObject *object = nullptr;
+            objects.get(i, &object);
+            HittableObject *copy = object->clone();
+            const Vec3f offset = toRenderSpace(options, copy->getAnchor());
+            if (offset.length2() > 0)
+                copy->translate(offset);
+            this->objects.pushBack(copy);
+        }
+        geometry = SceneBVH(this->objects);
+        const Vec3f offset = toRenderSpace(options, Vec3d(0));
+        const bool moved = offset.length2() > 0;
+        for (size_t i = lights.begin(); i != lights.end(); lights.nextIterator(&i)) {
+            Light *light = nullptr;
+            lights.get(i, &light);
+            Light *copy = light->clone();
+            if (moved)
+                copy->translate(offset);
+            this->lights.pushBack(copy);
+            if (auto point = dynamic_cast<const PointLight *>(copy))
+                pointLights.push_back(*point);
+            else if (auto distant = dynamic_cast<const DistantLight *>(copy))
+                (distant->isSoft() ? softDistantLights : distantLights).push_back(*distant);
+            else if (auto sphere = dynamic_cast<const SphereLight *>(copy))
+                sphereLights.push_back(*sphere);
+            else if (auto rect = dynamic_cast<const RectLight *>(copy))
+                rectLights.push_back(*rect);
+            else
+                otherLights.pushBack(copy);
+        }
+        for (uint32_t i = 0; i < pointLights.size(); i++) {
+            const float radius = pointLights[i].influenceRadius(options.lightCutoff);
+            pointLightRadii2.push_back(radius * radius);
+            allPointLights.push_back(i);
+        }
+        if (pointLights.size() >= options.manyLightsThreshold)
+            lightTree = LightTree(pointLights);
+    }
+
+    SceneSnapshot(const SceneSnapshot &other) = delete;
+
+    SceneSnapshot &operator=(const SceneSnapshot &other) = delete;
+
+    ~SceneSnapshot() {
+        for (size_t i = objects.begin(); i != objects.end(); objects.nextIterator(&i)) {
+            HittableObject *object = nullptr;
+            objects.get(i, &object);
+            delete object;
+        }
+        for (size_t i = lights.begin(); i != lights.end(); lights.nextIterator(&i)) {
+            Light *light = nullptr;
+            lights.get(i, &light);
+            delete light;
+        }
+    }
+
+    /**
+     * Options in render coordinates
+     */
+    [[nodiscard]] const SceneOptions &getOptions() const {
+        return options;
+    }
+
+    [[nodiscard]] const FastList<HittableObject *> &getObjects() const {
+        return objects;
+    }
+
+    /**
+     * Hierarchy over getObjects(), for all ray queries
+     */
+    [[nodiscard]] const SceneBVH &getGeometry() const {
+        return geometry;
+    }
+
+    [[nodiscard]] const MaterialTable &getMaterials() const {
+        return materials;
+    }
+
+    [[nodiscard]] const FastList<Light *> &getLights() const {
+        return lights;
+    }
+
+    /**
+     * Lights grouped by type, for shading kernels without virtual calls
+     */
+    [[nodiscard]] const std::vector<PointLight> &getPointLights() const {
+        return pointLights;
+    }
+
+    /**
+     * Squared influence radii of getPointLights(), see PointLight::influenceRadius()
+     */
+    [[nodiscard]] const std::vector<float> &getPointLightRadii2() const {
+        return pointLightRadii2;
+    }
+
+    /**
+     * Indices of all point lights, for shading without culling
+     */
+    [[nodiscard]] const std::vector<uint32_t> &getAllPointLights() const {
+        return allPointLights;
+    }
+
+    [[nodiscard]] const std::vector<DistantLight> &getDistantLights() const {
+        return distantLights;
+    }
+
+    /**
+     * Lights with an extent, shaded with several shadow rays each
+     */
+    [[nodiscard]] const std::vector<DistantLight> &getSoftDistantLights() const {
+        return softDistantLights;
+    }
+
+    [[nodiscard]] const std::vector<SphereLight> &getSphereLights() const {
+        return sphereLights;
+    }
+
+    [[nodiscard]] const std::vector<RectLight> &getRectLights() const {
+        return rectLights;
+    }
+
+    /**
+     * Hierarchy over getPointLights(). Empty unless the scene has enough point lights
+     * for many-lights sampling.
+     */
+    [[nodiscard]] const LightTree &getLightTree() const {
+        return lightTree;
+    }
+
+    /**
+     * Lights of types without a dedicated kernel group
+     */
+    [[nodiscard]] const FastList<Light *> &getOtherLights() const {
+        return otherLights;
+    }
+
+    [[nodiscard]] uint64_t getFrame() const {
+        return frame;
+    }
+
+private:
+    const SceneOptions options;
+    FastList<HittableObject *> objects;
+    SceneBVH geometry;
+    const MaterialTable materials;
+    FastList<Light *> lights;
+    std::vector<PointLight> pointLights;
+    std::vector<float> pointLightRadii2;
+    std::vector<uint32_t> allPointLights;
+    std::vector<DistantLight> distantLights;
+    std::vector<DistantLight> softDistantLights;
+    std::vector<SphereLight> sphereLights;
+    std::vector<RectLight> rectLights;
+    FastList<Light *> otherLights;
+    LightTree lightTree;
+    const uint64_t frame;
+};
+
+typedef std::shared_ptr<const SceneSnapshot> SceneSnapshotPtr;
+
+/**
+ * 64-bit FNV-1a hash of a built scene, to tell whether two processes built the same one.
+ * Objects have no serialized form, so they are hashed through what a renderer sees of them:
+ * their type, bounds, anchor, material and the hits of a ray along every axis through their
+ * center. Options that only decide how a frame is rendered, not what it shows, are left out.
+ */
+class SceneHash {
+public:
+    SceneHash(const SceneOptions &options, const FastList<HittableObject *> &objects,
+              const FastList<Light *> &lights, const MaterialTable &materials) {
+        add(options.fov);
+        add(options.backgroundColor);
+        add(options.maxDepth);
+        for (uint8_t row = 0; row < 4; row++) {
+            for (uint8_t col = 0; col < 4; col++)
+                add(options.cameraToWorld.get(row, col));
+        }
+        add(options.eye);
+        add(options.worldOrigin);
+        add(options.precision);
+        add(options.projection);
+        add(options.aperture);
+        add(options.focusDistance);
+        add(options.orthoHeight);
+        add(options.lightCutoff);
+        add(options.manyLightsThreshold);
+        add(options.lightSamples);
+        add(options.areaLightSamples);
+        add(options.penumbraDetection);
+        for (uint32_t id = 0; id < materials.getSize(); id++) {
+            const Material &material = materials.get(id);
+            add(material.albedo);
+            add(material.ambient);
+            add(material.Kd);
+            add(material.Ks);
+            add(material.n);
+            add(material.color);
+            add(material.texture);
+        }
+        for (size_t i = objects.begin(); i != objects.end(); objects.nextIterator(&i)) {
+            HittableObject *object = nullptr;
+            objects.get(i, &object);
+            addObject(*object, materials);
+        }
+        const Vec3f probes[] = {Vec3f(0), Vec3f((float) options.eye[0], (float) options.eye[1],
+                                                (float) options.eye[2])};
+        for (size_t i = lights.begin(); i != lights.end(); lights.nextIterator(&i)) {
+            Light *light = nullptr;
+            lights.get(i, &light);
+            add(typeid(*light).name());
+            add(light->color);
+            add(light->intensity);
+            for (const Vec3f &point: probes) {
+                Vec3f lightDir, lightIntensity;
+                float distance = 0;
+                light->illuminate(point, lightDir, lightIntensity, distance);
+                add(lightDir);
+                add(lightIntensity);
+                add(distance);
+            }
+        }
+    }
+
+    [[nodiscard]] uint64_t getValue() const {
+        return value;
+    }
+
+private:
+    void addBytes(const void *data, size_t size) {
+        const auto *bytes = (const uint8_t *) data;
+        for (size_t i = 0; i < size; i++)
+            value = (value ^ bytes[i]) * 0x100000001b3ull;
+    }
+
+    template<typename T>
+    void add(const T &scalar) {
+        addBytes(&scalar, sizeof(scalar));
+    }
+
+    // by component, vectors may have padding
+    template<typename T>
+    void add(const Vec3<T> &vector) {
+        for (int axis = 0; axis < 3; axis++)
+            add(vector[axis]);
+    }
+
+    void add(const char *text) {
+        addBytes(text, strlen(text) + 1);
+    }
+
+    void addObject(const HittableObject &object, const MaterialTable &materials) {
+        add(typeid(object).name());
+        const AABB box = object.bounds();
+        add(box.low);
+        add(box.high);
+        add(object.getAnchor());
+        add(object.materialId);
+        const Vec3f center = box.centroid();
+        const Vec3f extent = box.high - box.low;
+        for (int axis = 0; axis < 3; axis++) {
+            const Vec3f dir((float) (axis == 0), (float) (axis == 1), (float) (axis == 2));
+            const Vec3f orig = center - dir * (extent[axis] + 1);
+            float t = 0;
+            uint32_t primitive = 0;
+            if (!object.intersectPrimitive({orig, dir}, t, primitive))
+                continue;
+            const Vec3f point = orig + dir * t;
+            add(t);
+            add(primitive);
+            add(materials.surfaceColor(materials.get(object.materialId), object, point, primitive, 1e-3f * t));
+        }
+    }
+
+    uint64_t value = 0xcbf29ce484222325ull;
+};
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Runtime configuration. Every option can be given on the command line
+ * or through the environment variable listed next to it.
+ */
+struct RenderSettings {
+    size_t framesInFlight = 2;                                  // --latency, RAYCASTER_LATENCY
+    size_t threads = std::thread::hardware_concurrency();       // --threads, RAYCASTER_THREADS
+    float targetFrameTime = 1000.0f / 35;                       // --frame-time, RAYCASTER_FRAME_TIME (ms)
+    float minScale = 0.25;                                      // --min-scale, RAYCASTER_MIN_SCALE
+    float maxScale = 1;                                         // --max-scale, RAYCASTER_MAX_SCALE
+    const char *projection = "pinhole";                         // --projection, RAYCASTER_PROJECTION
+    float aperture = 0.2;                                       // --aperture, RAYCASTER_APERTURE
+    float focusDistance = 10;                                   // --focus, RAYCASTER_FOCUS
+    const char *precision = "float";                            // --precision, RAYCASTER_PRECISION
+    double worldOffset = 0;                                     // --world-offset, RAYCASTER_WORLD_OFFSET
+    size_t lightSamples = 4;                                    // --light-samples, RAYCASTER_LIGHT_SAMPLES
+    size_t manyLightsThreshold = 32;                            // --many-lights, RAYCASTER_MANY_LIGHTS
+    size_t extraLights = 0;                                     // --extra-lights, RAYCASTER_EXTRA_LIGHTS
+    float lightRadius = 0;                                      // --light-radius, RAYCASTER_LIGHT_RADIUS
+    size_t areaLightSamples = 4;                                // --area-samples, RAYCASTER_AREA_SAMPLES
+    size_t penumbraDetection = 1;                               // --penumbra, RAYCASTER_PENUMBRA
+    const char *mesh = nullptr;                                 // --mesh, RAYCASTER_MESH (.obj or .ply)
+    float meshSize = 3;                                         // --mesh-size, RAYCASTER_MESH_SIZE
+    size_t instances = 0;                                       // --instances, RAYCASTER_INSTANCES
+    size_t sdf = 0;                                             // --sdf, RAYCASTER_SDF
+    float sdfRelaxation = 1.6;                                  // --sdf-relaxation, RAYCASTER_SDF_RELAXATION
+    size_t sdfSteps = 128;                                      // --sdf-steps, RAYCASTER_SDF_STEPS
+    size_t textures = 0;                                        // --textures, RAYCASTER_TEXTURES
+    const char *texture = nullptr;                              // --texture, RAYCASTER_TEXTURE (image file)
+    size_t deferred = 0;                                        // --deferred, RAYCASTER_DEFERRED
+    size_t denoise = 0;                                         // --denoise, RAYCASTER_DENOISE (passes)
+    const char *server = nullptr;                               // --server, RAYCASTER_SERVER (address)
+    size_t serverWindow = 2;                                    // --server-window, RAYCASTER_SERVER_WINDOW
+    const char *connect = nullptr;                              // --connect, RAYCASTER_CONNECT (address)
+    size_t clientFrames = 0;                                    // --client-frames, RAYCASTER_CLIENT_FRAMES
+    const char *coordinator = nullptr;                          // --coordinator, RAYCASTER_COORDINATOR (address)
+    size_t workers = 0;                                         // --workers, RAYCASTER_WORKERS (local processes)
+    const char *worker = nullptr;                               // --worker, RAYCASTER_WORKER (coordinator address)
+    size_t frames = 1;                                          // --frames, RAYCASTER_FRAMES
+    size_t width = 1280;                                        // --width, RAYCASTER_WIDTH (offline frames)
+    size_t height = 720;                                        // --height, RAYCASTER_HEIGHT (offline frames)
+    size_t jobSize = 64;                                        // --job-size, RAYCASTER_JOB_SIZE (pixels)
+    const char *output = "frame####.png";                       // --output, RAYCASTER_OUTPUT (# for digits)
+    size_t batch = 0;                                           // --batch, RAYCASTER_BATCH
+    const char *stream = nullptr;                               // --stream, RAYCASTER_STREAM (file, pipe or -)
+    const char *streamFormat = "y4m";                           // --stream-format, RAYCASTER_STREAM_FORMAT
+    size_t streamBuffers = 4;                                   // --stream-buffers, RAYCASTER_STREAM_BUFFERS
+    const char *screenshot = "screensoot.png";                  // --screenshot, RAYCASTER_SCREENSHOT (F key)
+    size_t encodeThreads = 2;                                   // --encode-threads, RAYCASTER_ENCODE_THREADS
+    size_t compression = 1;                                     // --compression, RAYCASTER_COMPRESSION (zlib 0-9)
+    size_t acneCheck = 0;                                       // --acne-check, RAYCASTER_ACNE_CHECK
+    const char *isa = "auto";                                   // --isa, RAYCASTER_ISA (auto, sse4.2, avx2, avx512)
+};
+
+inline const char *getSettingValue(int argc, char **argv, const char *flag, const char *env) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], flag) == 0)
+            return argv[i + 1];
+    }
+    return getenv(env);
+}
+
+inline void readSetting(int argc, char **argv, const char *flag, const char *env, size_t &value) {
+    const char *text = getSettingValue(argc, argv, flag, env);
+    if (text != nullptr)
+        value = strtoul(text, nullptr, 10);
+}
+
+inline void readSetting(int argc, char **argv, const char *flag, const char *env, float &value) {
+    const char *text = getSettingValue(argc, argv, flag, env);
+    if (text != nullptr)
+        value = strtof(text, nullptr);
+}
+
+inline void readSetting(int argc, char **argv, const char *flag, const char *env, double &value) {
+    const char *text = getSettingValue(argc, argv, flag, env);
+    if (text != nullptr)
+        value = strtod(text, nullptr);
+}
+
+inline void readSetting(int argc, char **argv, const char *flag, const char *env, const char *&value) {
+    const char *text = getSettingValue(argc, argv, flag, env);
+    if (text != nullptr)
+        value = text;
+}
+
+inline RenderSettings parseSettings(int argc, char **argv) {
+    RenderSettings settings = {};
+    readSetting(argc, argv, "--latency", "RAYCASTER_LATENCY", settings.framesInFlight);
+    readSetting(argc, argv, "--threads", "RAYCASTER_THREADS", settings.threads);
+    readSetting(argc, argv, "--frame-time", "RAYCASTER_FRAME_TIME", settings.targetFrameTime);
+    readSetting(argc, argv, "--min-scale", "RAYCASTER_MIN_SCALE", settings.minScale);
+    readSetting(argc, argv, "--max-scale", "RAYCASTER_MAX_SCALE", settings.maxScale);
+    readSetting(argc, argv, "--projection", "RAYCASTER_PROJECTION", settings.projection);
+    readSetting(argc, argv, "--aperture", "RAYCASTER_APERTURE", settings.aperture);
+    readSetting(argc, argv, "--focus", "RAYCASTER_FOCUS", settings.focusDistance);
+    readSetting(argc, argv, "--precision", "RAYCASTER_PRECISION", settings.precision);
+    readSetting(argc, argv, "--world-offset", "RAYCASTER_WORLD_OFFSET", settings.worldOffset);
+    readSetting(argc, argv, "--light-samples", "RAYCASTER_LIGHT_SAMPLES", settings.lightSamples);
+    readSetting(argc, argv, "--many-lights", "RAYCASTER_MANY_LIGHTS", settings.manyLightsThreshold);
+    readSetting(argc, argv, "--extra-lights", "RAYCASTER_EXTRA_LIGHTS", settings.extraLights);
+    readSetting(argc, argv, "--light-radius", "RAYCASTER_LIGHT_RADIUS", settings.lightRadius);
+    readSetting(argc, argv, "--area-samples", "RAYCASTER_AREA_SAMPLES", settings.areaLightSamples);
+    readSetting(argc, argv, "--penumbra", "RAYCASTER_PENUMBRA", settings.penumbraDetection);
+    readSetting(argc, argv, "--mesh", "RAYCASTER_MESH", settings.mesh);
+    readSetting(argc, argv, "--mesh-size", "RAYCASTER_MESH_SIZE", settings.meshSize);
+    readSetting(argc, argv, "--instances", "RAYCASTER_INSTANCES", settings.instances);
+    readSetting(argc, argv, "--sdf", "RAYCASTER_SDF", settings.sdf);
+    readSetting(argc, argv, "--sdf-relaxation", "RAYCASTER_SDF_RELAXATION", settings.sdfRelaxation);
+    readSetting(argc, argv, "--sdf-steps", "RAYCASTER_SDF_STEPS", settings.sdfSteps);
+    readSetting(argc, argv, "--textures", "RAYCASTER_TEXTURES", settings.textures);
+    readSetting(argc, argv, "--texture", "RAYCASTER_TEXTURE", settings.texture);
+    readSetting(argc, argv, "--deferred", "RAYCASTER_DEFERRED", settings.deferred);
+    readSetting(argc, argv, "--denoise", "RAYCASTER_DENOISE", settings.denoise);
+    readSetting(argc, argv, "--server", "RAYCASTER_SERVER", settings.server);
+    readSetting(argc, argv, "--server-window", "RAYCASTER_SERVER_WINDOW", settings.serverWindow);
+    readSetting(argc, argv, "--connect", "RAYCASTER_CONNECT", settings.connect);
+    readSetting(argc, argv, "--client-frames", "RAYCASTER_CLIENT_FRAMES", settings.clientFrames);
+    readSetting(argc, argv, "--coordinator", "RAYCASTER_COORDINATOR", settings.coordinator);
+    readSetting(argc, argv, "--workers", "RAYCASTER_WORKERS", settings.workers);
+    readSetting(argc, argv, "--worker", "RAYCASTER_WORKER", settings.worker);
+    readSetting(argc, argv, "--frames", "RAYCASTER_FRAMES", settings.frames);
+    readSetting(argc, argv, "--width", "RAYCASTER_WIDTH", settings.width);
+    readSetting(argc, argv, "--height", "RAYCASTER_HEIGHT", settings.height);
+    readSetting(argc, argv, "--job-size", "RAYCASTER_JOB_SIZE", settings.jobSize);
+    readSetting(argc, argv, "--output", "RAYCASTER_OUTPUT", settings.output);
+    readSetting(argc, argv, "--batch", "RAYCASTER_BATCH", settings.batch);
+    readSetting(argc, argv, "--stream", "RAYCASTER_STREAM", settings.stream);
+    readSetting(argc, argv, "--stream-format", "RAYCASTER_STREAM_FORMAT", settings.streamFormat);
+    readSetting(argc, argv, "--stream-buffers", "RAYCASTER_STREAM_BUFFERS", settings.streamBuffers);
+    readSetting(argc, argv, "--screenshot", "RAYCASTER_SCREENSHOT", settings.screenshot);
+    readSetting(argc, argv, "--encode-threads", "RAYCASTER_ENCODE_THREADS", settings.encodeThreads);
+    readSetting(argc, argv, "--compression", "RAYCASTER_COMPRESSION", settings.compression);
+    readSetting(argc, argv, "--acne-check", "RAYCASTER_ACNE_CHECK", settings.acneCheck);
+    readSetting(argc, argv, "--isa", "RAYCASTER_ISA", settings.isa);
+    if (settings.framesInFlight < 1)
+        settings.framesInFlight = 1;
+    if (settings.threads < 1)
+        settings.threads = 1;
+    if (settings.targetFrameTime <= 0)
+        settings.targetFrameTime = 1000.0f / 35;
+    if (settings.serverWindow < 1)
+        settings.serverWindow = 1;
+    if (settings.streamBuffers < 1)
+        settings.streamBuffers = 1;
+    if (settings.encodeThreads < 1)
+        settings.encodeThreads = 1;
+    if (settings.compression > 9)
+        settings.compression = 9;
+    if (settings.frames < 1)
+        settings.frames = 1;
+    if (settings.width < 1 || settings.width > 16384)
+        settings.width = 1280;
+    if (settings.height < 1 || settings.height > 16384)
+        settings.height = 720;
+    if (settings.denoise > 5)
+        settings.denoise = 5;
+    if (settings.sdfRelaxation < 1)
+        settings.sdfRelaxation = 1;
+    if (settings.maxScale <= 0)
+        settings.maxScale = 1;
+    if (settings.minScale <= 0 || settings.minScale > settings.maxScale)
+        settings.minScale = settings.maxScale;
+    return settings;
+}
+
+/**
+ * Command line arguments that rebuild the scene of settings in another process
+ */
+inline std::vector<std::string> sceneArguments(const RenderSettings &settings) {
+    std::vector<std::string> arguments;
+    auto add = [&arguments](const char *flag, const std::string &value) {
+        arguments.emplace_back(flag);
+        arguments.push_back(value);
+    };
+    auto addFloat = [&add](const char *flag, float value) {
+        char text[32];
+        snprintf(text, sizeof(text), "%.9g", value);
+        add(flag, text);
+    };
+    auto addDouble = [&add](const char *flag, double value) {
+        char text[32];
+        snprintf(text, sizeof(text), "%.17g", value);
+        add(flag, text);
+    };
+    add("--projection", settings.projection);
+    addFloat("--aperture", settings.aperture);
+    addFloat("--focus", settings.focusDistance);
+    add("--precision", settings.precision);
+    addDouble("--world-offset", settings.worldOffset);
+    add("--light-samples", std::to_string(settings.lightSamples));
+    add("--many-lights", std::to_string(settings.manyLightsThreshold));
+    add("--extra-lights", std::to_string(settings.extraLights));
+    addFloat("--light-radius", settings.lightRadius);
+    add("--area-samples", std::to_string(settings.areaLightSamples));
+    add("--penumbra", std::to_string(settings.penumbraDetection));
+    if (settings.mesh != nullptr)
+        add("--mesh", settings.mesh);
+    addFloat("--mesh-size", settings.meshSize);
+    add("--instances", std::to_string(settings.instances));
+    add("--sdf", std::to_string(settings.sdf));
+    addFloat("--sdf-relaxation", settings.sdfRelaxation);
+    add("--sdf-steps", std::to_string(settings.sdfSteps));
+    add("--textures", std::to_string(settings.textures));
+    if (settings.texture != nullptr)
+        add("--texture", settings.texture);
+    return arguments;
+}
+
+/**
+ * File name of a frame: the last run of # in pattern becomes the zero-padded frame number
+ */
+inline std::string formatFramePath(const char *pattern, uint64_t frame) {
+    std::string path = pattern;
+    const size_t end = path.find_last_of('#');
+    if (end == std::string::npos)
+        return path;
+    size_t start = end;
+    while (start > 0 && path[start - 1] == '#')
+        start--;
+    std::string number = std::to_string(frame);
+    if (number.size() < end - start + 1)
+        number.insert(0, end - start + 1 - number.size(), '0');
+    return path.replace(start, end - start + 1, number);
+}
@@ -0,0 +1,301 @@
+#pragma once
+
+#include <vector>
+
+#include "Vector.h"
+#include "GeometryHelpers.h"
+#include "SceneObject.h"
+#include "SceneSnapshot.h"
+#include "Material.h"
+#include "Light.h"
+#include "Tracing.h"
+#include "LightTree.h"
+#include "Random.h"
+#include "RenderStats.h"
+
+/**
+ * Last blocker of the shadow rays towards every light, kept for one tile.
+ * Neighbouring pixels are usually shadowed by the same object, so it is
+ * tested before the full occlusion query.
+ */
+class OccluderCache {
+public:
+    void reset(size_t lightsCount) {
+        blockers.assign(lightsCount, nullptr);
+    }
+
+    const HittableObject *&slot(size_t light) {
+        return blockers[light];
+    }
+
+    RenderStats stats;
+
+private:
+    std::vector<const HittableObject *> blockers;
+};
+
+struct SurfaceHit {
+    Vec3f point;              // just off the surface on the viewer side, where shadow rays start
+    Vec3f normal;
+    Vec3f viewDir;
+    const HittableObject *object;
+    const Material *material;
+    RGBColor color;           // material color with textures applied
+    Sampler *sampler;
+    OccluderCache *occluders; // may be null
+};
+
+/**
+ * Shadow query towards light slot, going through the occluder cache when there is one.
+ * Slots are point lights first, then hard distant, soft distant, sphere and rect lights,
+ * then the other lights.
+ */
+inline bool isOccluded(const SurfaceHit &hit, const Vec3f &dir, float distance,
+                       const SceneBVH &geometry, size_t slot) {
+    OccluderCache *cache = hit.occluders;
+    if (cache == nullptr)
+        return occluded(hit.point, dir, distance, geometry);
+
+    cache->stats.shadowRays++;
+    const HittableObject *&blocker = cache->slot(slot);
+    if (blocker != nullptr) {
+        float tNear = 0;
+        if (blocker->intersect({hit.point, dir}, tNear) && tNear < distance) {
+            cache->stats.occluderCacheHits++;
+            return true;
+        }
+        cache->stats.occluderCacheMisses++;
+    }
+    const HittableObject *found = nullptr;
+    const bool result = occluded(hit.point, dir, distance, geometry, &found);
+    blocker = found;
+    return result;
+}
+
+/**
+ * Subset of the scene point lights, e.g. the lights that can reach a tile
+ */
+struct LightList {
+    const uint32_t *indices;
+    size_t count;
+};
+
+/**
+ * x^N with the multiplication chain unrolled at compile time
+ */
+template<int N>
+inline float powConst(float x) {
+    if constexpr (N == 0) {
+        return 1;
+    } else if constexpr (N % 2 == 0) {
+        const float half = powConst<N / 2>(x);
+        return half * half;
+    } else {
+        return x * powConst<N - 1>(x);
+    }
+}
+
+/**
+ * Specular power. Exponent 0 stands for "known only at runtime".
+ */
+template<int Exponent>
+inline float specularPower(float x, int n) {
+    if constexpr (Exponent == 0)
+        return binpow(x, n);
+    else
+        return powConst<Exponent>(x);
+}
+
+/**
+ * x^n with a fixed number of steps and no branches on n, so a loop over
+ * pixels with different exponents still vectorizes. n must be below 2^16.
+ */
+inline float maskedPow(float x, uint32_t n) {
+    float result = 1;
+    for (int bit = 0; bit < 16; bit++) {
+        result *= ((n >> bit) & 1) ? x : 1.f;
+        x *= x;
+    }
+    return result;
+}
+
+/**
+ * Phong terms of a single light scaled by weight. With a final LightT
+ * illuminate() is resolved statically and inlined.
+ */
+template<int Exponent, typename LightT>
+inline void shadeLight(const LightT &light, size_t slot, const SurfaceHit &hit, const SceneBVH &geometry,
+                       float weight, Vec3f &diffuse, Vec3f &specular) {
+    RGBColor lightDir, lightIntensity;
+    float distance = 0;
+    light.illuminate(hit.point, lightDir, lightIntensity, distance);
+
+    bool vis = !isOccluded(hit, -lightDir, distance, geometry, slot);
+    lightIntensity *= vis * weight;
+
+    diffuse += lightIntensity * max(0.f, hit.normal.dotProduct(-lightDir));
+
+    RGBColor R = reflect(lightDir, hit.normal);
+    specular += lightIntensity * specularPower<Exponent>(max(0.f, R.dotProduct(-hit.viewDir)), hit.material->n);
+}
+
+template<int Exponent, typename LightT>
+inline void accumulateLights(const std::vector<LightT> &lights, size_t firstSlot, const SurfaceHit &hit,
+                             const SceneBVH &geometry, Vec3f &diffuse, Vec3f &specular) {
+    for (size_t i = 0; i < lights.size(); i++)
+        shadeLight<Exponent>(lights[i], firstSlot + i, hit, geometry, 1, diffuse, specular);
+}
+
+template<int Exponent>
+inline void accumulateLights(const std::vector<PointLight> &lights, const LightList &visible, const SurfaceHit &hit,
+                             const SceneBVH &geometry, Vec3f &diffuse, Vec3f &specular) {
+    for (size_t i = 0; i < visible.count; i++) {
+        const uint32_t index = visible.indices[i];
+        shadeLight<Exponent>(lights[index], index, hit, geometry, 1, diffuse, specular);
+    }
+}
+
+constexpr int kMaxAreaLightSamples = 64;
+
+/**
+ * Soft shadows from a light with an extent. Sample positions are stratified on
+ * a side x side grid and the shadow rays are intersected as one batch.
+ * With penumbra detection the diagonal strata are traced first; when they all
+ * agree the point is assumed fully lit or fully shadowed.
+ */
+template<int Exponent, typename LightT>
+inline void shadeAreaLight(const LightT &light, size_t slot, const SurfaceHit &hit,
+                           const SceneBVH &geometry, const SceneOptions &options,
+                           Vec3f &diffuse, Vec3f &specular) {
+    const int side = (int) clamp(1, 8, options.areaLightSamples);
+    const int count = side * side;
+    Vec3f dirs[kMaxAreaLightSamples], intensities[kMaxAreaLightSamples];
+    float distances[kMaxAreaLightSamples];
+    for (int i = 0; i < count; i++) {
+        const float u = (i % side + hit.sampler->nextFloat()) / side;
+        const float v = (i / side + hit.sampler->nextFloat()) / side;
+        Vec3f lightDir;
+        light.sample(hit.point, u, v, lightDir, intensities[i], distances[i]);
+        dirs[i] = -lightDir;
+    }
+
+    const uint64_t all = (count == 64) ? ~0ull : (1ull << count) - 1;
+    const HittableObject *cached = hit.occluders ? hit.occluders->slot(slot) : nullptr;
+    const HittableObject *blocker = nullptr;
+    uint64_t blocked = 0, traced = all;
+    if (options.penumbraDetection && side > 1) {
+        uint64_t probes = 0;
+        for (int k = 0; k < side; k++)
+            probes |= 1ull << (k * (side + 1));
+        blocked = occludedBatch(hit.point, dirs, distances, probes, geometry, cached, &blocker);
+        traced = probes;
+        if (blocked == probes) {
+            blocked = all;
+        } else if (blocked != 0) {
+            blocked |= occludedBatch(hit.point, dirs, distances, all & ~probes, geometry, blocker, &blocker);
+            traced = all;
+        }
+    } else {
+        blocked = occludedBatch(hit.point, dirs, distances, all, geometry, cached, &blocker);
+    }
+    if (hit.occluders != nullptr) {
+        RenderStats &stats = hit.occluders->stats;
+        stats.shadowRays += __builtin_popcountll(traced);
+        stats.penumbraSkips += traced != all;
+        hit.occluders->slot(slot) = blocker;
+    }
+
+    const float weight = 1.0f / count;
+    for (int i = 0; i < count; i++) {
+        if (blocked & (1ull << i))
+            continue;
+        const Vec3f lightDir = -dirs[i];
+        const Vec3f lightIntensity = intensities[i] * weight;
+        diffuse += lightIntensity * max(0.f, hit.normal.dotProduct(-lightDir));
+        RGBColor R = reflect(lightDir, hit.normal);
+        specular += lightIntensity * specularPower<Exponent>(max(0.f, R.dotProduct(-hit.viewDir)), hit.material->n);
+    }
+}
+
+template<int Exponent, typename LightT>
+inline void accumulateAreaLights(const std::vector<LightT> &lights, size_t firstSlot, const SurfaceHit &hit,
+                                 const SceneSnapshot &scene, Vec3f &diffuse, Vec3f &specular) {
+    for (size_t i = 0; i < lights.size(); i++)
+        shadeAreaLight<Exponent>(lights[i], firstSlot + i, hit, scene.getGeometry(), scene.getOptions(),
+                                 diffuse, specular);
+}
+
+/**
+ * Many-lights estimate: lightSamples lights drawn from the light tree,
+ * each weighted by the inverse of its probability
+ */
+template<int Exponent>
+inline void accumulateSampledLights(const SceneSnapshot &scene, const SurfaceHit &hit,
+                                    const SceneBVH &geometry, Vec3f &diffuse, Vec3f &specular) {
+    const LightTree &tree = scene.getLightTree();
+    const std::vector<PointLight> &lights = scene.getPointLights();
+    const uint32_t samples = max(1u, scene.getOptions().lightSamples);
+    for (uint32_t i = 0; i < samples; i++) {
+        float pdf = 0;
+        const uint32_t index = tree.sample(hit.point, hit.sampler->nextFloat(), pdf);
+        shadeLight<Exponent>(lights[index], index, hit, geometry, 1 / (pdf * samples), diffuse, specular);
+    }
+}
+
+/**
+ * Phong shading kernel specialized on the specular exponent
+ */
+template<int Exponent>
+RGBColor shadePhong(const SurfaceHit &hit, const SceneSnapshot &scene, const LightList &pointLights) {
+    const Material &material = *hit.material;
+    const SceneBVH &geometry = scene.getGeometry();
+    Vec3f diffuse = 0, specular = 0;
+    if (scene.getLightTree().isEmpty())
+        accumulateLights<Exponent>(scene.getPointLights(), pointLights, hit, geometry, diffuse, specular);
+    else
+        accumulateSampledLights<Exponent>(scene, hit, geometry, diffuse, specular);
+    const size_t distantSlot = scene.getPointLights().size();
+    accumulateLights<Exponent>(scene.getDistantLights(), distantSlot, hit, geometry, diffuse, specular);
+
+    const size_t softDistantSlot = distantSlot + scene.getDistantLights().size();
+    const size_t sphereSlot = softDistantSlot + scene.getSoftDistantLights().size();
+    const size_t rectSlot = sphereSlot + scene.getSphereLights().size();
+    accumulateAreaLights<Exponent>(scene.getSoftDistantLights(), softDistantSlot, hit, scene, diffuse, specular);
+    accumulateAreaLights<Exponent>(scene.getSphereLights(), sphereSlot, hit, scene, diffuse, specular);
+    accumulateAreaLights<Exponent>(scene.getRectLights(), rectSlot, hit, scene, diffuse, specular);
+
+    const FastList<Light *> &others = scene.getOtherLights();
+    size_t slot = rectSlot + scene.getRectLights().size();
+    for (size_t lightIndex = others.begin(); lightIndex != others.end(); others.nextIterator(&lightIndex), slot++) {
+        Light *light = nullptr;
+        others.get(lightIndex, &light);
+        shadeLight<Exponent>(*light, slot, hit, geometry, 1, diffuse, specular);
+    }
+    return material.albedo * diffuse * material.Kd * hit.color + specular * material.Ks * hit.color + material.ambient;
+}
+
+/**
+ * Phong shading with the kernel of the specular exponent of the material. Exponents used
+ * by the scenes get an unrolled power chain, the rest fall back to binpow. The calls are
+ * direct, so the kernels of each instruction set inline them, see KernelTable::shadeHit.
+ */
+inline RGBColor shadeHit(const SurfaceHit &hit, const SceneSnapshot &scene, const LightList &pointLights) {
+    switch (hit.material->n) {
+        case 2:
+            return shadePhong<2>(hit, scene, pointLights);
+        case 6:
+            return shadePhong<6>(hit, scene, pointLights);
+        case 10:
+            return shadePhong<10>(hit, scene, pointLights);
+        case 16:
+            return shadePhong<16>(hit, scene, pointLights);
+        case 18:
+            return shadePhong<18>(hit, scene, pointLights);
+        case 54:
+            return shadePhong<54>(hit, scene, pointLights);
+        case 162:
+            return shadePhong<162>(hit, scene, pointLights);
+        default:
+            return shadePhong<0>(hit, scene, pointLights);
+    }
+}
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Vector.h"
+#include "GeometryHelpers.h"
+#include "Random.h"
+#include "SDLHelpers.h"
+
+/**
+ * Where and how large the texture is looked up
+ */
+struct TextureQuery {
+    Vec3f point;       // in the frame of the object, see HittableObject::toObjectSpace()
+    Vec2f uv;          // surface coordinates, see HittableObject::getTextureCoordinates()
+    float footprint;   // world size of the pixel at the hit
+    float uvFootprint; // the same in texture coordinates
+};
+
+class Texture {
+public:
+    virtual ~Texture() = default;
+
+    [[nodiscard]] virtual RGBColor evaluate(const TextureQuery &query) const = 0;
+};
+
+inline RGBColor lerpColor(const RGBColor &a, const RGBColor &b, float t) {
+    return a + (b - a) * t;
+}
+
+/**
+ * 3D checkerboard. Once a pixel covers a whole cell it turns into the average color.
+ */
+class CheckerTexture final : public Texture {
+public:
+    CheckerTexture(float scale, const RGBColor &a, const RGBColor &b) : scale(scale), a(a), b(b) {}
+
+    [[nodiscard]] RGBColor evaluate(const TextureQuery &query) const override {
+        const float blend = clamp(0, 1, query.footprint * scale - 0.5f);
+        const Vec3f cell = query.point * scale;
+        const auto parity = ((int) floor(cell[0]) + (int) floor(cell[1]) + (int) floor(cell[2])) & 1;
+        return lerpColor(parity ? a : b, (a + b) * 0.5f, blend);
+    }
+
+private:
+    float scale;
+    RGBColor a, b;
+};
+
+/**
+ * Value noise of one octave in [0, 1]
+ */
+inline float valueNoise(const Vec3f &point) {
+    const float fx = floor(point[0]), fy = floor(point[1]), fz = floor(point[2]);
+    const auto x = (int32_t) fx, y = (int32_t) fy, z = (int32_t) fz;
+    auto smooth = [](float t) { return t * t * (3 - 2 * t); };
+    const float tx = smooth(point[0] - fx), ty = smooth(point[1] - fy), tz = smooth(point[2] - fz);
+    auto corner = [&](int dx, int dy, int dz) {
+        return hashSeed((x + dx) ^ hashSeed((y + dy) ^ hashSeed(z + dz))) * (1.0f / 4294967296.0f);
+    };
+    const float c00 = corner(0, 0, 0) + (corner(1, 0, 0) - corner(0, 0, 0)) * tx;
+    const float c10 = corner(0, 1, 0) + (corner(1, 1, 0) - corner(0, 1, 0)) * tx;
+    const float c01 = corner(0, 0, 1) + (corner(1, 0, 1) - corner(0, 0, 1)) * tx;
+    const float c11 = corner(0, 1, 1) + (corner(1, 1, 1) - corner(0, 1, 1)) * tx;
+    const float c0 = c00 + (c10 - c00) * ty, c1 = c01 + (c11 - c01) * ty;
+    return c0 + (c1 - c0) * tz;
+}
+
+/**
+ * Fractal value noise blending two colors. Octaves finer than the pixel are
+ * replaced by their mean instead of being evaluated.
+ */
+class NoiseTexture final : public Texture {
+public:
+    NoiseTexture(float scale, int octaves, const RGBColor &a, const RGBColor &b) :
+            scale(scale), octaves(octaves), a(a), b(b) {}
+
+    [[nodiscard]] RGBColor evaluate(const TextureQuery &query) const override {
+        float value = 0, amplitude = 0.5f, frequency = scale;
+        for (int octave = 0; octave < octaves; octave++) {
+            value += amplitude * (frequency * query.footprint < 0.5f ? valueNoise(query.point * frequency) : 0.5f);
+            amplitude *= 0.5f;
+            frequency *= 2;
+        }
+        return lerpColor(a, b, clamp(0, 1, value / (1 - amplitude * 2)));
+    }
+
+private:
+    float scale;
+    int octaves;
+    RGBColor a, b;
+};
+
+/**
+ * Linear blend from a at start to b at end, constant beyond them
+ */
+class GradientTexture final : public Texture {
+public:
+    GradientTexture(const Vec3f &start, const Vec3f &end, const RGBColor &a, const RGBColor &b) :
+            start(start), direction((end - start) / (end - start).length2()), a(a), b(b) {}
+
+    [[nodiscard]] RGBColor evaluate(const TextureQuery &query) const override {
+        return lerpColor(a, b, clamp(0, 1, (query.point - start).dotProduct(direction)));
+    }
+
+private:
+    Vec3f start, direction;
+    RGBColor a, b;
+};
+
+/**
+ * Image with a full mip chain. Every level is stored in 8 x 8 texel tiles,
+ * so a bilinear footprint touches one or two cache lines instead of two
+ * rows far apart. Lookups are trilinear between the two levels around the footprint.
+ */
+class ImageTexture final : public Texture {
+public:
+    /**
+     * @param image - any format, converted on load
+     * @param tiling - repetitions of the image per unit of texture coordinates
+     */
+    explicit ImageTexture(SDL_Surface *image, float tiling = 1) : tiling(tiling) {
+        SDL_Surface *converted = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_ABGR8888, 0);
+        if (converted == nullptr)
+            return;
+        const int width = converted->w, height = converted->h;
+        std::vector<RGBColor> texels((size_t) width * height);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++)
+                texels[(size_t) y * width + x] = unpack(getPixel(converted, x, y));
+        }
+        SDL_FreeSurface(converted);
+        buildLevels(std::move(texels), width, height);
+    }
+
+    /**
+     * @return null if the file can't be loaded
+     */
+    static std::shared_ptr<const ImageTexture> load(const char *path, float tiling = 1) {
+        SDL_Surface *image = IMG_Load(path);
+        if (image == nullptr) {
+            fprintf(stderr, "Can't load texture %s: %s\n", path, IMG_GetError());
+            return nullptr;
+        }
+        auto texture = std::make_shared<const ImageTexture>(image, tiling);
+        SDL_FreeSurface(image);
+        return texture->levels.empty() ? nullptr : texture;
+    }
+
+    [[nodiscard]] RGBColor evaluate(const TextureQuery &query) const override {
+        if (levels.empty())
+            return 1;
+        const float u = query.uv.x * tiling, v = query.uv.y * tiling;
+        const float texels = query.uvFootprint * tiling * (float) levels[0].width;
+        const float level = clamp(0, (float) levels.size() - 1, log2(max(texels, 1.f)));
+        const int lower = (int) level;
+        const RGBColor fine = bilinear(levels[lower], u, v);
+        if (lower + 1 >= (int) levels.size())
+            return fine;
+        return lerpColor(fine, bilinear(levels[lower + 1], u, v), level - lower);
+    }
+
+private:
+    constexpr static int kTileSide = 8;
+
+    struct Level {
+        int width, height, tilesX;
+        std::vector<Uint32> texels; // tile after tile, rows inside a tile
+
+        [[nodiscard]] Uint32 fetch(int x, int y) const {
+            x = ((x % width) + width) % width;
+            y = ((y % height) + height) % height;
+            const int tile = (y / kTileSide) * tilesX + x / kTileSide;
+            return texels[(size_t) tile * kTileSide * kTileSide + (y % kTileSide) * kTileSide + x % kTileSide];
+        }
+    };
+
+    /**
+     * Texel to linear color, the inverse of the gamma applied by packColor()
+     */
+    static RGBColor unpack(Uint32 texel) {
+        static const std::vector<float> decode = [] {
+            std::vector<float> table(256);
+            for (int i = 0; i < 256; i++)
+                table[i] = pow(i / 255.0f, 1 / 0.55f);
+            return table;
+        }();
+        return {decode[texel & 0xFF], decode[(texel >> 8) & 0xFF], decode[(texel >> 16) & 0xFF]};
+    }
+
+    static Uint32 pack(const RGBColor &color) {
+        Uint32 texel = 0xFF000000;
+        for (int channel = 0; channel < 3; channel++)
+            texel |= (Uint32) (clamp(0, 255, pow(color[channel], 0.55f) * 255 + 0.5f)) << (8 * channel);
+        return texel;
+    }
+
+    void buildLevels(std::vector<RGBColor> texels, int width, int height) {
+        while (true) {
+            Level level = {width, height, (width + kTileSide - 1) / kTileSide, {}};
+            const int tilesY = (height + kTileSide - 1) / kTileSide;
+            level.texels.assign((size_t) level.tilesX * tilesY * kTileSide * kTileSide, 0);
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    const int tile = (y / kTileSide) * level.tilesX + x / kTileSide;
+                    level.texels[(size_t) tile * kTileSide * kTileSide + (y % kTileSide) * kTileSide + x % kTileSide] =
+                            pack(texels[(size_t) y * width + x]);
+                }
+            }
+            levels.push_back(std::move(level));
+            if (width == 1 && height == 1)
+                break;
+            // box filter in linear space, odd edges reuse their last texel
+            const int nextWidth = max(1, width / 2), nextHeight = max(1, height / 2);
+            std::vector<RGBColor> next((size_t) nextWidth * nextHeight);
+            for (int y = 0; y < nextHeight; y++) {
+                for (int x = 0; x < nextWidth; x++) {
+                    const int x0 = min(2 * x, width - 1), x1 = min(2 * x + 1, width - 1);
+                    const int y0 = min(2 * y, height - 1), y1 = min(2 * y + 1, height - 1);
+                    next[(size_t) y * nextWidth + x] = (texels[(size_t) y0 * width + x0] + texels[(size_t) y0 * width + x1] +
+                                                        texels[(size_t) y1 * width + x0] + texels[(size_t) y1 * width + x1]) * 0.25f;
+                }
+            }
+            texels.swap(next);
+            width = nextWidth;
+            height = nextHeight;
+        }
+    }
+
+    static RGBColor bilinear(const Level &level, float u, float v) {
+        const float x = u * level.width - 0.5f, y = v * level.height - 0.5f;
+        const float fx = floor(x), fy = floor(y);
+        const int x0 = (int) fx, y0 = (int) fy;
+        const float tx = x - fx, ty = y - fy;
+        const RGBColor top = lerpColor(unpack(level.fetch(x0, y0)), unpack(level.fetch(x0 + 1, y0)), tx);
+        const RGBColor bottom = lerpColor(unpack(level.fetch(x0, y0 + 1)), unpack(level.fetch(x0 + 1, y0 + 1)), tx);
+        return lerpColor(top, bottom, ty);
+    }
+
+    float tiling;
+    std::vector<Level> levels;
+};
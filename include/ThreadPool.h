@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Persistent pool of worker threads.
+ * parallelFor() may be called concurrently and from inside pool tasks:
+ * the calling thread takes part in the loop, so nested calls never deadlock.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threadsCount = std::thread::hardware_concurrency()) {
+        if (threadsCount == 0)
+            threadsCount = 1;
+        workers.reserve(threadsCount);
+        for (size_t i = 0; i < threadsCount; i++)
+            workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+
+    ThreadPool(const ThreadPool &other) = delete;
+
+    ThreadPool &operator=(const ThreadPool &other) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (auto &worker: workers)
+            worker.join();
+    }
+
+    [[nodiscard]] size_t getThreadsCount() const {
+        return workers.size();
+    }
+
+    /**
+     * Queue a detached task
+     */
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            tasks.push_back(std::move(task));
+        }
+        wakeUp.notify_one();
+    }
+
+    /**
+     * Calls body(i) for every i in [0, count) and returns when all calls finished
+     */
+    void parallelFor(size_t count, const std::function<void(size_t)> &body) {
+        if (count == 0)
+            return;
+        auto loop = std::make_shared<LoopState>(count, body);
+        const size_t helpers = std::min(count - 1, workers.size());
+        for (size_t i = 0; i < helpers; i++)
+            submit([loop]() { loop->run(); });
+        loop->run();
+        std::unique_lock<std::mutex> guard(loop->lock);
+        loop->finished.wait(guard, [&loop]() { return loop->done == loop->count; });
+    }
+
+private:
+    struct LoopState {
+        LoopState(size_t count, const std::function<void(size_t)> &body) : count(count), body(body) {}
+
+        void run() {
+            size_t completed = 0;
+            for (size_t i = next++; i < count; i = next++) {
+                body(i);
+                completed++;
+            }
+            if (completed == 0)
+                return;
+            std::lock_guard<std::mutex> guard(lock);
+            done += completed;
+            if (done == count)
+                finished.notify_all();
+        }
+
+        const size_t count;
+        const std::function<void(size_t)> &body;
+        std::atomic<size_t> next = 0;
+        size_t done = 0;
+        std::mutex lock;
+        std::condition_variable finished;
+    };
+
+    void workerLoop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wakeUp.wait(guard, [this]() { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex lock;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+};
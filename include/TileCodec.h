@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Protocol.h"
+#include "Qoi.h"
+
+/**
+ * Append a TileMessage and the pixels of the width x height rectangle at pixels,
+ * QOI-compressed unless raw rows are smaller
+ * @param stride - pixels between the starts of two rows
+ */
+inline void appendEncodedTile(std::vector<uint8_t> &out, const uint32_t *pixels, int x, int y, int width, int height,
+                              int stride) {
+    const size_t start = out.size();
+    TileMessage tile = {(uint32_t) x, (uint32_t) y, (uint32_t) width, (uint32_t) height,
+                        (uint32_t) TileEncoding::Qoi, 0};
+    appendRecord(out, tile);
+    encodeQoi(pixels, width, height, stride, out);
+    const size_t rawSize = (size_t) width * height * 4;
+    if (out.size() - start - sizeof(tile) > rawSize) {
+        out.resize(start + sizeof(tile));
+        tile.encoding = (uint32_t) TileEncoding::Raw;
+        for (int j = 0; j < height; j++) {
+            const auto *row = (const uint8_t *) (pixels + (size_t) j * stride);
+            out.insert(out.end(), row, row + width * 4);
+        }
+    }
+    tile.size = (uint32_t) (out.size() - start - sizeof(tile));
+    memcpy(out.data() + start, &tile, sizeof(tile));
+}
+
+/**
+ * Decode the size bytes at data described by tile into the rectangle at target
+ * @return false if the encoding is unknown or the data is malformed
+ */
+inline bool decodeTile(const TileMessage &tile, const uint8_t *data, uint32_t *target, int stride) {
+    if (tile.encoding == (uint32_t) TileEncoding::Qoi)
+        return decodeQoi(data, tile.size, target, (int) tile.width, (int) tile.height, stride);
+    if (tile.encoding != (uint32_t) TileEncoding::Raw || tile.size != tile.width * tile.height * 4)
+        return false;
+    for (uint32_t j = 0; j < tile.height; j++)
+        memcpy(target + (size_t) j * stride, data + (size_t) j * tile.width * 4, tile.width * 4);
+    return true;
+}
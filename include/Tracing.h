@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstdint>
+
+#include "FastList.h"
+#include "Vector.h"
+#include "SceneObject.h"
+#include "SceneBVH.h"
+#include "SceneProperties.h"
+
+/**
+ * Nearest hit along the ray
+ * @param primitive - receives the primitive hit inside the object, if not null
+ */
+const HittableObject *trace(const Vec3f &orig, const Vec3f &dir, const SceneBVH &geometry, float &tNear,
+                            uint32_t *primitive = nullptr) {
+    const Ray ray(orig, dir);
+    float nearest = kInfinity;
+    const HittableObject *nearestObj = nullptr;
+    uint32_t nearestPrimitive = 0;
+    geometry.getTree().traverse(ray, nearest, [&](uint32_t first, uint32_t count, float &tMax) {
+        for (uint32_t k = first; k < first + count; k++) {
+            const HittableObject *object = geometry.getObject(k);
+            float t = 0;
+            uint32_t hitPrimitive = 0;
+            if (object->intersectPrimitive(ray, t, hitPrimitive) && t < tMax) {
+                tMax = t;
+                nearestObj = object;
+                nearestPrimitive = hitPrimitive;
+            }
+        }
+        return false;
+    });
+    if (primitive != nullptr)
+        *primitive = nearestPrimitive;
+    tNear = nearest;
+    return nearestObj;
+}
+
+/**
+ * Point of a hit at distance t along dir. Double precision intersects the object again
+ * in double and rounds the point once, instead of after the float intersection, the
+ * multiply and the add each; t then becomes the refined distance.
+ */
+inline Vec3f hitPoint(const HittableObject &object, const Vec3f &orig, const Vec3f &dir, float &t,
+                      Precision precision) {
+    if (precision != Precision::Double)
+        return orig + dir * t;
+    const Vec3d origin = toDouble(orig), direction = toDouble(dir);
+    double distance = t;
+    if (object.intersectDouble(origin, direction, distance))
+        t = (float) distance;
+    const Vec3d point = origin + direction * distance;
+    return {(float) point[0], (float) point[1], (float) point[2]};
+}
+
+/**
+ * Start of the secondary rays of a hit at distance t along dir: the hit point moved
+ * off the surface, to the side the ray came from, by its error bound. Unlike a fixed
+ * epsilon this holds for scenes of any scale and at any distance from the origin.
+ * @param normal - surface normal at point, of either orientation
+ */
+inline Vec3f secondaryRayOrigin(const HittableObject &object, const Vec3f &orig, const Vec3f &dir, float t,
+                                const Vec3f &point, Vec3f normal) {
+    normal.normalize();
+    if (normal.dotProduct(dir) > 0)
+        normal = -normal;
+    const float error = hitPointError(orig, dir, t) + object.getHitTolerance(t);
+    return offsetRayOrigin(point, normal, error);
+}
+
+/**
+ * Any-hit query: is something between orig and orig + dir * maxDistance
+ * @param blocker - receives the first object found, if not null
+ */
+bool occluded(const Vec3f &orig, const Vec3f &dir, float maxDistance, const SceneBVH &geometry,
+              const HittableObject **blocker = nullptr) {
+    const Ray ray(orig, dir);
+    bool found = false;
+    geometry.getTree().traverse(ray, maxDistance, [&](uint32_t first, uint32_t count, float &tMax) {
+        for (uint32_t k = first; k < first + count; k++) {
+            const HittableObject *object = geometry.getObject(k);
+            float tNear = 0;
+            if (object->intersect(ray, tNear) && tNear < tMax) {
+                if (blocker != nullptr)
+                    *blocker = object;
+                found = true;
+                return true;
+            }
+        }
+        return false;
+    });
+    return found;
+}
+
+/**
+ * Occlusion of a batch of rays sharing orig. The hierarchy is walked once for
+ * the whole batch with the mask of rays that reach each node, so every object is
+ * loaded once, and finished rays drop out. Node boxes are tested 8 rays at a time;
+ * objects, behind virtual calls, one ray at a time.
+ * @param active - bit i selects ray i, at most 64 rays
+ * @param first - object to test before the others, may be null
+ * @param blocker - receives an object that blocked some ray, if not null
+ * @return bit i set if ray i is blocked
+ */
+uint64_t occludedBatch(const Vec3f &orig, const Vec3f *dirs, const float *distances, uint64_t active,
+                       const SceneBVH &geometry, const HittableObject *first = nullptr,
+                       const HittableObject **blocker = nullptr) {
+    uint64_t blocked = 0;
+    auto testObject = [&](const HittableObject *object, uint64_t rays) {
+        for (uint64_t pending = rays & ~blocked; pending != 0; pending &= pending - 1) {
+            const int i = __builtin_ctzll(pending);
+            float tNear = 0;
+            if (object->intersect({orig, dirs[i]}, tNear) && tNear < distances[i]) {
+                blocked |= 1ull << i;
+                if (blocker != nullptr)
+                    *blocker = object;
+            }
+        }
+    };
+    if (first != nullptr)
+        testObject(first, active);
+
+    const std::vector<BVHTree::Node> &nodes = geometry.getTree().getNodes();
+    if (nodes.empty())
+        return blocked;
+    // ray i is lane i % 8 of packet i / 8, unused lanes never reach the masks
+    Vec3x8 invDirs[8];
+    float8 tMax[8] = {};
+    for (uint64_t pending = active; pending != 0; pending &= pending - 1) {
+        const int i = __builtin_ctzll(pending);
+        invDirs[i / 8].set(i % 8, 1.0f / dirs[i]);
+        tMax[i / 8][i % 8] = distances[i];
+    }
+    auto raysHitting = [&](const AABB &box, uint64_t rays) {
+        uint64_t mask = 0;
+        for (uint64_t pending = rays; pending != 0;) {
+            const int packet = __builtin_ctzll(pending) / 8;
+            const mask8 hits = box.intersect(orig, invDirs[packet], tMax[packet]);
+            for (int lane = 0; lane < 8; lane++) {
+                if (hits[lane])
+                    mask |= 1ull << (packet * 8 + lane);
+            }
+            pending &= ~(0xffull << (packet * 8));
+        }
+        return mask & rays;
+    };
+
+    struct Entry {
+        uint32_t node;
+        uint64_t rays;
+    };
+    Entry stack[128];
+    int stackSize = 0;
+    stack[stackSize++] = {0, raysHitting(nodes[0].box, active & ~blocked)};
+    while (stackSize > 0) {
+        const Entry entry = stack[--stackSize];
+        const uint64_t rays = entry.rays & ~blocked;
+        if (rays == 0)
+            continue;
+        const BVHTree::Node &node = nodes[entry.node];
+        if (node.count != 0) {
+            for (uint32_t k = node.offset; k < node.offset + node.count; k++) {
+                const HittableObject *object = geometry.getObject(k);
+                if (object != first)
+                    testObject(object, rays);
+            }
+            continue;
+        }
+        const uint32_t left = entry.node + 1, right = node.offset;
+        const uint64_t rightRays = raysHitting(nodes[right].box, rays);
+        const uint64_t leftRays = raysHitting(nodes[left].box, rays);
+        if (rightRays != 0)
+            stack[stackSize++] = {right, rightRays};
+        if (leftRays != 0)
+            stack[stackSize++] = {left, leftRays};
+    }
+    return blocked;
+}
+
+inline Vec3f reflect(const Vec3f &I, const Vec3f &N) {
+    return I - 2 * I.dotProduct(N) * N;
+}
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "Vector.h"
+#include "VectorPacket.h"
+#include "Ray.h"
+#include "BVH.h"
+#include "SceneObject.h"
+#include "Kernels.h"
+
+constexpr int kTrianglePacketSize = 8;
+
+/**
+ * Eight triangles in structure of arrays layout, intersected together.
+ * Unused lanes hold degenerate triangles, which the test rejects.
+ */
+struct alignas(32) TrianglePacket {
+    Vec3x8 vertices[3]; // corners
+    uint32_t ids[kTrianglePacketSize];
+};
+
+/**
+ * Ray prepared for the watertight test: the dominant axis of the direction
+ * becomes z, and the shear maps the direction onto (0, 0, 1).
+ */
+struct WatertightRay {
+    explicit WatertightRay(const Ray &ray) : origin(ray.origin) {
+        const Vec3f &d = ray.direction;
+        kz = (fabs(d[0]) > fabs(d[1])) ? 0 : 1;
+        if (fabs(d[2]) > fabs(d[kz]))
+            kz = 2;
+        kx = (kz + 1) % 3;
+        ky = (kx + 1) % 3;
+        // keep the winding independent of the direction sign
+        if (d[kz] < 0)
+            swap(kx, ky);
+        shearX = d[kx] / d[kz];
+        shearY = d[ky] / d[kz];
+        shearZ = 1 / d[kz];
+    }
+
+    Vec3f origin;
+    int kx, ky, kz;
+    float shearX, shearY, shearZ;
+};
+
+/**
+ * Watertight ray-triangle test (Woop, Benthin, Wald 2013) over a whole packet.
+ * Points on an edge shared by two triangles are accepted by both, so rays
+ * never slip through a closed mesh.
+ * @param tMax - nearest distance so far, lowered on hit
+ * @param primitive - receives the triangle id on hit
+ */
+inline bool intersectPacket(const TrianglePacket &packet, const WatertightRay &ray,
+                            float &tMax, uint32_t &primitive) {
+    const int kx = ray.kx, ky = ray.ky, kz = ray.kz;
+    const Vec3x8 a = packet.vertices[0] - ray.origin;
+    const Vec3x8 b = packet.vertices[1] - ray.origin;
+    const Vec3x8 c = packet.vertices[2] - ray.origin;
+    const float8 az = a[kz], bz = b[kz], cz = c[kz];
+    const float8 ax = a[kx] - ray.shearX * az;
+    const float8 ay = a[ky] - ray.shearY * az;
+    const float8 bx = b[kx] - ray.shearX * bz;
+    const float8 by = b[ky] - ray.shearY * bz;
+    const float8 cx = c[kx] - ray.shearX * cz;
+    const float8 cy = c[ky] - ray.shearY * cz;
+
+    // scaled barycentric coordinates, a hit has them all of the same sign
+    const float8 u = cx * by - cy * bx;
+    const float8 v = ax * cy - ay * cx;
+    const float8 w = bx * ay - by * ax;
+    const mask8 mixedSigns = ((u < 0) | (v < 0) | (w < 0)) & ((u > 0) | (v > 0) | (w > 0));
+    const float8 det = u + v + w;
+    const float8 t = (u * az + v * bz + w * cz) * ray.shearZ;
+
+    // true lanes convert to -1, so sign is -1 where det is negative
+    const float8 sign = 1.0f + 2.0f * __builtin_convertvector(det < 0, float8);
+    const float8 tScaled = t * sign, detAbs = det * sign;
+    const mask8 valid = ~mixedSigns & (det != 0) & (tScaled > 0) & (tScaled < tMax * detAbs);
+
+    bool found = false;
+    for (int lane = 0; lane < kTrianglePacketSize; lane++) {
+        if (!valid[lane])
+            continue;
+        const float distance = tScaled[lane] / detAbs[lane];
+        if (distance < tMax) {
+            tMax = distance;
+            primitive = packet.ids[lane];
+            found = true;
+        }
+    }
+    return found;
+}
+
+/**
+ * Vertex and index buffers with their hierarchy. Scene snapshots clone every
+ * object each frame, so all copies of a mesh share one MeshData.
+ */
+struct MeshData {
+    std::vector<Vec3f> vertices;
+    std::vector<uint32_t> indices; // three per triangle
+    BVHTree tree;                  // every leaf references a single packet
+    std::vector<TrianglePacket> packets;
+
+    [[nodiscard]] size_t getTrianglesCount() const {
+        return indices.size() / 3;
+    }
+
+    [[nodiscard]] const Vec3f &getCorner(uint32_t triangle, int corner) const {
+        return vertices[indices[3 * triangle + corner]];
+    }
+
+    [[nodiscard]] AABB bounds() const {
+        return tree.bounds();
+    }
+
+    /**
+     * Build the hierarchy and pack its leaves. Must be called again after the vertices change.
+     */
+    void build() {
+        std::vector<AABB> boxes(getTrianglesCount());
+        for (uint32_t triangle = 0; triangle < boxes.size(); triangle++) {
+            for (int corner = 0; corner < 3; corner++)
+                boxes[triangle].extend(getCorner(triangle, corner));
+        }
+        tree.build(boxes, kTrianglePacketSize);
+        packets.clear();
+        const std::vector<uint32_t> &order = tree.getOrder();
+        tree.remapLeaves([&](uint32_t &offset, uint32_t &count) {
+            TrianglePacket packet = {};
+            for (uint32_t lane = 0; lane < count; lane++) {
+                const uint32_t triangle = order[offset + lane];
+                packet.ids[lane] = triangle;
+                for (int corner = 0; corner < 3; corner++)
+                    packet.vertices[corner].set(lane, getCorner(triangle, corner));
+            }
+            offset = (uint32_t) packets.size();
+            count = 1;
+            packets.push_back(packet);
+        });
+    }
+};
+
+/**
+ * Nearest triangle of the mesh along ray, in mesh coordinates.
+ * Dispatched through KernelTable::intersectMesh.
+ */
+inline bool intersectMesh(const MeshData &mesh, const Ray &ray, float &tNear, uint32_t &primitive) {
+    const WatertightRay sheared(ray);
+    float nearest = kInfinity;
+    bool found = false;
+    mesh.tree.traverse(ray, nearest, [&](uint32_t first, uint32_t count, float &tMax) {
+        found |= intersectPacket(mesh.packets[first], sheared, tMax, primitive);
+        return false;
+    });
+    if (!found)
+        return false;
+    tNear = nearest;
+    return true;
+}
+
+class TriangleMesh : public HittableObject {
+public:
+    /**
+     * @param data - built mesh, see MeshData::build()
+     */
+    explicit TriangleMesh(std::shared_ptr<const MeshData> data) : data(std::move(data)) {}
+
+    bool intersect(const Ray &ray, float &tNear) const override {
+        uint32_t primitive = 0;
+        return intersectPrimitive(ray, tNear, primitive);
+    }
+
+    bool intersectPrimitive(const Ray &ray, float &tNear, uint32_t &primitive) const override {
+        return kernels().intersectMesh(*data, {ray.origin - offset, ray.direction}, tNear, primitive);
+    }
+
+    /**
+     * The shared vertices stay where they are, rays are moved the other way
+     */
+    void translate(const Vec3f &offset) override {
+        this->offset += offset;
+    }
+
+    [[nodiscard]] HittableObject *clone() const override {
+        return new TriangleMesh(*this);
+    }
+
+    [[nodiscard]] AABB bounds() const override {
+        const AABB box = data->bounds();
+        return {box.low + offset, box.high + offset};
+    }
+
+    /**
+     * Geometric normal of the triangle, facing the viewer
+     */
+    [[nodiscard]] Vec3f getPrimitiveNormal(const Vec3f &hitPoint, const Vec3f &viewDirection,
+                                           uint32_t primitive) const override {
+        const Vec3f &a = data->getCorner(primitive, 0);
+        Vec3f normal = (data->getCorner(primitive, 1) - a).crossProduct(data->getCorner(primitive, 2) - a);
+        normal.normalize();
+        return normal.dotProduct(viewDirection) > 0 ? -normal : normal;
+    }
+
+    /**
+     * Finds the triangle again by intersecting from just before the hit point
+     */
+    [[nodiscard]] Vec3f getSurfaceNormal(const Vec3f &hitPoint, const Vec3f &viewDirection) const override {
+        float tNear = 0;
+        uint32_t primitive = 0;
+        const float backoff = 2 * hitPointError(hitPoint, viewDirection, 0);
+        if (!intersectPrimitive({hitPoint - viewDirection * backoff, viewDirection}, tNear, primitive))
+            return -viewDirection;
+        return getPrimitiveNormal(hitPoint, viewDirection, primitive);
+    }
+
+    [[nodiscard]] const std::shared_ptr<const MeshData> &getData() const {
+        return data;
+    }
+
+private:
+    std::shared_ptr<const MeshData> data;
+    Vec3f offset;
+};
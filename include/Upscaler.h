@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+
+#include "SDLHelpers.h"
+#include "ThreadPool.h"
+#include "GeometryHelpers.h"
+
+/**
+ * Blend two packed 8-bit-per-channel pixels, two channels per multiply
+ * @param weight - weight of b in [0, 256]
+ */
+inline Uint32 lerpPixel(Uint32 a, Uint32 b, Uint32 weight) {
+    const Uint32 inverse = 256 - weight;
+    const Uint32 rb = (((a & 0x00FF00FF) * inverse + (b & 0x00FF00FF) * weight) >> 8) & 0x00FF00FF;
+    const Uint32 ag = (((a >> 8) & 0x00FF00FF) * inverse + ((b >> 8) & 0x00FF00FF) * weight) & 0xFF00FF00;
+    return rb | ag;
+}
+
+/**
+ * Bilinear upscaler from the internal render resolution to the window size.
+ * The output surface is allocated once and keeps the source pixel format;
+ * per-column sample positions are recomputed only when the source size changes.
+ */
+class Upscaler {
+public:
+    Upscaler(int width, int height) : width(width), height(height),
+                                      surface(createSurface(width, height)),
+                                      columns(width), columnWeights(width) {
+    }
+
+    Upscaler(const Upscaler &other) = delete;
+
+    Upscaler &operator=(const Upscaler &other) = delete;
+
+    ~Upscaler() {
+        freeSurface(surface);
+    }
+
+    /**
+     * Upscale the top-left srcWidth x srcHeight corner of src to the output surface
+     */
+    SDL_Surface *upscale(SDL_Surface *src, int srcWidth, int srcHeight, ThreadPool &pool) {
+        if (srcWidth != cachedWidth) {
+            for (int x = 0; x < width; x++) {
+                const int position = sampleFixed(x, srcWidth, width);
+                columns[x] = position >> 8;
+                columnWeights[x] = position & 0xFF;
+            }
+            cachedWidth = srcWidth;
+        }
+        const int rowsPerTask = 16;
+        pool.parallelFor((height + rowsPerTask - 1) / rowsPerTask, [&](size_t task) {
+            const int yEnd = min(height, (int) (task + 1) * rowsPerTask);
+            for (int y = (int) task * rowsPerTask; y < yEnd; y++) {
+                const int position = sampleFixed(y, srcHeight, height);
+                const int row = position >> 8;
+                const Uint32 rowWeight = position & 0xFF;
+                const Uint32 *top = getPixelPtr(src, 0, row);
+                const Uint32 *bottom = getPixelPtr(src, 0, min(row + 1, srcHeight - 1));
+                Uint32 *target = getPixelPtr(surface, 0, y);
+                for (int x = 0; x < width; x++) {
+                    const int column = columns[x];
+                    const int next = min(column + 1, srcWidth - 1);
+                    const Uint32 upper = lerpPixel(top[column], top[next], columnWeights[x]);
+                    const Uint32 lower = lerpPixel(bottom[column], bottom[next], columnWeights[x]);
+                    target[x] = lerpPixel(upper, lower, rowWeight);
+                }
+            }
+        });
+        return surface;
+    }
+
+    [[nodiscard]] SDL_Surface *getSurface() const {
+        return surface;
+    }
+
+private:
+    /**
+     * Source coordinate of the destination pixel center in 24.8 fixed point
+     */
+    static int sampleFixed(int dst, int srcSize, int dstSize) {
+        const float position = (dst + 0.5f) * srcSize / dstSize - 0.5f;
+        return (int) (clamp(0, srcSize - 1, position) * 256);
+    }
+
+    const int width, height;
+    SDL_Surface *surface;
+    std::vector<int> columns;
+    std::vector<Uint32> columnWeights;
+    int cachedWidth = -1;
+};
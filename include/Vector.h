@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <cstdlib>
 #include <cstdio>
 #include <cmath>
@@ -42,24 +43,32 @@ public:
 
 #if 1
 
+/**
+ * Three components in a four-lane vector, 16 bytes for floats, with the fourth lane kept 0.
+ * Reductions then add whole lane pairs instead of extracting three lanes, and
+ * divisions make sure the padding lane never becomes NaN.
+ */
 template<typename T>
-class Vec3 {
-    typedef T content3 __attribute__((ext_vector_type(3)));
+class alignas(4 * sizeof(T)) Vec3 {
+    typedef T content4 __attribute__((ext_vector_type(4)));
 public:
     Vec3(): content() {
-        content = {0, 0, 0};
+        content = {0, 0, 0, 0};
     }
 
     Vec3(T xx): content() {
-        content = {xx, xx, xx};
+        content = {xx, xx, xx, 0};
     }
 
-    explicit Vec3(content3 content): content() {
+    /**
+     * @param content - components with the fourth one 0
+     */
+    explicit Vec3(content4 content): content() {
         this->content = content;
     }
 
     Vec3(T xx, T yy, T zz): content() {
-        content = {xx, yy, zz};
+        content = {xx, yy, zz, 0};
     }
 
     Vec3 operator+(const Vec3 &v) const {
@@ -83,20 +92,24 @@ public:
     }
 
     Vec3 operator/(const Vec3 &v) const {
-        return Vec3(content / v.content);
+        content4 divisor = v.content;
+        divisor.w = 1;
+        return Vec3(content / divisor);
     }
 
     [[nodiscard]] T dotProduct(const Vec3<T> &v) const {
-        const auto res = content * v.content;
-        return res[0] + res[1] + res[2];
+        return horizontalSum(content * v.content);
     }
 
     Vec3 operator/(const T &r) const {
-        return Vec3(content / r);
+        content4 result = content / r;
+        result.w = 0;
+        return Vec3(result);
     }
 
     Vec3 &operator/=(const T &r) {
         content /= r;
+        content.w = 0;
         return *this;
     }
 
@@ -116,19 +129,38 @@ public:
     }
 
     Vec3 &operator=(T xx) {
-        content = {xx, xx, xx};
+        content = {xx, xx, xx, 0};
         return *this;
     }
 
+    /**
+     * Two lane rotations and one multiply-subtract, with the fourth lane staying 0
+     */
     [[nodiscard]] Vec3 crossProduct(const Vec3<T> &v) const {
-        return Vec3<T>(content[1] * v.content[2] - content[2] * v.content[1],
-                       content[2] * v.content[0] - content[0] * v.content[2],
-                       content[0] * v.content[1] - content[1] * v.content[0]);
+        return Vec3(content.yzxw * v.content.zxyw - content.zxyw * v.content.yzxw);
+    }
+
+    /**
+     * Component-wise minimum and maximum, without branches
+     */
+    [[nodiscard]] Vec3 minComponents(const Vec3 &v) const {
+        return Vec3(__builtin_elementwise_min(content, v.content));
+    }
+
+    [[nodiscard]] Vec3 maxComponents(const Vec3 &v) const {
+        return Vec3(__builtin_elementwise_max(content, v.content));
+    }
+
+    [[nodiscard]] T minComponent() const {
+        return fmin(fmin(content[0], content[1]), content[2]);
+    }
+
+    [[nodiscard]] T maxComponent() const {
+        return fmax(fmax(content[0], content[1]), content[2]);
     }
 
     [[nodiscard]] T length2() const {
-        const auto res = content * content;
-        return res[0] + res[1] + res[2];
+        return horizontalSum(content * content);
     }
 
     [[nodiscard]] T length() const {
@@ -153,10 +185,18 @@ public:
     }
 
     friend Vec3 operator/(const T &r, const Vec3 &v) {
-        return Vec3<T>(r / v.content);
+        content4 result = r / v.content;
+        result.w = 0;
+        return Vec3<T>(result);
     }
 
-    content3 content;
+    content4 content;
+
+private:
+    static T horizontalSum(const content4 &lanes) {
+        const auto pairs = lanes.xy + lanes.zw;
+        return pairs.x + pairs.y;
+    }
 };
 #else
 template<typename T>
@@ -272,6 +312,13 @@ typedef Vec3f RGBColor;
 typedef Vec3<double> Vec3d;
 typedef Vec3<int> Vec3i;
 
+/**
+ * The same vector in double, exactly
+ */
+inline Vec3d toDouble(const Vec3f &v) {
+    return {v[0], v[1], v[2]};
+}
+
 typedef Vec2<float> Vec2f;
 typedef Vec2<double> Vec2d;
 typedef Vec2<int> Vec2i;
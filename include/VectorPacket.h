@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cmath>
+
+#include "Vector.h"
+
+typedef float float8 __attribute__((ext_vector_type(8)));
+typedef int mask8 __attribute__((ext_vector_type(8)));
+typedef float float16 __attribute__((ext_vector_type(16)));
+typedef int mask16 __attribute__((ext_vector_type(16)));
+
+/**
+ * N vectors in structure of arrays layout, one per lane: the block of an array of
+ * structures of arrays. Operations work on all lanes at once and read like their
+ * Vec3f counterparts; per-vector results such as dot products come back N wide.
+ */
+template<int N>
+class Vec3xN {
+public:
+    typedef float lanes __attribute__((ext_vector_type(N)));
+
+    Vec3xN() : axes() {}
+
+    /**
+     * The same vector in every lane
+     */
+    explicit Vec3xN(const Vec3f &v) : axes() {
+        for (int axis = 0; axis < 3; axis++)
+            axes[axis] = v[axis];
+    }
+
+    Vec3xN(const lanes &x, const lanes &y, const lanes &z) : axes() {
+        axes[0] = x;
+        axes[1] = y;
+        axes[2] = z;
+    }
+
+    /**
+     * Up to N vectors, the remaining lanes are 0
+     */
+    static Vec3xN load(const Vec3f *vectors, int count) {
+        Vec3xN result;
+        for (int lane = 0; lane < count; lane++)
+            result.set(lane, vectors[lane]);
+        return result;
+    }
+
+    [[nodiscard]] Vec3f get(int lane) const {
+        return {axes[0][lane], axes[1][lane], axes[2][lane]};
+    }
+
+    void set(int lane, const Vec3f &v) {
+        for (int axis = 0; axis < 3; axis++)
+            axes[axis][lane] = v[axis];
+    }
+
+    /**
+     * All lanes of one component
+     */
+    const lanes &operator[](int axis) const {
+        return axes[axis];
+    }
+
+    lanes &operator[](int axis) {
+        return axes[axis];
+    }
+
+    Vec3xN operator+(const Vec3xN &v) const {
+        return {axes[0] + v.axes[0], axes[1] + v.axes[1], axes[2] + v.axes[2]};
+    }
+
+    Vec3xN operator-(const Vec3xN &v) const {
+        return {axes[0] - v.axes[0], axes[1] - v.axes[1], axes[2] - v.axes[2]};
+    }
+
+    Vec3xN operator-(const Vec3f &v) const {
+        return {axes[0] - v[0], axes[1] - v[1], axes[2] - v[2]};
+    }
+
+    Vec3xN operator-() const {
+        return {-axes[0], -axes[1], -axes[2]};
+    }
+
+    Vec3xN operator*(const Vec3xN &v) const {
+        return {axes[0] * v.axes[0], axes[1] * v.axes[1], axes[2] * v.axes[2]};
+    }
+
+    /**
+     * Every lane scaled by its own factor
+     */
+    Vec3xN operator*(const lanes &r) const {
+        return {axes[0] * r, axes[1] * r, axes[2] * r};
+    }
+
+    Vec3xN operator*(float r) const {
+        return {axes[0] * r, axes[1] * r, axes[2] * r};
+    }
+
+    Vec3xN &operator+=(const Vec3xN &v) {
+        for (int axis = 0; axis < 3; axis++)
+            axes[axis] += v.axes[axis];
+        return *this;
+    }
+
+    [[nodiscard]] lanes dotProduct(const Vec3xN &v) const {
+        return axes[0] * v.axes[0] + axes[1] * v.axes[1] + axes[2] * v.axes[2];
+    }
+
+    [[nodiscard]] lanes dotProduct(const Vec3f &v) const {
+        return axes[0] * v[0] + axes[1] * v[1] + axes[2] * v[2];
+    }
+
+    [[nodiscard]] Vec3xN crossProduct(const Vec3xN &v) const {
+        return {axes[1] * v.axes[2] - axes[2] * v.axes[1],
+                axes[2] * v.axes[0] - axes[0] * v.axes[2],
+                axes[0] * v.axes[1] - axes[1] * v.axes[0]};
+    }
+
+    [[nodiscard]] lanes length2() const {
+        return dotProduct(*this);
+    }
+
+    /**
+     * Lanes of zero length stay as they are, like Vec3f::normalize()
+     */
+    Vec3xN &normalize() {
+        const lanes n = length2();
+        lanes factor = 1;
+        for (int lane = 0; lane < N; lane++) {
+            if (n[lane] > 0)
+                factor[lane] = 1 / sqrtf(n[lane]);
+        }
+        for (int axis = 0; axis < 3; axis++)
+            axes[axis] *= factor;
+        return *this;
+    }
+
+private:
+    lanes axes[3];
+};
+
+typedef Vec3xN<8> Vec3x8;
+typedef Vec3xN<16> Vec3x16;
@@ -1,14 +1,65 @@
 #include "Raycasting.h"
+#include "FramePipeline.h"
+#include "ResolutionScaler.h"
+#include "Upscaler.h"
+#include "Settings.h"
 #include "FastList.h"
+#include "MeshLoader.h"
+#include "Instance.h"
+#include "SDF.h"
+#include "CameraControl.h"
+#include "RenderServer.h"
+#include "RenderClient.h"
+#include "RenderCoordinator.h"
+#include "RenderWorker.h"
+#include "FrameSink.h"
+#include "ImageEncoder.h"
+#include "KernelVariants.h"
+
+#include <sys/wait.h>
+
+SceneOptions generateWorld(FastList<HittableObject *> &objects, FastList<Light *> &lights, MaterialTable &materials);
+
+/**
+ * Scatter dim point lights around the scene to exercise many-lights sampling
+ */
+void addExtraLights(FastList<Light *> &lights, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        Vec3f position((rand() / (float) RAND_MAX - 0.5f) * 30,
+                       (rand() / (float) RAND_MAX) * 15,
+                       (rand() / (float) RAND_MAX - 0.5f) * 30);
+        RGBColor color(rand() / (float) RAND_MAX, rand() / (float) RAND_MAX, rand() / (float) RAND_MAX);
+        lights.pushBack(new PointLight(position, color, 2000));
+    }
+}
 
-SceneOptions generateWorld(FastList<HittableObject *> &objects, FastList<Light *> &lights);
+/**
+ * Replace point lights with spherical lights of the given radius
+ */
+void makeLightsSoft(FastList<Light *> &lights, float radius) {
+    if (radius <= 0)
+        return;
+    for (size_t i = lights.begin(); i != lights.end(); lights.nextIterator(&i)) {
+        Light *light = nullptr;
+        lights.get(i, &light);
+        if (auto point = dynamic_cast<PointLight *>(light)) {
+            lights.set(i, new SphereLight(point->getPosition(), radius, point->color, point->intensity));
+            delete point;
+        }
+    }
+}
 
 void freeWorld(const FastList<HittableObject *> &objects, const FastList<Light *> &lights);
 
 void SDLInit(SDL_Window *&win, int *w, int *h);
 
-void eventLoop(SDL_Surface *content, SDL_Event &event, bool printed, const float moveStep, SceneOptions &options,
-               int &close);
+bool keyToCameraMove(SDL_Scancode key, CameraMove &move);
+
+void eventLoop(SDL_Surface *content, const SDL_Rect &contentRect, SDL_Event &event, bool printed,
+               const float moveStep, ImageEncoder &encoder, const char *screenshot, SceneOptions &options,
+               bool &paused, int &close);
+
+void applyCameraSettings(const RenderSettings &settings, SceneOptions &options);
 
 
 inline Matrix4x4f getRandRot(float modify = 100) {
@@ -17,152 +68,881 @@ inline Matrix4x4f getRandRot(float modify = 100) {
                            (rand() / (float)RAND_MAX - 0.5) / modify);
 }
 
-int main() {
-    FastList<HittableObject *> objects = {};
-    FastList<Light *> lights = {};
-    SceneOptions options = generateWorld(objects, lights);
+/**
+ * Load the mesh given in the settings, centered at the origin
+ * @return null if there is none
+ */
+std::shared_ptr<const HittableObject> loadSceneMesh(const RenderSettings &settings, ThreadPool &pool) {
+    if (settings.mesh == nullptr)
+        return nullptr;
+    auto timeStart = std::chrono::high_resolution_clock::now();
+    std::shared_ptr<MeshData> mesh = loadMesh(settings.mesh, pool);
+    if (mesh == nullptr)
+        return nullptr;
+    fitMesh(*mesh, 0, settings.meshSize);
+    mesh->build();
+    auto passedTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - timeStart);
+    fprintf(stderr, "Loaded %s: %zu triangles in %.1f ms\n", settings.mesh, mesh->getTrianglesCount(),
+            passedTime.count());
+    return std::make_shared<const TriangleMesh>(mesh);
+}
 
-    SDL_Window *win = nullptr;
-    int w = 0, h = 0;
-    const float scale = 1 / 2.0;
-    SDLInit(win, &w, &h);
-    options.width = w * scale;
-    options.height = h * scale;
+/**
+ * Scatter copies of one shape behind the scene to exercise instancing
+ */
+void addInstances(FastList<HittableObject *> &objects, const std::shared_ptr<const HittableObject> &shape,
+                  size_t count, MaterialTable &materials) {
+    // a small palette shared by all instances instead of a material each
+    uint32_t palette[4] = {};
+    for (uint32_t &id : palette) {
+        Material material;
+        material.color = RGBColor(rand() / (float) RAND_MAX, rand() / (float) RAND_MAX, rand() / (float) RAND_MAX);
+        id = materials.add(material);
+    }
+    for (size_t i = 0; i < count; i++) {
+        Matrix4x4f scaling;
+        const float scale = 0.3f + 0.7f * (rand() / (float) RAND_MAX);
+        for (int axis = 0; axis < 3; axis++)
+            scaling.set(axis, axis, scale);
+        const Vec3f position((rand() / (float) RAND_MAX - 0.5f) * 30,
+                             (rand() / (float) RAND_MAX - 0.5f) * 16,
+                             -5 - (rand() / (float) RAND_MAX) * 25);
+        const Matrix4x4f transform = scaling * getRandRot(0.2) * Matrix4x4f::translate(position);
+        auto instance = new Instance(shape, transform);
+        instance->materialId = palette[i % 4];
+        objects.pushBack(instance);
+    }
+}
 
-    SDL_Rect clipRect = {0, 0, w, h};
+/**
+ * Add implicit surfaces on both sides of the spheres: a CSG shape and the same shape baked into a grid
+ */
+void addSdfObjects(FastList<HittableObject *> &objects, const RenderSettings &settings, ThreadPool &pool,
+                   MaterialTable &materials) {
+    if (settings.sdf == 0)
+        return;
+    SphereTracing tracing;
+    tracing.relaxation = settings.sdfRelaxation;
+    tracing.maxSteps = (int) settings.sdfSteps;
+    SdfNodePtr carved = std::make_shared<const SdfCsg>(CsgOperation::Subtraction,
+                                                       std::make_shared<const SdfBox>(Vec3f(0), Vec3f(1), 0.1f),
+                                                       std::make_shared<const SdfSphere>(Vec3f(0), 1.3f));
+    SdfNodePtr shape = std::make_shared<const SdfCsg>(CsgOperation::Union, carved,
+                                                      std::make_shared<const SdfTorus>(Vec3f(0), 1.5f, 0.25f), 0.3f);
+    auto analytic = new SdfObject(std::make_shared<const SdfTranslation>(shape, Vec3f(6, -4, 0)), tracing);
+    auto grid = new SdfObject(std::make_shared<const SdfTranslation>(SdfGrid::bake(*shape, 64, pool),
+                                                                     Vec3f(-6, -4, 0)), tracing);
+    Material material;
+    material.color = {237.0f / 255, 85.0f / 255, 59.0f / 255};
+    analytic->materialId = materials.add(material);
+    material.color = {32.0f / 255, 99.0f / 255, 155.0f / 255};
+    grid->materialId = materials.add(material);
+    objects.pushBack(analytic);
+    objects.pushBack(grid);
+}
 
-    SDL_Surface *content = createSurface(options.width, options.height);
-    SDL_Surface *screen = SDL_GetWindowSurface(win);
+/**
+ * Put the textures chosen in the settings on the demo materials: a checkerboard on the boxes,
+ * noise or an image on the sphere at the origin and a gradient on the SDF shapes
+ */
+void applyTextures(const FastList<HittableObject *> &objects, const RenderSettings &settings,
+                   MaterialTable &materials) {
+    if (settings.textures == 0 && settings.texture == nullptr)
+        return;
+    std::shared_ptr<const Texture> image;
+    if (settings.texture != nullptr)
+        image = ImageTexture::load(settings.texture, 2);
+    const int32_t checker = materials.addTexture(std::make_shared<const CheckerTexture>(
+            4, RGBColor(1), RGBColor(0.2)));
+    const int32_t noise = image ? materials.addTexture(image) : materials.addTexture(std::make_shared<const NoiseTexture>(
+            2, 5, RGBColor(0.3), RGBColor(1)));
+    const int32_t gradient = materials.addTexture(std::make_shared<const GradientTexture>(
+            Vec3f(0, -1.5, 0), Vec3f(0, 1.5, 0), RGBColor(0.2), RGBColor(1)));
+    for (size_t i = objects.begin(); i != objects.end(); objects.nextIterator(&i)) {
+        HittableObject *object = nullptr;
+        objects.get(i, &object);
+        if (object->materialId == 0)
+            continue;
+        Material &material = materials.get(object->materialId);
+        if (dynamic_cast<const OrientedBox *>(object) && settings.textures != 0)
+            material.texture = checker;
+        else if (dynamic_cast<const Sphere *>(object) && (settings.textures != 0 || image))
+            material.texture = noise;
+        else if (dynamic_cast<const SdfObject *>(object) && settings.textures != 0)
+            material.texture = gradient;
+    }
+}
+
+/**
+ * Everything the settings add to the demo scene
+ */
+void addSceneExtras(FastList<HittableObject *> &objects, const RenderSettings &settings, ThreadPool &pool,
+                    MaterialTable &materials) {
+    const std::shared_ptr<const HittableObject> mesh = loadSceneMesh(settings, pool);
+    if (mesh != nullptr) {
+        auto *instance = new Instance(mesh, Matrix4x4f());
+        instance->setAnchor(Vec3d(0, -4, 0));
+        objects.pushBack(instance);
+    }
+    addSdfObjects(objects, settings, pool, materials);
+    addInstances(objects, mesh ? mesh : std::make_shared<const Sphere>(Vec3f(0), 0.5f), settings.instances, materials);
+    applyTextures(objects, settings, materials);
+}
+
+/**
+ * The demo scene with everything the settings add to it
+ */
+SceneOptions buildScene(const RenderSettings &settings, FastList<HittableObject *> &objects,
+                        FastList<Light *> &lights, MaterialTable &materials, ThreadPool &pool) {
+    SceneOptions options = generateWorld(objects, lights, materials);
+    applyCameraSettings(settings, options);
+    addExtraLights(lights, settings.extraLights);
+    makeLightsSoft(lights, settings.lightRadius);
+    options.areaLightSamples = settings.areaLightSamples;
+    options.penumbraDetection = settings.penumbraDetection != 0;
+    options.lightSamples = settings.lightSamples;
+    options.manyLightsThreshold = settings.manyLightsThreshold;
+    options.deferredShading = settings.deferred != 0;
+    options.denoiseIterations = (uint32_t) settings.denoise;
+    addSceneExtras(objects, settings, pool, materials);
+    return options;
+}
+
+constexpr auto kStatsInterval = std::chrono::seconds(2);   // between lines of render statistics
+
+/**
+ * Present the next rendered frame, printing its statistics if nextStats has passed
+ */
+void presentFrame(FramePipeline &pipeline, ResolutionScaler &scaler, Upscaler &upscaler, ThreadPool &pool,
+                  SDL_Window *win, SDL_Surface *screen, FrameSink &sink, ImageEncoder &encoder,
+                  const char *screenshot, SceneOptions &options, bool &paused, int &close,
+                  std::chrono::high_resolution_clock::time_point &nextStats);
+
+/**
+ * Orbits of the demo spheres and the spinning boxes
+ */
+class DemoAnimation {
+public:
+    explicit DemoAnimation(const FastList<HittableObject *> &objects) {
+        HittableObject *object = nullptr;
+        objects.get(2, &object);
+        firstRotatable = dynamic_cast<MarkovaSphere *>(object);
+        objects.get(4, &object);
+        secondRotatable = dynamic_cast<MarkovaSphere *>(object);
+        objects.get(1, &object);
+        firstSideRotatable = dynamic_cast<MarkovaSphere *>(object);
+        objects.get(5, &object);
+        secondSideRotatable = dynamic_cast<MarkovaSphere *>(object);
+        objects.get(6, &object);
+        cubeFirst = dynamic_cast<OrientedBox *>(object);
+        objects.get(7, &object);
+        cubeSecond = dynamic_cast<OrientedBox *>(object);
+        initialCenters[0] = firstRotatable->center;
+        initialCenters[1] = secondRotatable->center;
+        initialCenters[2] = firstSideRotatable->center;
+        initialCenters[3] = secondSideRotatable->center;
+        initialCubes[0] = cubeFirst->getTransform();
+        initialCubes[1] = cubeSecond->getTransform();
+    }
+
+    /**
+     * Move the scene to its state after frame steps, in closed form: every
+     * orbit and spin is a constant rotation, so frame k applies its k-th power
+     */
+    void seek(uint64_t frame) {
+        firstRotatable->center = rotateViewComposFirst.power(frame).multVecMatrix(initialCenters[0]);
+        secondRotatable->center = rotateViewComposSecond.power(frame).multVecMatrix(initialCenters[1]);
+        firstSideRotatable->center = rotateViewComposSideFirst.power(frame).multVecMatrix(initialCenters[2]);
+        secondSideRotatable->center = rotateViewComposSideSecond.power(frame).multVecMatrix(initialCenters[3]);
+        cubeFirst->setTransform(initialCubes[0] * rotateViewCubeFirst.power(frame));
+        cubeSecond->setTransform(initialCubes[1] * rotateViewCubeSecond.power(frame));
+    }
 
-    Matrix4x4f rotateViewMatrix = getRandRot(100),rotateViewCompos = getRandRot(100);
+    void step() {
+        firstRotatable->center = rotateViewComposFirst.multVecMatrix(firstRotatable->center);
+        secondRotatable->center = rotateViewComposSecond.multVecMatrix(secondRotatable->center);
+
+        firstSideRotatable->center = rotateViewComposSideFirst.multVecMatrix(firstSideRotatable->center);
+        secondSideRotatable->center = rotateViewComposSideSecond.multVecMatrix(secondSideRotatable->center);
+
+        // the orbit rotation also turns the cubes around their own centers
+        cubeFirst->setTransform(cubeFirst->getTransform() * rotateViewCubeFirst);
+        cubeSecond->setTransform(cubeSecond->getTransform() * rotateViewCubeSecond);
+    }
+
+private:
     Matrix4x4f rotateViewComposFirst = getRandRot(10), rotateViewComposSecond = getRandRot(10);
     Matrix4x4f rotateViewComposSideFirst = getRandRot(10), rotateViewComposSideSecond = getRandRot(10);
     Matrix4x4f rotateViewCubeFirst = getRandRot(10), rotateViewCubeSecond = getRandRot(10);
+    MarkovaSphere *firstRotatable = nullptr, *secondRotatable = nullptr;
+    MarkovaSphere *firstSideRotatable = nullptr, *secondSideRotatable = nullptr;
+    OrientedBox *cubeFirst = nullptr, *cubeSecond = nullptr;
+    Vec3f initialCenters[4];
+    Matrix4x4f initialCubes[2];
+};
+
+/**
+ * Count the frames of an unchanged paused scene for progressive accumulation
+ */
+void trackAccumulation(SceneOptions &options, SceneOptions &previousOptions, bool paused) {
+    const bool sameScene = paused && options.width == previousOptions.width &&
+                           options.height == previousOptions.height &&
+                           memcmp(&options.cameraToWorld, &previousOptions.cameraToWorld, sizeof(Matrix4x4f)) == 0 &&
+                           memcmp(&options.eye, &previousOptions.eye, sizeof(Vec3d)) == 0;
+    options.accumulatedFrames = sameScene ? previousOptions.accumulatedFrames + 1 : 0;
+    previousOptions = options;
+}
 
-    HittableObject *firstRotatableObj = nullptr, *secondRotatableObj = nullptr;
-    HittableObject *sideFirstRotatableObj = nullptr, *sideSecondRotatableObj = nullptr;
-    HittableObject *cubeFirstObj = nullptr, *cubeSecondObj = nullptr;
+int runServer(const RenderSettings &settings, FastList<HittableObject *> &objects, FastList<Light *> &lights,
+              MaterialTable &materials, SceneOptions options, ThreadPool &pool);
 
-    objects.get(2, &firstRotatableObj);
-    objects.get(4, &secondRotatableObj);
+int runClient(const RenderSettings &settings);
 
-    objects.get(1, &sideFirstRotatableObj);
-    objects.get(5, &sideSecondRotatableObj);
+int runCoordinator(const RenderSettings &settings);
 
-    objects.get(6, &cubeFirstObj);
-    objects.get(7, &cubeSecondObj);
+int runBatch(const RenderSettings &settings, FastList<HittableObject *> &objects, FastList<Light *> &lights,
+             const MaterialTable &materials, SceneOptions options, ThreadPool &pool);
 
-    auto *firstRotatable = dynamic_cast<MarkovaSphere *>(firstRotatableObj),
-            *secondRotatable = dynamic_cast<MarkovaSphere *>(secondRotatableObj),
-            *firstSideRotatable = dynamic_cast<MarkovaSphere *>(sideFirstRotatableObj),
-            *secondSideRotatable = dynamic_cast<MarkovaSphere *>(sideSecondRotatableObj);
+bool openStream(const RenderSettings &settings, FrameSink &sink, int width, int height);
 
-    auto *cubeFirst = dynamic_cast<Cube *>(cubeFirstObj),
-            *cubeSecond = dynamic_cast<Cube *>(cubeSecondObj);
+void printEncoderStats(ImageEncoder &encoder);
 
-    int close = 0;
-    while (!close) {
-        auto timeStart = std::chrono::high_resolution_clock::now();
+int runWorker(const RenderSettings &settings, const char *address);
 
-        firstRotatable->center = rotateViewComposFirst.multVecMatrix(firstRotatable->center);
-        secondRotatable->center = rotateViewComposSecond.multVecMatrix(secondRotatable->center);
+int runAcneCheck();
 
-        firstSideRotatable->center = rotateViewComposSideFirst.multVecMatrix(firstSideRotatable->center);
-        secondSideRotatable->center = rotateViewComposSideSecond.multVecMatrix(secondSideRotatable->center);
+int main(int argc, char **argv) {
+    const RenderSettings settings = parseSettings(argc, argv);
+    if (!selectKernels(settings.isa))
+        return 1;
+    fprintf(stderr, "Kernels: %s\n", kernels().isa);
+    if (settings.acneCheck != 0)
+        return runAcneCheck();
+    if (settings.connect != nullptr)
+        return runClient(settings);
+    if (settings.coordinator != nullptr)
+        return runCoordinator(settings);
+    if (settings.worker != nullptr)
+        return runWorker(settings, settings.worker);
 
-        cubeFirst->setCenter(rotateViewCubeFirst.multVecMatrix(cubeFirst->getCenter()));
-        cubeSecond->setCenter(rotateViewCubeSecond.multVecMatrix(cubeSecond->getCenter()));
+    ThreadPool pool(settings.threads);
+    FastList<HittableObject *> objects = {};
+    FastList<Light *> lights = {};
+    MaterialTable materials;
+    SceneOptions options = buildScene(settings, objects, lights, materials, pool);
+
+    if (settings.server != nullptr || settings.batch != 0) {
+        const int status = settings.batch != 0 ? runBatch(settings, objects, lights, materials, options, pool)
+                                               : runServer(settings, objects, lights, materials, options, pool);
+        freeWorld(objects, lights);
+        return status;
+    }
 
-        render(options, objects, lights, content);
+    SDL_Window *win = nullptr;
+    int w = 0, h = 0;
+    const float initialScale = 1 / 2.0;
+    SDLInit(win, &w, &h);
 
-        SDL_Event event = {};
-        bool printed = false;
-        const float moveStep = 0.1;
+    SDL_Surface *screen = SDL_GetWindowSurface(win);
+
+    ResolutionScaler scaler(w, h, settings.targetFrameTime, settings.minScale, settings.maxScale, initialScale);
+    Upscaler upscaler(w, h);
+    FrameSink sink(settings.streamBuffers);
+    if (!openStream(settings, sink, w, h))
+        return 1;
+    ImageEncoder encoder(settings.encodeThreads, (int) settings.compression);
+    FramePipeline pipeline(scaler.getMaxWidth(), scaler.getMaxHeight(), settings.framesInFlight, pool);
+    DemoAnimation animation(objects);
+
+    uint64_t frame = 0;
+    bool paused = false;
+    SceneOptions previousOptions = options;
+
+    int close = 0;
+    auto nextStats = std::chrono::high_resolution_clock::now() + kStatsInterval;
+    while (!close) {
+        auto timeStart = std::chrono::high_resolution_clock::now();
+
+        if (!paused)
+            animation.step();
 
-        eventLoop(content, event, printed, moveStep, options, close);
+        options.width = scaler.getWidth();
+        options.height = scaler.getHeight();
+        trackAccumulation(options, previousOptions, paused);
+        pipeline.submit(std::make_shared<const SceneSnapshot>(options, objects, lights, materials, frame++));
 
-        SDL_BlitScaled(content, nullptr, screen, &clipRect);
-        SDL_UpdateWindowSurface(win);
+        if (pipeline.shouldPresent())
+            presentFrame(pipeline, scaler, upscaler, pool, win, screen, sink, encoder, settings.screenshot, options,
+                         paused, close, nextStats);
 
         auto timeEnd = std::chrono::high_resolution_clock::now();
         auto passedTime = std::chrono::duration<float, std::milli>(timeEnd - timeStart).count();
-        fprintf(stderr, "\rReal FPS: %.2f ", 1.0f / passedTime * 1000);
-        const float fpsTarget = 35;
-        if (passedTime / 1000 < 1 / fpsTarget) {
-            float wait = 1000.0f / fpsTarget - passedTime;
+        const float realFps = 1.0f / passedTime * 1000;
+        if (passedTime < settings.targetFrameTime) {
+            float wait = settings.targetFrameTime - passedTime;
             SDL_Delay(wait);
         }
         timeEnd = std::chrono::high_resolution_clock::now();
         passedTime = std::chrono::duration<float, std::milli>(timeEnd - timeStart).count();
         float fps = 1.0f / (passedTime / 1000);
-        fprintf(stderr, "FPS: %.2f\n", fps);
+        // one status line, rewritten every frame
+        fprintf(stderr, "\rFPS: %.2f, real FPS: %.2f, scale %.2f ", fps, realFps, scaler.getScale());
+        if (sink.isOpen())
+            fprintf(stderr, "stream stalls: %zu ", sink.getStalls());
+    }
+    fprintf(stderr, "\n");
+
+    RenderedFrame pendingFrame;
+    while (pipeline.acquire(pendingFrame))
+        pipeline.release(pendingFrame);
+    if (sink.isOpen()) {
+        sink.close();
+        fprintf(stderr, "Streamed %zu frames, %zu stalls on a full ring, %.1f ms\n", sink.getFrames(),
+                sink.getStalls(), sink.getStallTime());
+    }
+    printEncoderStats(encoder);
+
+    freeWorld(objects, lights);
+    return 0;
+}
+
+/**
+ * Serve frames to remote clients instead of a window, one client at a time.
+ * Frames are rendered at the size the client asks for, and only while the
+ * client keeps up with acknowledging them.
+ */
+int runServer(const RenderSettings &settings, FastList<HittableObject *> &objects, FastList<Light *> &lights,
+              MaterialTable &materials, SceneOptions options, ThreadPool &pool) {
+    RenderServer server(settings.serverWindow);
+    if (!server.listen(settings.server))
+        return 1;
+    fprintf(stderr, "Listening on %s\n", settings.server);
+    DemoAnimation animation(objects);
+    uint64_t frame = 0;
+    bool paused = false;
+    while (true) {
+        if (!server.acceptClient())
+            continue;
+        options.width = server.getWidth();
+        options.height = server.getHeight();
+        FramePipeline pipeline(server.getWidth(), server.getHeight(), 1, pool);
+        SceneOptions previousOptions = options;
+        while (server.hasClient()) {
+            // with a full window only wait for messages: acknowledgements pace the rendering
+            server.poll(server.canSend() ? 0 : 100, options, materials, lights, paused);
+            if (!server.canSend())
+                continue;
+            if (!paused)
+                animation.step();
+            trackAccumulation(options, previousOptions, paused);
+            pipeline.submit(std::make_shared<const SceneSnapshot>(options, objects, lights, materials, frame++));
+            RenderedFrame rendered;
+            pipeline.acquire(rendered);
+            if (server.sendFrame(rendered.surface, rendered.scene->getFrame(), pool))
+                fprintf(stderr, "\rFrame %llu: %.1f ms, %u tiles, %zu bytes ",
+                        (unsigned long long) rendered.scene->getFrame(), rendered.renderTime,
+                        server.getLastTiles(), server.getLastBytes());
+            pipeline.release(rendered);
+        }
     }
+}
+
+/**
+ * Show the frames of a render server and send it the camera moves.
+ * With clientFrames set there is no window: that many frames are received,
+ * the last one is saved to client.png and the client exits.
+ */
+int runClient(const RenderSettings &settings) {
+    const bool headless = settings.clientFrames > 0;
+    SDL_Window *win = nullptr;
+    int w = 640, h = 480;
+    if (!headless)
+        SDLInit(win, &w, &h);
+    RenderClient client;
+    if (!client.connect(settings.connect, max(1, (int) (w * settings.maxScale)), max(1, (int) (h * settings.maxScale))))
+        return 1;
+    ThreadPool pool(settings.threads);
+    ImageEncoder encoder(settings.encodeThreads, (int) settings.compression);
+    Upscaler upscaler(w, h);
+    SDL_Surface *screen = headless ? nullptr : SDL_GetWindowSurface(win);
+    SDL_Surface *content = nullptr;
+    size_t received = 0;
+    int close = 0;
+    while (!close) {
+        if (client.frameReady(headless ? -1 : 10)) {
+            if (!client.receiveFrame()) {
+                fprintf(stderr, "\nServer closed the connection\n");
+                break;
+            }
+            received++;
+            fprintf(stderr, "\rFrame %llu: %u tiles, %zu bytes ", (unsigned long long) client.getFrame(),
+                    client.getLastTiles(), client.getLastBytes());
+            if (content == nullptr || content->w != client.getWidth() || content->h != client.getHeight()) {
+                if (content != nullptr)
+                    freeSurface(content);
+                content = createSurface(client.getWidth(), client.getHeight());
+            }
+            for (int y = 0; y < client.getHeight(); y++)
+                memcpy(getPixelPtr(content, 0, y), &client.getPixels()[(size_t) y * client.getWidth()],
+                       client.getWidth() * 4);
+            if (headless && received >= settings.clientFrames)
+                break;
+            if (!headless) {
+                SDL_Surface *upscaled = upscaler.upscale(content, content->w, content->h, pool);
+                SDL_BlitSurface(upscaled, nullptr, screen, nullptr);
+                SDL_UpdateWindowSurface(win);
+            }
+        }
+        SDL_Event event = {};
+        while (!headless && SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) {
+                close = 1;
+            } else if (event.type == SDL_KEYDOWN) {
+                CameraMove move;
+                const SDL_Scancode key = event.key.keysym.scancode;
+                if (keyToCameraMove(key, move))
+                    client.sendCameraMove(move, 0.1);
+                else if (key == SDL_SCANCODE_C)
+                    client.sendMaterialColor(1 + rand() % 8, rand() / (float) RAND_MAX, rand() / (float) RAND_MAX,
+                                             rand() / (float) RAND_MAX);
+                else if (key == SDL_SCANCODE_L)
+                    client.sendLightColor(0, rand() / (float) RAND_MAX, rand() / (float) RAND_MAX,
+                                          rand() / (float) RAND_MAX);
+                else if (key == SDL_SCANCODE_F && content != nullptr)
+                    encoder.save(content, content->w, content->h, settings.screenshot);
+            }
+        }
+    }
+    if (headless && content != nullptr) {
+        encoder.save(content, content->w, content->h, "client.png");
+        fprintf(stderr, "\nSaved frame %llu to client.png\n", (unsigned long long) client.getFrame());
+    }
+    if (content != nullptr)
+        freeSurface(content);
+    printEncoderStats(encoder);
+    return received > 0 ? 0 : 1;
+}
+
+constexpr size_t kBatchTilesPerThread = 8;  // tiles rendered together per thread, so the last ones balance out
+constexpr size_t kMaxBatchFrames = 64;
+
+/**
+ * Start streaming frames if the settings ask for it
+ * @return false if the stream is asked for and can't be opened
+ */
+bool openStream(const RenderSettings &settings, FrameSink &sink, int width, int height) {
+    if (settings.stream == nullptr)
+        return true;
+    StreamFormat format;
+    if (strcmp(settings.streamFormat, "y4m") == 0) {
+        format = StreamFormat::Y4m;
+    } else if (strcmp(settings.streamFormat, "rgb") == 0) {
+        format = StreamFormat::Rgb;
+    } else {
+        fprintf(stderr, "Unknown stream format %s, expected y4m or rgb\n", settings.streamFormat);
+        return false;
+    }
+    const int fps = max(1, (int) lround(1000 / settings.targetFrameTime));
+    return sink.open(settings.stream, format, width, height, fps);
+}
 
+/**
+ * Wait for the images still queued in encoder and report its throughput
+ */
+void printEncoderStats(ImageEncoder &encoder) {
+    encoder.finish();
+    if (encoder.getImages() > 0)
+        fprintf(stderr, "Encoded %zu images, %.1f MB, %.2f images/s\n", encoder.getImages(),
+                encoder.getBytes() / 1e6, encoder.getThroughput());
+}
+
+/**
+ * Render settings.frames frames of the animation without a window, several at a
+ * time when they are small, into an image sequence or a stream.
+ * Frame k is the scene after k animation steps.
+ */
+int runBatch(const RenderSettings &settings, FastList<HittableObject *> &objects, FastList<Light *> &lights,
+             const MaterialTable &materials, SceneOptions options, ThreadPool &pool) {
+    options.width = (uint32_t) settings.width;
+    options.height = (uint32_t) settings.height;
+    const int width = (int) options.width, height = (int) options.height;
+    // the G-buffer and the denoiser span a whole frame, so those frames are rendered one by one
+    const bool wholeFrames = options.deferredShading || options.denoiseIterations > 0;
+    const size_t tiles = (size_t) ((width + kTileSize - 1) / kTileSize) * ((height + kTileSize - 1) / kTileSize);
+    size_t group = (pool.getThreadsCount() * kBatchTilesPerThread + tiles - 1) / tiles;
+    group = wholeFrames ? 1 : min(min(group, kMaxBatchFrames), (size_t) settings.frames);
+    fprintf(stderr, "Rendering %zu frames of %d x %d, %zu at a time\n", (size_t) settings.frames, width, height,
+            group);
+
+    std::unique_ptr<GBuffer> gbuffer;
+    std::unique_ptr<Denoiser> denoiser;
+    if (wholeFrames) {
+        gbuffer = std::make_unique<GBuffer>(width, height);
+        denoiser = std::make_unique<Denoiser>(width, height);
+    }
+    FrameSink sink(settings.streamBuffers);
+    if (!openStream(settings, sink, width, height))
+        return 1;
+    ImageEncoder encoder(settings.encodeThreads, (int) settings.compression);
+    std::vector<SDL_Surface *> surfaces;
+    for (size_t i = 0; i < group; i++)
+        surfaces.push_back(createSurface(width, height));
+    // OpenEXR files get the linear colors; accumulating no previous frames, the accumulators just keep them
+    const bool linear = settings.stream == nullptr && pathExtension(settings.output) == ".exr";
+    std::vector<std::unique_ptr<FrameAccumulator>> accumulators;
+    std::vector<FrameAccumulator *> linearFrames;
+    for (size_t i = 0; linear && i < group; i++) {
+        accumulators.push_back(std::make_unique<FrameAccumulator>(width, height));
+        linearFrames.push_back(accumulators.back().get());
+    }
+    std::vector<RGBColor> denoised;
+    DemoAnimation animation(objects);
+    std::vector<SceneSnapshotPtr> scenes;
+    int status = 0;
+    auto timeStart = std::chrono::high_resolution_clock::now();
+    for (uint64_t first = 0; first < settings.frames && status == 0; first += group) {
+        const size_t count = min((size_t) (settings.frames - first), group);
+        scenes.clear();
+        for (size_t i = 0; i < count; i++) {
+            animation.seek(first + i);
+            scenes.push_back(std::make_shared<const SceneSnapshot>(options, objects, lights, materials, first + i));
+        }
+        if (wholeFrames)
+            renderDeferred(scenes[0], surfaces[0], pool, *gbuffer, linear ? linearFrames[0] : nullptr, nullptr,
+                           denoiser.get());
+        else
+            renderFrames(scenes, surfaces, pool, linearFrames);
+
+        if (settings.stream != nullptr) {
+            for (size_t i = 0; i < count && status == 0; i++) {
+                if (!sink.push(surfaces[i]))
+                    status = 1;
+            }
+        } else if (linear && options.denoiseIterations > 0) {
+            denoised.resize((size_t) width * height);
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++)
+                    denoised[(size_t) y * width + x] = denoiser->color(*gbuffer, gbuffer->index(x, y));
+            }
+            encoder.save(denoised.data(), width, height, formatFramePath(settings.output, first));
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                const std::string path = formatFramePath(settings.output, first + i);
+                if (linear)
+                    encoder.save(linearFrames[i]->getColors().data(), width, height, path);
+                else
+                    encoder.save(surfaces[i], width, height, path);
+            }
+        }
+        auto passedTime = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - timeStart);
+        fprintf(stderr, "\rFrame %llu of %zu, %.2f frames/s ", (unsigned long long) (first + count),
+                (size_t) settings.frames, (first + count) / passedTime.count());
+    }
+    fprintf(stderr, "\n");
+    if (sink.isOpen()) {
+        sink.close();
+        fprintf(stderr, "Streamed %zu frames, %zu stalls on a full ring, %.1f ms\n", sink.getFrames(),
+                sink.getStalls(), sink.getStallTime());
+    }
+    printEncoderStats(encoder);
+    scenes.clear();
+    for (SDL_Surface *surface: surfaces)
+        freeSurface(surface);
+    return status;
+}
+
+/**
+ * Render settings.frames frames with worker processes: settings.workers local ones
+ * forked here, and any number started with --worker on this or other machines.
+ */
+int runCoordinator(const RenderSettings &settings) {
+    if (pathExtension(settings.output) == ".exr") {
+        fprintf(stderr, "Workers send 8-bit tiles, render OpenEXR frames with --batch instead\n");
+        return 1;
+    }
+    if (settings.deferred != 0 || settings.denoise != 0)
+        fprintf(stderr, "Workers render tiles with the forward renderer, ignoring --deferred and --denoise\n");
+    std::vector<pid_t> children;
+    int status = 1;
+    {
+        RenderCoordinator coordinator(settings, kTileSize);
+        if (!coordinator.listen(settings.coordinator))
+            return 1;
+        fprintf(stderr, "Listening on %s\n", settings.coordinator);
+        // forked before any thread exists; the local workers share the cores of this machine
+        for (size_t i = 0; i < settings.workers; i++) {
+            const pid_t child = fork();
+            if (child == 0) {
+                RenderSettings local = settings;
+                local.threads = max(1, (int) (settings.threads / settings.workers));
+                _exit(runWorker(local, settings.coordinator));
+            }
+            if (child < 0)
+                fprintf(stderr, "Can't start a worker: %s\n", strerror(errno));
+            else
+                children.push_back(child);
+        }
+        // the scene every worker has to build before it gets jobs
+        uint64_t sceneHash = 0;
+        {
+            srand(kSceneSeed);
+            ThreadPool pool(settings.threads);
+            FastList<HittableObject *> objects = {};
+            FastList<Light *> lights = {};
+            MaterialTable materials;
+            const SceneOptions options = buildScene(settings, objects, lights, materials, pool);
+            sceneHash = SceneHash(options, objects, lights, materials).getValue();
+            freeWorld(objects, lights);
+        }
+        // without local workers wait for remote ones for good
+        size_t running = children.size();
+        auto waiting = [&running, &settings]() {
+            while (running > 0 && waitpid(-1, nullptr, WNOHANG) > 0)
+                running--;
+            return settings.workers == 0 || running > 0;
+        };
+        ImageEncoder encoder(settings.encodeThreads, (int) settings.compression);
+        if (coordinator.run(encoder, sceneHash, waiting))
+            status = 0;
+        printEncoderStats(encoder);
+    }
+    // closing the connections tells the workers to exit
+    for (pid_t child: children)
+        waitpid(child, nullptr, 0);
+    return status;
+}
+
+/**
+ * Render the jobs of a coordinator until it closes the connection. The scene is
+ * rebuilt from the arguments the coordinator sends, frame k is the scene after k
+ * animation steps. The coordinator only sends jobs if the scene hashes the same
+ * as its own, see SceneHash.
+ */
+int runWorker(const RenderSettings &settings, const char *address) {
+    RenderWorker worker;
+    if (!worker.connect(address))
+        return 1;
+    std::vector<char *> argv = {(char *) "RayCaster"};
+    for (const std::string &argument: worker.getArguments())
+        argv.push_back((char *) argument.c_str());
+    const RenderSettings sceneSettings = parseSettings((int) argv.size(), argv.data());
+
+    srand(worker.getSeed());
+    ThreadPool pool(settings.threads);
+    FastList<HittableObject *> objects = {};
+    FastList<Light *> lights = {};
+    MaterialTable materials;
+    SceneOptions options = buildScene(sceneSettings, objects, lights, materials, pool);
+    if (!worker.sendSceneHash(SceneHash(options, objects, lights, materials).getValue())) {
+        freeWorld(objects, lights);
+        return 1;
+    }
+    options.width = worker.getWidth();
+    options.height = worker.getHeight();
+    options.deferredShading = false;
+    options.denoiseIterations = 0;
+    DemoAnimation animation(objects);
+    SDL_Surface *surface = createSurface(worker.getWidth(), worker.getHeight());
+
+    SceneSnapshotPtr scene;
+    JobMessage job = {};
+    size_t rendered = 0;
+    while (worker.receiveJob(job)) {
+        auto timeStart = std::chrono::high_resolution_clock::now();
+        if (scene == nullptr || scene->getFrame() != job.frame) {
+            animation.seek(job.frame);
+            scene = std::make_shared<const SceneSnapshot>(options, objects, lights, materials, job.frame);
+        }
+        renderRegion(*scene, Camera(scene->getOptions()), surface, pool, (int) job.x, (int) job.y, (int) job.width,
+                     (int) job.height);
+        auto passedTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() -
+                                                                    timeStart);
+        if (!worker.sendResult(job, surface, passedTime.count()))
+            break;
+        rendered++;
+    }
+    fprintf(stderr, "Worker rendered %zu jobs\n", rendered);
+    scene.reset();
+    freeSurface(surface);
     freeWorld(objects, lights);
     return 0;
 }
 
-void eventLoop(SDL_Surface *content, SDL_Event &event, bool printed, const float moveStep, SceneOptions &options,
-               int &close) {
+/**
+ * Self-intersection check of the secondary ray origins: shadow rays leaving the lit
+ * side of every kind of shape must not hit it again, for shapes from 1e-3 to 1e6
+ * units seen from 5 to 500 times their size
+ * @return 1 if some did
+ */
+int runAcneCheck() {
+    const int grid = 64;
+    size_t failures = 0;
+    for (float scale : {1e-3f, 1e-1f, 1.f, 1e2f, 1e4f, 1e6f}) {
+        for (float distance : {5.f, 50.f, 500.f}) {
+            // the eye is at the origin, so far shapes are also far from it
+            Vec3f center(0.3f, 0.2f, -1);
+            center.normalize();
+            center *= distance * scale;
+            const Vec3f light = center + Vec3f(2, 3, 2) * (4 * scale);
+            Matrix4x4f scaling;
+            for (int axis = 0; axis < 3; axis++)
+                scaling.set(axis, axis, scale);
+            auto mesh = std::make_shared<MeshData>();
+            for (const Vec3f &corner : {Vec3f(1, 1, 1), Vec3f(1, -1, -1), Vec3f(-1, 1, -1), Vec3f(-1, -1, 1)})
+                mesh->vertices.push_back(center + corner * scale);
+            mesh->indices = {0, 1, 2, 0, 3, 1, 0, 2, 3, 1, 3, 2};
+            mesh->build();
+            const std::unique_ptr<HittableObject> shapes[] = {
+                    std::make_unique<Sphere>(center, scale),
+                    std::make_unique<OrientedBox>(scaling * Matrix4x4f::rot(0.3f, 0.5f, 0.7f) *
+                                                  Matrix4x4f::translate(center)),
+                    std::make_unique<SdfObject>(std::make_shared<const SdfSphere>(center, scale)),
+                    std::make_unique<TriangleMesh>(mesh),
+                    std::make_unique<Instance>(std::make_shared<const Sphere>(Vec3f(0), 1.f),
+                                               scaling * Matrix4x4f::translate(center))};
+            const char *names[] = {"sphere", "box", "sdf", "mesh", "instance"};
+            for (size_t s = 0; s < std::size(shapes); s++) {
+                const HittableObject &shape = *shapes[s];
+                size_t lit = 0, selfHits = 0;
+                for (int j = 0; j < grid; j++) {
+                    for (int i = 0; i < grid; i++) {
+                        Vec3f dir = center + Vec3f((i + 0.5f) / grid * 4 - 2, (j + 0.5f) / grid * 4 - 2, 0) * scale;
+                        dir.normalize();
+                        float t = 0;
+                        uint32_t primitive = 0;
+                        if (!shape.intersectPrimitive({Vec3f(0), dir}, t, primitive))
+                            continue;
+                        const Vec3f point = dir * t;
+                        Vec3f normal = shape.getPrimitiveNormal(point, dir, primitive);
+                        const Vec3f origin = secondaryRayOrigin(shape, Vec3f(0), dir, t, point, normal);
+                        Vec3f toLight = light - origin;
+                        const float lightDistance = toLight.length();
+                        toLight /= lightDistance;
+                        normal.normalize();
+                        if (normal.dotProduct(dir) > 0)
+                            normal = -normal;
+                        // unlit, or so grazing that the approximate normal decides
+                        if (normal.dotProduct(toLight) < 0.01f)
+                            continue;
+                        lit++;
+                        float tShadow = 0;
+                        if (shape.intersect({origin, toLight}, tShadow) && tShadow < lightDistance)
+                            selfHits++;
+                    }
+                }
+                fprintf(stderr, "%-8s size %-6g at %-4g sizes: %zu of %zu shadow rays hit the surface they left\n",
+                        names[s], scale, distance, selfHits, lit);
+                failures += selfHits;
+            }
+        }
+    }
+    fprintf(stderr, failures == 0 ? "No self-intersections\n" : "%zu self-intersections\n", failures);
+    return failures == 0 ? 0 : 1;
+}
+
+void applyCameraSettings(const RenderSettings &settings, SceneOptions &options) {
+    if (strcmp(settings.projection, "thin-lens") == 0)
+        options.projection = Projection::ThinLens;
+    else if (strcmp(settings.projection, "ortho") == 0)
+        options.projection = Projection::Orthographic;
+    else
+        options.projection = Projection::Pinhole;
+    options.aperture = settings.aperture;
+    options.focusDistance = settings.focusDistance;
+    if (strcmp(settings.precision, "double") == 0)
+        options.precision = Precision::Double;
+    else if (strcmp(settings.precision, "mixed") == 0)
+        options.precision = Precision::CameraRelative;
+    else
+        options.precision = Precision::Float;
+    options.worldOrigin = settings.worldOffset;
+}
+
+/**
+ * Show the oldest frame of the pipeline, upscaled to the window, and stream it
+ */
+void presentFrame(FramePipeline &pipeline, ResolutionScaler &scaler, Upscaler &upscaler, ThreadPool &pool,
+                  SDL_Window *win, SDL_Surface *screen, FrameSink &sink, ImageEncoder &encoder,
+                  const char *screenshot, SceneOptions &options, bool &paused, int &close,
+                  std::chrono::high_resolution_clock::time_point &nextStats) {
+    RenderedFrame rendered;
+    if (!pipeline.acquire(rendered))
+        return;
+    scaler.update(rendered.renderTime);
+    const auto now = std::chrono::high_resolution_clock::now();
+    if (now >= nextStats) {
+        // ends the status line, which the next frame starts again below the statistics
+        nextStats = now + kStatsInterval;
+        fprintf(stderr, "\nShadow rays: %llu, occluder cache hit rate: %.2f, SDF steps per ray: %.1f",
+                (unsigned long long) rendered.stats.shadowRays, rendered.stats.occluderCacheHitRate(),
+                rendered.stats.averageSdfSteps());
+        const SceneOptions &frameOptions = rendered.scene->getOptions();
+        if (frameOptions.deferredShading || frameOptions.denoiseIterations > 0)
+            fprintf(stderr, ", visibility: %.1f ms, shading: %.1f ms, denoise: %.1f ms",
+                    rendered.stats.visibilityTime, rendered.stats.shadingTime, rendered.stats.denoiseTime);
+        fprintf(stderr, "\n");
+    }
+
+    const SceneOptions &renderedOptions = rendered.scene->getOptions();
+    const SDL_Rect contentRect = {0, 0, (int) renderedOptions.width, (int) renderedOptions.height};
+
+    SDL_Event event = {};
+    bool printed = false;
+    const float moveStep = 0.1;
+
+    eventLoop(rendered.surface, contentRect, event, printed, moveStep, encoder, screenshot, options, paused, close);
+
+    SDL_Surface *upscaled = upscaler.upscale(rendered.surface, contentRect.w, contentRect.h, pool);
+    pipeline.release(rendered);
+    SDL_BlitSurface(upscaled, nullptr, screen, nullptr);
+    SDL_UpdateWindowSurface(win);
+    // the stream keeps the window size while the render resolution changes
+    if (sink.isOpen() && !sink.push(upscaled))
+        close = 1;
+}
+
+/**
+ * Camera move bound to a key
+ * @return false if the key has no move
+ */
+bool keyToCameraMove(SDL_Scancode key, CameraMove &move) {
+    switch (key) {
+        case SDL_SCANCODE_W: move = CameraMove::Forward; return true;
+        case SDL_SCANCODE_S: move = CameraMove::Back; return true;
+        case SDL_SCANCODE_A: move = CameraMove::Left; return true;
+        case SDL_SCANCODE_D: move = CameraMove::Right; return true;
+        case SDL_SCANCODE_Q: move = CameraMove::YawLeft; return true;
+        case SDL_SCANCODE_E: move = CameraMove::YawRight; return true;
+        case SDL_SCANCODE_Z: move = CameraMove::Up; return true;
+        case SDL_SCANCODE_X: move = CameraMove::Down; return true;
+        case SDL_SCANCODE_UP: move = CameraMove::PitchUp; return true;
+        case SDL_SCANCODE_DOWN: move = CameraMove::PitchDown; return true;
+        case SDL_SCANCODE_P: move = CameraMove::Pause; return true;
+        default: return false;
+    }
+}
+
+void eventLoop(SDL_Surface *content, const SDL_Rect &contentRect, SDL_Event &event, bool printed,
+               const float moveStep, ImageEncoder &encoder, const char *screenshot, SceneOptions &options,
+               bool &paused, int &close) {
     while (SDL_PollEvent(&event)) {
         switch (event.type) {
             case SDL_QUIT:
                 close = 1;
                 break;
-            case SDL_KEYDOWN:
-                Vec3f dirForward = options.cameraToWorld.multDirMatrix(Vec3f(0, 0, -1)) * moveStep;
-                Vec3f dirDown = options.cameraToWorld.multDirMatrix(Vec3f(0, 1, 0)) * moveStep;
-                Vec3f dirLeft = options.cameraToWorld.multDirMatrix(Vec3f(-1, 0, 0)) * moveStep;
-                switch (event.key.keysym.scancode) {
-                    case SDL_SCANCODE_W:{
-                        options.cameraToWorld *= Matrix4x4f::translate(dirForward);
-                        break;
-                    }
-                    case SDL_SCANCODE_S:{
-                        options.cameraToWorld *= Matrix4x4f::translate(-dirForward);
-                        break;
-                    }
-                    case SDL_SCANCODE_A:{
-                        options.cameraToWorld *= Matrix4x4f::translate(dirLeft);
-                        break;
-                    }
-                    case SDL_SCANCODE_D:{
-                        options.cameraToWorld *= Matrix4x4f::translate(-dirLeft);
-                        break;
-                    }
-                    case SDL_SCANCODE_Q:{
-                        options.cameraToWorld *= Matrix4x4f::rotY(-moveStep);
-                        break;
-                    }
-                    case SDL_SCANCODE_E:{
-                        options.cameraToWorld *= Matrix4x4f::rotY(moveStep);
-                        break;
-                    }
-                    case SDL_SCANCODE_Z:{
-                        options.cameraToWorld *= Matrix4x4f::translate(dirDown);
-                        break;
-                    }
-                    case SDL_SCANCODE_X:{
-                        options.cameraToWorld *= Matrix4x4f::translate(-dirDown);
-                        break;
-                    }
-                    case SDL_SCANCODE_F:{
-                        if(!printed)
-                            IMG_SavePNG(content, "screensoot.png");
-                        printed = true;
-                        break;
-                    }
-                    case SDL_SCANCODE_UP:{
-                        options.cameraToWorld *= Matrix4x4f::rotX(moveStep);
-                        break;
-                    }
-                    case SDL_SCANCODE_DOWN:{
-                        options.cameraToWorld *= Matrix4x4f::rotX(-moveStep);
-                        break;
-                    }
-                    default:
-                        break;
+            case SDL_KEYDOWN: {
+                CameraMove move;
+                if (keyToCameraMove(event.key.keysym.scancode, move)) {
+                    applyCameraMove(move, moveStep, options, paused);
+                } else if (event.key.keysym.scancode == SDL_SCANCODE_F) {
+                    if (!printed)
+                        encoder.save(content, contentRect.w, contentRect.h, screenshot);
+                    printed = true;
                 }
+                break;
+            }
+            default:
+                break;
         }
     }
 }
@@ -182,12 +962,10 @@ void freeWorld(const FastList<HittableObject *> &objects, const FastList<Light *
 }
 
 
-SceneOptions generateWorld(FastList<HittableObject *> &objects, FastList<Light *> &lights) {
+SceneOptions generateWorld(FastList<HittableObject *> &objects, FastList<Light *> &lights, MaterialTable &materials) {
     SceneOptions options = {};
 
-    options.cameraToWorld.set(3, 2, 10);
-    options.cameraToWorld.set(3, 1, 1);
-    options.cameraToWorld.set(3, 0, 0);
+    options.eye = Vec3d(0, 1, 10);
 
     float w[5] = {0.01, 0.06, 0.1, 0.15, 0.2};
     float r[5] = {0.7, 0.7, 2, 0.7, 0.7};
@@ -205,17 +983,22 @@ SceneOptions generateWorld(FastList<HittableObject *> &objects, FastList<Light *
             sph = new MarkovaSphere(xformSphere, r[k]);
         else
             sph = new Sphere({0, 0, 0}, r[k]);
-        sph->n = n;
-        sph->Ks = w[k];
-        sph->color = colors[k];
+        Material material;
+        material.n = n;
+        material.Ks = w[k];
+        material.color = colors[k];
+        sph->materialId = materials.add(material);
         objects.pushBack(sph);
     }
-    HittableObject *cubeOne = new Cube({2.5, -2.5, 2.5}, 1),
-            *cubeTwo = new Cube({-2.5, 2.5, -2.5}, 1);
-
-    cubeOne->n = cubeTwo->n = 16;
-    cubeOne->color = {108.0f / 255, 216.0f / 255, 212.0f / 255};
-    cubeTwo->color = {216.0f / 255, 108.0f / 255, 112.0f / 255};
+    HittableObject *cubeOne = new OrientedBox(Matrix4x4f::translate({2.5, -2.5, 2.5})),
+            *cubeTwo = new OrientedBox(Matrix4x4f::translate({-2.5, 2.5, -2.5}));
+
+    Material cubeMaterial;
+    cubeMaterial.n = 16;
+    cubeMaterial.color = {108.0f / 255, 216.0f / 255, 212.0f / 255};
+    cubeOne->materialId = materials.add(cubeMaterial);
+    cubeMaterial.color = {216.0f / 255, 108.0f / 255, 112.0f / 255};
+    cubeTwo->materialId = materials.add(cubeMaterial);
 
     objects.pushBack(cubeOne);
     objects.pushBack(cubeTwo);
@@ -1,16 +1,23 @@
 
 #include <cmath>
 
-bool solveQuadratic(const float &a, const float &b, const float &c, float &x0, float &x1) {
-    const float discr = b * b - 4 * a * c;
+#include "Linalg.h"
+
+template<typename T>
+bool solveQuadratic(const T &a, const T &b, const T &c, T &x0, T &x1) {
+    const T discr = b * b - 4 * a * c;
     if (discr < 0)
         return false;
     else if (discr == 0) {
-        x0 = x1 = -0.5f * b / a;
+        x0 = x1 = T(-0.5) * b / a;
     } else {
-        const float q = -0.5f * (b + sqrt(discr) * ((b > 0) * 2 - 1));
+        const T q = T(-0.5) * (b + std::sqrt(discr) * ((b > 0) * 2 - 1));
         x0 = q / a;
         x1 = c / q;
     }
     return true;
 }
+
+template bool solveQuadratic<float>(const float &a, const float &b, const float &c, float &x0, float &x1);
+
+template bool solveQuadratic<double>(const double &a, const double &b, const double &c, double &x0, double &x1);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdio>
+
+/**
+ * Failed EXPECT()s so far; a test returns it from main, so ctest sees any failure
+ */
+inline int &testFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define EXPECT(condition)                                                                  \
+    do {                                                                                   \
+        if (!(condition)) {                                                                \
+            fprintf(stderr, "%s:%d: expected %s\n", __FILE__, __LINE__, #condition);       \
+            testFailures()++;                                                              \
+        }                                                                                  \
+    } while (0)
@@ -0,0 +1,222 @@
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "ImageEncoder.h"
+#include "Check.h"
+
+/**
+ * Deterministic bytes, so a failure reproduces
+ */
+static uint32_t nextRandom(uint32_t &state) {
+    state = state * 1664525 + 1013904223;
+    return state >> 8;
+}
+
+/**
+ * width x height pixels stride apart with runs, repeats, small steps and noise
+ */
+static std::vector<uint32_t> testImage(int width, int height, int stride, uint32_t seed) {
+    std::vector<uint32_t> pixels((size_t) stride * height, 0xdeadbeef);
+    uint8_t pixel[4] = {10, 20, 30, 255};
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const uint32_t random = nextRandom(seed);
+            switch (random % 6) {
+                case 0: break;
+                case 1: pixel[0]++, pixel[2]--; break;
+                case 2: pixel[1] += 20, pixel[0] += 25; break;
+                case 3: pixel[0] = random >> 3, pixel[1] = random >> 11; break;
+                case 4: pixel[3] = random >> 5; break;
+                default: pixel[0] = pixel[1] = pixel[2] = (uint8_t) (x * 7); break;
+            }
+            memcpy(&pixels[(size_t) y * stride + x], pixel, 4);
+        }
+    }
+    return pixels;
+}
+
+static uint32_t readBigEndian(const std::vector<uint8_t> &bytes, size_t offset) {
+    return getBigEndian(bytes.data() + offset);
+}
+
+static uint64_t readLittleEndian(const std::vector<uint8_t> &bytes, size_t offset, int size) {
+    uint64_t value = 0;
+    for (int k = size - 1; k >= 0; k--)
+        value = value << 8 | bytes[offset + k];
+    return value;
+}
+
+/**
+ * Decode an 8-bit RGB PNG as encodePng() writes it, with None and Up filters only
+ * @return false if the file is malformed or uses anything else
+ */
+static bool decodePng(const std::vector<uint8_t> &png, int &width, int &height, std::vector<uint8_t> &rgb) {
+    const uint8_t signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+    if (png.size() < 8 || memcmp(png.data(), signature, 8) != 0)
+        return false;
+    std::vector<uint8_t> data;
+    bool ended = false;
+    for (size_t p = 8; !ended; ) {
+        if (png.size() - p < 12)
+            return false;
+        const uint32_t size = readBigEndian(png, p);
+        if (png.size() - p - 12 < size)
+            return false;
+        const std::string type(png.begin() + (long) p + 4, png.begin() + (long) p + 8);
+        const uint8_t *content = png.data() + p + 8;
+        if (readBigEndian(png, p + 8 + size) != (uint32_t) crc32(0, png.data() + p + 4, size + 4))
+            return false;
+        if (type == "IHDR") {
+            const uint8_t expected[5] = {8, 2, 0, 0, 0};
+            if (size != 13 || memcmp(content + 8, expected, 5) != 0)
+                return false;
+            width = (int) getBigEndian(content);
+            height = (int) getBigEndian(content + 4);
+        } else if (type == "IDAT") {
+            data.insert(data.end(), content, content + size);
+        } else if (type == "IEND") {
+            ended = true;
+        }
+        p += 12 + size;
+    }
+    const size_t rowSize = 1 + (size_t) width * 3;
+    std::vector<uint8_t> filtered(rowSize * height);
+    uLongf size = filtered.size();
+    if (uncompress(filtered.data(), &size, data.data(), data.size()) != Z_OK || size != filtered.size())
+        return false;
+    rgb.assign((size_t) width * height * 3, 0);
+    for (int y = 0; y < height; y++) {
+        const uint8_t filter = filtered[y * rowSize];
+        if (filter != 0 && filter != 2)
+            return false;
+        for (size_t k = 0; k < rowSize - 1; k++) {
+            const uint8_t above = (filter == 2 && y > 0) ? rgb[(y - 1) * (rowSize - 1) + k] : 0;
+            rgb[y * (rowSize - 1) + k] = (uint8_t) (filtered[y * rowSize + 1 + k] + above);
+        }
+    }
+    return true;
+}
+
+static void testPng(ThreadPool &pool) {
+    // strips of kPngStripRows rows are deflated apart, the last one shorter
+    const int width = 37, height = 2 * kPngStripRows + 22, stride = 40;
+    const std::vector<uint32_t> pixels = testImage(width, height, stride, 3);
+    std::vector<uint8_t> png;
+    EXPECT(encodePng(pixels.data(), width, height, stride, 6, pool, png));
+    int decodedWidth = 0, decodedHeight = 0;
+    std::vector<uint8_t> rgb;
+    EXPECT(decodePng(png, decodedWidth, decodedHeight, rgb));
+    EXPECT(decodedWidth == width && decodedHeight == height);
+    bool same = rgb.size() == (size_t) width * height * 3;
+    for (int y = 0; same && y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const auto *pixel = (const uint8_t *) &pixels[(size_t) y * stride + x];
+            same = same && memcmp(pixel, &rgb[((size_t) y * width + x) * 3], 3) == 0;
+        }
+    }
+    EXPECT(same);
+}
+
+static void testHalf() {
+    EXPECT(floatToHalf(1) == 0x3c00);
+    EXPECT(floatToHalf(-2) == 0xc000);
+    EXPECT(floatToHalf(4) == 0x4400);
+    EXPECT(floatToHalf(65504) == 0x7bff);
+    EXPECT(floatToHalf(1e6f) == 0x7c00);
+    EXPECT(floatToHalf(ldexpf(1, -24)) == 0x0001);
+    EXPECT(floatToHalf(ldexpf(1, -25)) == 0x0000);
+    EXPECT(floatToHalf(ldexpf(3, -25)) == 0x0002);
+    EXPECT(floatToHalf(1 + ldexpf(1, -11)) == 0x3c00);
+    EXPECT(floatToHalf(1 + ldexpf(3, -11)) == 0x3c02);
+    EXPECT(floatToHalf(NAN) == 0x7e00);
+}
+
+/**
+ * Undo the ZIP compression of an OpenEXR block: inflate, then the byte deltas, then the split of low and high bytes
+ */
+static bool unzipExrBlock(const uint8_t *data, size_t size, size_t rawSize, std::vector<uint8_t> &raw) {
+    raw.assign(data, data + size);
+    if (size == rawSize)
+        return true;
+    std::vector<uint8_t> predicted(rawSize);
+    uLongf inflated = rawSize;
+    if (uncompress(predicted.data(), &inflated, data, size) != Z_OK || inflated != rawSize)
+        return false;
+    for (size_t i = 1; i < predicted.size(); i++)
+        predicted[i] = (uint8_t) (predicted[i - 1] + predicted[i] - 128);
+    const size_t half = (rawSize + 1) / 2;
+    raw.resize(rawSize);
+    for (size_t i = 0; i < rawSize; i++)
+        raw[i] = predicted[(i & 1) ? half + i / 2 : i / 2];
+    return true;
+}
+
+static void testExr(ThreadPool &pool) {
+    const int width = 23, height = 2 * kExrBlockRows + 8;
+    for (bool noise : {false, true}) {
+        std::vector<RGBColor> colors((size_t) width * height);
+        uint32_t seed = 4;
+        for (size_t k = 0; k < colors.size(); k++) {
+            if (noise)
+                colors[k] = RGBColor((float) nextRandom(seed) / 1e4f, -(float) nextRandom(seed) / 1e6f, 0.1f);
+            else
+                colors[k] = RGBColor(4, (float) (k % width) / width, 0.5f);
+        }
+        std::vector<uint8_t> exr;
+        EXPECT(encodeExr(colors.data(), width, height, 6, pool, exr));
+        EXPECT(exr.size() > 8 && readLittleEndian(exr, 0, 4) == 20000630);
+
+        // attributes are a name, a type, a size and the value, up to an empty name
+        size_t p = 8;
+        bool zip = false;
+        while (p < exr.size() && exr[p] != 0) {
+            const std::string name((const char *) &exr[p]);
+            p += name.size() + 1;
+            const std::string type((const char *) &exr[p]);
+            p += type.size() + 1;
+            const size_t size = readLittleEndian(exr, p, 4);
+            p += 4;
+            if (name == "compression")
+                zip = size == 1 && exr[p] == 3;
+            if (name == "dataWindow")
+                EXPECT(readLittleEndian(exr, p + 8, 4) == (uint64_t) width - 1 &&
+                       readLittleEndian(exr, p + 12, 4) == (uint64_t) height - 1);
+            p += size;
+        }
+        EXPECT(zip);
+        p++;
+
+        const size_t blocks = (height + kExrBlockRows - 1) / kExrBlockRows;
+        bool same = true;
+        for (size_t block = 0; block < blocks; block++) {
+            const size_t offset = readLittleEndian(exr, p + block * 8, 8);
+            const int y0 = (int) readLittleEndian(exr, offset, 4), rows = min(kExrBlockRows, height - y0);
+            const size_t size = readLittleEndian(exr, offset + 4, 4);
+            EXPECT(y0 == (int) block * kExrBlockRows && offset + 8 + size <= exr.size());
+            std::vector<uint8_t> raw;
+            EXPECT(unzipExrBlock(&exr[offset + 8], size, (size_t) rows * width * 6, raw));
+            for (int y = 0; same && y < rows; y++) {
+                for (int channel = 0; channel < 3; channel++) {
+                    for (int x = 0; x < width; x++) {
+                        const size_t at = ((size_t) y * 3 + channel) * width * 2 + x * 2;
+                        const float value = colors[(size_t) (y0 + y) * width + x][2 - channel];
+                        same = same && readLittleEndian(raw, at, 2) == floatToHalf(value);
+                    }
+                }
+            }
+        }
+        EXPECT(same);
+    }
+}
+
+int main() {
+    ThreadPool pool(4);
+    testPng(pool);
+    testHalf();
+    testExr(pool);
+    return testFailures();
+}
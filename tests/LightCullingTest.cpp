@@ -0,0 +1,43 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Raycasting.h"
+#include "KernelVariants.h"
+#include "Check.h"
+
+static bool sameIndices(const LightList &list, const std::vector<uint32_t> &expected) {
+    return list.count == expected.size() && std::equal(expected.begin(), expected.end(), list.indices);
+}
+
+/**
+ * The demo's intensity-2000 point lights reach a bounded distance, and tiles beyond it don't shade them
+ */
+int main() {
+    const SceneOptions options;
+    const PointLight demo(Vec3f(0), 1, 2000);
+    const float radius = demo.influenceRadius(options.lightCutoff);
+    EXPECT(radius > 150 && radius < 250);
+    EXPECT(fabs(2000 / (4 * M_PI * radius * radius) - options.lightCutoff) < 1e-3f * options.lightCutoff);
+
+    FastList<HittableObject *> objects;
+    FastList<Light *> lights;
+    MaterialTable materials;
+    for (const Vec3f &position : {Vec3f(0, 5, 0), Vec3f(1000, 5, 0), Vec3f(0, 5, -150), Vec3f(0, 5, 300)})
+        lights.pushBack(new PointLight(position, 1, 2000));
+    {
+        const SceneSnapshot scene(options, objects, lights, materials);
+        std::vector<uint32_t> storage;
+        EXPECT(sameIndices(cullLights(scene, Vec3f(-1, 0, -1), Vec3f(1, 0, 1), storage), {0, 2}));
+        EXPECT(sameIndices(cullLights(scene, Vec3f(999, 0, -1), Vec3f(1001, 0, 1), storage), {1}));
+        EXPECT(sameIndices(cullLights(scene, Vec3f(-1, 0, 100), Vec3f(1, 0, 140), storage), {0, 3}));
+        EXPECT(sameIndices(cullLights(scene, Vec3f(500, 0, 500), Vec3f(510, 0, 510), storage), {}));
+    }
+    for (size_t i = lights.begin(); i != lights.end(); lights.nextIterator(&i)) {
+        Light *light = nullptr;
+        lights.get(i, &light);
+        delete light;
+    }
+    return testFailures();
+}
@@ -0,0 +1,208 @@
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "MeshLoader.h"
+#include "Check.h"
+
+/**
+ * Parse text the way loadMesh() does, from a buffer terminated with a zero
+ */
+static bool parseMesh(const std::string &text, bool ply, ThreadPool &pool, MeshData &mesh) {
+    std::vector<char> bytes(text.begin(), text.end());
+    bytes.push_back(0);
+    const char *begin = bytes.data(), *end = bytes.data() + text.size();
+    return ply ? PlyParser(begin, end, mesh, pool).parse() : parseObj(begin, end, mesh, pool);
+}
+
+static bool parseMesh(const std::string &text, bool ply, ThreadPool &pool) {
+    MeshData mesh;
+    return parseMesh(text, ply, pool, mesh);
+}
+
+/**
+ * Every prefix of text parses without crashing, and an accepted one only references its vertices
+ * @return how many prefixes were accepted
+ */
+static int parsePrefixes(const std::string &text, size_t from, bool ply, ThreadPool &pool) {
+    int accepted = 0;
+    for (size_t size = from; size < text.size(); size++) {
+        MeshData mesh;
+        if (!parseMesh(text.substr(0, size), ply, pool, mesh))
+            continue;
+        accepted++;
+        EXPECT(mesh.indices.size() % 3 == 0);
+        for (uint32_t index : mesh.indices)
+            EXPECT(index < mesh.vertices.size());
+    }
+    return accepted;
+}
+
+static void testObj(ThreadPool &pool) {
+    const std::string text = "# square\nv 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nvn 0 0 1\n"
+                             "f 1//1 2//1 3//1 4//1\nf -4 -2 -1\n";
+    MeshData mesh;
+    EXPECT(parseMesh(text, false, pool, mesh));
+    EXPECT(mesh.vertices.size() == 4);
+    EXPECT(mesh.vertices[2][0] == 1 && mesh.vertices[2][1] == 1);
+    const std::vector<uint32_t> indices = {0, 1, 2, 0, 2, 3, 0, 2, 3};
+    EXPECT(mesh.indices == indices);
+
+    EXPECT(!parseMesh("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 4\n", false, pool));
+    EXPECT(!parseMesh("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 0 1 2\n", false, pool));
+    EXPECT(!parseMesh("v 0 0 0\nv 1 0 0\nf -3 -2 -1\n", false, pool));
+    EXPECT(!parseMesh("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 -9223372036854775808\n", false, pool));
+    EXPECT(!parseMesh("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 99999999999999999999\n", false, pool));
+    // coordinates missing from a line are not taken from the next one
+    EXPECT(!parseMesh("v 0 0\n1 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n", false, pool));
+    EXPECT(!parseMesh("v 0 0 0\nv 1 0 0\nv 0 1\n", false, pool));
+    parsePrefixes(text, 0, false, pool);
+
+    // relative indices of faces in later chunks resolve against the vertices of earlier ones
+    std::string large;
+    const size_t triangles = 2 * kMeshTextChunk / 30;
+    for (size_t k = 0; k < triangles; k++)
+        large += "v " + std::to_string(k) + " 0 0\nv 0 1 0\nv 0 0 1\nf -3 -2 -1\n";
+    EXPECT(large.size() > 2 * kMeshTextChunk);
+    MeshData chunked;
+    EXPECT(parseMesh(large, false, pool, chunked));
+    EXPECT(chunked.getTrianglesCount() == triangles);
+    bool sequential = true;
+    for (size_t k = 0; k < chunked.indices.size(); k++)
+        sequential = sequential && chunked.indices[k] == k;
+    EXPECT(sequential);
+    EXPECT(chunked.vertices[3 * (triangles - 1)][0] == (float) (triangles - 1));
+}
+
+static const char *const kAsciiPlyHeader =
+        "ply\nformat ascii 1.0\ncomment unit square\nelement vertex 4\nproperty float x\nproperty float y\n"
+        "property float z\nproperty uchar red\nelement face 2\nproperty list uchar int vertex_indices\nend_header\n";
+
+static void testAsciiPly(ThreadPool &pool) {
+    const std::string header = kAsciiPlyHeader;
+    const std::string text = header + "0 0 0 9\n1 0 0 9\n1 1 0 9\n0 1 0 9\n4 0 1 2 3\n3 0 2 3\n";
+    MeshData mesh;
+    EXPECT(parseMesh(text, true, pool, mesh));
+    EXPECT(mesh.vertices.size() == 4);
+    EXPECT(mesh.vertices[1][0] == 1 && mesh.vertices[3][1] == 1);
+    const std::vector<uint32_t> indices = {0, 1, 2, 0, 2, 3, 0, 2, 3};
+    EXPECT(mesh.indices == indices);
+
+    // values missing from a line are not taken from the next one
+    EXPECT(!parseMesh(header + "0 0\n0 1 0 9\n1 1 0 9\n0 1 0 9\n4 0 1 2 3\n3 0 2 3\n", true, pool));
+    EXPECT(!parseMesh(header + "0 0 0 9\n1 0 0 9\n1 1 0 9\n0 1 0 9\n4 0 1 2\n3 0 2 3\n", true, pool));
+    EXPECT(!parseMesh(header + "0 0 0 9\n1 0 0 9\n1 1 0 9\n0 1 0 9\n200 0 1 2\n3 0 2 3\n", true, pool));
+    EXPECT(!parseMesh(header + "0 0 0 9\n1 0 0 9\n1 1 0 9\n0 1 0 9\n4 0 1 2 4\n3 0 2 3\n", true, pool));
+    EXPECT(!parseMesh(header + "0 0 0 9\n1 0 0 9\n1 1 0 9\n0 1 0 9\n4 0 1 2 3\n3 0 -1 3\n", true, pool));
+    EXPECT(!parseMesh(header + "0 0 0 9\n1 0 0 9\n1 1 0 9\n0 1 0 9\n4 0 1 2 3\n3 0 1.5 3\n", true, pool));
+    std::string huge = text;
+    huge.replace(huge.find("vertex 4"), 8, "vertex 4000000000000");
+    EXPECT(!parseMesh(huge, true, pool));
+    EXPECT(parsePrefixes(text, 0, true, pool) <= 2);
+}
+
+static void putValue(std::string &out, const void *value, size_t size, bool bigEndian) {
+    const auto *bytes = (const char *) value;
+    for (size_t k = 0; k < size; k++)
+        out.push_back(bytes[bigEndian ? size - 1 - k : k]);
+}
+
+/**
+ * A binary PLY with 3 vertices, 2 faces with a flag before the list, and an extra element of lists
+ * @param header - set to the size of the header
+ */
+static std::string binaryPly(bool bigEndian, size_t &header) {
+    std::string text = std::string("ply\nformat ") + (bigEndian ? "binary_big_endian" : "binary_little_endian") +
+                       " 1.0\nelement vertex 3\nproperty float x\nproperty float y\nproperty double z\n"
+                       "element face 2\nproperty uchar flags\nproperty list uchar uint vertex_indices\n"
+                       "element extra 1\nproperty list int uchar data\nend_header\n";
+    header = text.size();
+    for (int v = 0; v < 3; v++) {
+        const float x = v == 1, y = v == 2;
+        const double z = v;
+        putValue(text, &x, 4, bigEndian);
+        putValue(text, &y, 4, bigEndian);
+        putValue(text, &z, 8, bigEndian);
+    }
+    for (int face = 0; face < 2; face++) {
+        text.push_back(7);
+        text.push_back(3);
+        for (uint32_t index = 0; index < 3; index++) {
+            const uint32_t value = face == 0 ? index : 2 - index;
+            putValue(text, &value, 4, bigEndian);
+        }
+    }
+    const int32_t count = 2;
+    putValue(text, &count, 4, bigEndian);
+    text += "ab";
+    return text;
+}
+
+static void testBinaryPly(ThreadPool &pool) {
+    for (bool bigEndian : {false, true}) {
+        size_t header = 0;
+        const std::string text = binaryPly(bigEndian, header);
+        MeshData mesh;
+        EXPECT(parseMesh(text, true, pool, mesh));
+        EXPECT(mesh.vertices.size() == 3);
+        EXPECT(mesh.vertices[1][0] == 1 && mesh.vertices[2][1] == 1 && mesh.vertices[2][2] == 2);
+        const std::vector<uint32_t> indices = {0, 1, 2, 2, 1, 0};
+        EXPECT(mesh.indices == indices);
+
+        EXPECT(parsePrefixes(text, 0, true, pool) == 0);
+        std::string index = text;
+        index[header + 48 + 1 + (bigEndian ? 4 : 1)] = 5;
+        EXPECT(!parseMesh(index, true, pool));
+        std::string list = text;
+        list[header + 48 + 1] = (char) 255;
+        EXPECT(!parseMesh(list, true, pool));
+        // indices out of range, negative or not integers are rejected before they are cast
+        std::string huge = text;
+        memset(&huge[header + 48 + 2], 0xff, 4);
+        EXPECT(!parseMesh(huge, true, pool));
+        std::string signedIndex = huge;
+        signedIndex.replace(signedIndex.find("uchar uint"), 10, "uchar int ");
+        EXPECT(!parseMesh(signedIndex, true, pool));
+        std::string floatIndex = text;
+        floatIndex.replace(floatIndex.find("uchar uint"), 10, "uchar float");
+        EXPECT(!parseMesh(floatIndex, true, pool));
+        std::string negative = text;
+        const int32_t count = -5;
+        negative.resize(text.size() - 6);
+        putValue(negative, &count, 4, bigEndian);
+        negative += "ab";
+        EXPECT(!parseMesh(negative, true, pool));
+    }
+    EXPECT(!parseMesh("ply\nformat binary_little_endian 1.0\nelement vertex 3\nproperty float x\n"
+                      "property quad y\nend_header\n", true, pool));
+}
+
+/**
+ * loadMesh() of a file that fills whole pages and ends inside a number, so parsing stops on the zero after the mapping
+ */
+static void testMappedFile(ThreadPool &pool) {
+    const std::string path = "/tmp/MeshLoaderTest." + std::to_string(getpid()) + ".obj";
+    const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    std::string text = "v 0 0 0\nv 1 0 0\nv 0 1 0\n#";
+    text.append(page - text.size() - 8, '-');
+    text += "\nf 1 2 3";
+    EXPECT(text.size() == page);
+    FILE *file = fopen(path.c_str(), "wb");
+    EXPECT(file != nullptr && fwrite(text.data(), 1, text.size(), file) == text.size());
+    if (file != nullptr)
+        fclose(file);
+    const std::shared_ptr<MeshData> mesh = loadMesh(path.c_str(), pool);
+    EXPECT(mesh != nullptr && mesh->vertices.size() == 3 && mesh->getTrianglesCount() == 1);
+    remove(path.c_str());
+    EXPECT(loadMesh(path.c_str(), pool) == nullptr);
+}
+
+int main() {
+    ThreadPool pool(4);
+    testObj(pool);
+    testAsciiPly(pool);
+    testBinaryPly(pool);
+    testMappedFile(pool);
+    return testFailures();
+}
@@ -0,0 +1,51 @@
+#include <cstdint>
+#include <cstdlib>
+
+#include "Raycasting.h"
+#include "KernelVariants.h"
+#include "Check.h"
+
+/**
+ * occludedBatch() blocks exactly the rays occluded() does, for any set of active rays
+ */
+int main() {
+    srand(1);
+    auto random = []() {
+        return (float) rand() / (float) RAND_MAX;
+    };
+    FastList<HittableObject *> objects;
+    for (int k = 0; k < 40; k++) {
+        const Vec3f center(random() * 40 - 20, random() * 40 - 20, random() * 40 - 20);
+        objects.pushBack(new Sphere(center, 0.5f + random() * 2));
+    }
+    const SceneBVH geometry(objects);
+
+    size_t blockedRays = 0;
+    for (int batch = 0; batch < 50; batch++) {
+        const Vec3f orig(random() * 10 - 5, random() * 10 - 5, random() * 10 - 5);
+        Vec3f dirs[64];
+        float distances[64];
+        for (int i = 0; i < 64; i++) {
+            dirs[i] = Vec3f(random() * 2 - 1, random() * 2 - 1, random() * 2 - 1);
+            dirs[i].normalize();
+            distances[i] = i % 5 == 0 ? kInfinity : random() * 30;
+        }
+        const uint64_t active = batch % 2 == 0 ? ~0ull : (uint64_t) rand() << 32 | (uint64_t) rand();
+        const uint64_t blocked = occludedBatch(orig, dirs, distances, active, geometry);
+        uint64_t expected = 0;
+        for (int i = 0; i < 64; i++) {
+            if ((active >> i & 1) && occluded(orig, dirs[i], distances[i], geometry))
+                expected |= 1ull << i;
+        }
+        EXPECT(blocked == expected);
+        blockedRays += __builtin_popcountll(blocked);
+    }
+    EXPECT(blockedRays > 0);
+
+    for (size_t i = objects.begin(); i != objects.end(); objects.nextIterator(&i)) {
+        HittableObject *object = nullptr;
+        objects.get(i, &object);
+        delete object;
+    }
+    return testFailures();
+}
@@ -0,0 +1,195 @@
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Raycasting.h"
+#include "RenderServer.h"
+#include "RenderClient.h"
+#include "KernelVariants.h"
+#include "Check.h"
+
+/**
+ * Connected pair of local sockets standing in for a client and a server
+ */
+static bool openPair(int fds[2]) {
+    return socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0;
+}
+
+/**
+ * Write bytes to one end of a fresh pair, close it and receive a message at the other end
+ */
+static bool receiveBytes(const std::vector<uint8_t> &bytes, MessageType &type, std::vector<uint8_t> &payload) {
+    int fds[2];
+    if (!openPair(fds))
+        return false;
+    const bool sent = sendAll(fds[0], bytes.data(), bytes.size());
+    close(fds[0]);
+    const bool received = receiveMessage(fds[1], type, payload);
+    close(fds[1]);
+    return sent && received;
+}
+
+static void testRoundTrip() {
+    int fds[2];
+    EXPECT(openPair(fds));
+    const CameraMessage camera = {3, 0.25f};
+    EXPECT(sendMessage(fds[0], MessageType::Camera, camera));
+    EXPECT(sendMessage(fds[0], MessageType::Ack, nullptr, 0));
+    MessageType type = MessageType::Hello;
+    std::vector<uint8_t> payload;
+    CameraMessage received = {};
+    EXPECT(receiveMessage(fds[1], type, payload));
+    EXPECT(type == MessageType::Camera && readMessage(payload, received));
+    EXPECT(received.move == 3 && received.step == 0.25f);
+    EXPECT(receiveMessage(fds[1], type, payload));
+    EXPECT(type == MessageType::Ack && payload.empty());
+    // the wrong message type for the payload size
+    AckMessage ack = {};
+    EXPECT(!readMessage(payload, ack));
+    close(fds[0]);
+    EXPECT(!receiveMessage(fds[1], type, payload));
+    close(fds[1]);
+}
+
+static void testTruncation() {
+    const LightMessage light = {2, 1, 0.5f, 0, 3};
+    std::vector<uint8_t> message;
+    appendRecord(message, MessageHeader{(uint32_t) MessageType::Light, sizeof(light)});
+    appendRecord(message, light);
+    MessageType type;
+    std::vector<uint8_t> payload;
+    EXPECT(receiveBytes(message, type, payload));
+    LightMessage received = {};
+    EXPECT(type == MessageType::Light && readMessage(payload, received) && received.intensity == 3);
+    // the peer closing anywhere inside the header or the payload
+    int accepted = 0;
+    for (size_t size = 0; size < message.size(); size++)
+        accepted += receiveBytes(std::vector<uint8_t>(message.begin(), message.begin() + (long) size), type, payload);
+    EXPECT(accepted == 0);
+}
+
+static void testLimits() {
+    std::vector<uint8_t> oversized;
+    appendRecord(oversized, MessageHeader{(uint32_t) MessageType::Frame, kMaxMessageSize + 1});
+    oversized.resize(oversized.size() + 64);
+    MessageType type;
+    std::vector<uint8_t> payload;
+    EXPECT(!receiveBytes(oversized, type, payload));
+    std::vector<uint8_t> huge;
+    appendRecord(huge, MessageHeader{(uint32_t) MessageType::Frame, 0xffffffff});
+    EXPECT(!receiveBytes(huge, type, payload));
+
+    EXPECT(frameFitsMessage(1, 1));
+    EXPECT(frameFitsMessage(8192, kMaxMessageSize / 4 / 8192));
+    EXPECT(!frameFitsMessage(8192, kMaxMessageSize / 4 / 8192 + 1));
+    EXPECT(!frameFitsMessage(0, 600));
+    EXPECT(!frameFitsMessage(800, 0));
+    // the product doesn't wrap around in 32 bits
+    EXPECT(!frameFitsMessage(0x10000, 0x10000));
+    EXPECT(!frameFitsMessage(0xffffffff, 0xffffffff));
+}
+
+static bool sameFrame(const RenderClient &client, SDL_Surface *surface) {
+    const std::vector<uint32_t> &pixels = client.getPixels();
+    if (client.getWidth() != surface->w || client.getHeight() != surface->h)
+        return false;
+    for (int y = 0; y < surface->h; y++) {
+        if (memcmp(&pixels[(size_t) y * surface->w], getPixelPtr(surface, 0, y), surface->w * 4) != 0)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * A server and a client talking over a local socket: a full frame, then only the tile that changed,
+ * a camera move applied to the scene, and the server noticing the client leave
+ */
+static void testLoopback(ThreadPool &pool) {
+    const std::string address = "unix:/tmp/RayCasterTest." + std::to_string(getpid());
+    RenderServer server(1);
+    EXPECT(server.listen(address.c_str()));
+    SceneOptions options;
+    MaterialTable materials;
+    FastList<Light *> lights;
+    bool paused = false;
+    SDL_Surface *surface = createSurface(70, 40);
+    {
+        RenderClient client;
+        EXPECT(client.connect(address.c_str(), 70, 40));
+        EXPECT(server.acceptClient());
+        EXPECT(server.getWidth() == 70 && server.getHeight() == 40);
+
+        for (int y = 0; y < surface->h; y++) {
+            for (int x = 0; x < surface->w; x++)
+                *getPixelPtr(surface, x, y) = ColorToUint(x * 3, y * 5, (x * y) & 0xff, 255);
+        }
+        EXPECT(server.sendFrame(surface, 1, pool));
+        EXPECT(!server.canSend());
+        EXPECT(client.receiveFrame());
+        EXPECT(client.getFrame() == 1 && client.getLastTiles() == 6);
+        EXPECT(sameFrame(client, surface));
+        server.poll(1000, options, materials, lights, paused);
+        EXPECT(server.canSend());
+
+        *getPixelPtr(surface, 65, 35) = ColorToUint(1, 2, 3, 255);
+        EXPECT(server.sendFrame(surface, 2, pool));
+        EXPECT(client.receiveFrame());
+        EXPECT(client.getFrame() == 2 && client.getLastTiles() == 1);
+        EXPECT(sameFrame(client, surface));
+
+        const Vec3d eye = options.eye;
+        EXPECT(client.sendCameraMove(CameraMove::Forward, 2));
+        EXPECT(client.sendCameraMove(CameraMove::Pause, 0));
+        server.poll(1000, options, materials, lights, paused);
+        EXPECT(paused && (options.eye - eye).length() == 2);
+        EXPECT(server.canSend());
+    }
+    server.poll(1000, options, materials, lights, paused);
+    EXPECT(!server.hasClient());
+    SDL_FreeSurface(surface);
+    unlink(address.c_str() + 5);
+}
+
+/**
+ * Workers that built the same scene agree on its SceneHash, any change to it shows
+ */
+static void testSceneHash() {
+    auto hash = [](const Vec3f &center, const RGBColor &lightColor, uint32_t materialId) {
+        SceneOptions options;
+        MaterialTable materials;
+        Material material;
+        material.color = {1, 0, 0};
+        materials.add(material);
+        FastList<HittableObject *> objects = {};
+        FastList<Light *> lights = {};
+        auto *sphere = new Sphere(center, 1);
+        sphere->materialId = materialId;
+        objects.pushBack(sphere);
+        lights.pushBack(new PointLight(Vec3f(0, 5, 0), lightColor, 10));
+        const uint64_t value = SceneHash(options, objects, lights, materials).getValue();
+        delete sphere;
+        Light *light = nullptr;
+        lights.get(lights.begin(), &light);
+        delete light;
+        return value;
+    };
+    const uint64_t scene = hash(Vec3f(0, 0, -5), 1, 1);
+    EXPECT(hash(Vec3f(0, 0, -5), 1, 1) == scene);
+    EXPECT(hash(Vec3f(0, 0.001f, -5), 1, 1) != scene);
+    EXPECT(hash(Vec3f(0, 0, -5), Vec3f(1, 1, 0.5f), 1) != scene);
+    EXPECT(hash(Vec3f(0, 0, -5), 1, 0) != scene);
+}
+
+int main() {
+    ThreadPool pool(4);
+    testRoundTrip();
+    testTruncation();
+    testLimits();
+    testLoopback(pool);
+    testSceneHash();
+    return testFailures();
+}
@@ -0,0 +1,111 @@
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Qoi.h"
+#include "TileCodec.h"
+#include "Check.h"
+
+/**
+ * Deterministic bytes, so a failure reproduces
+ */
+static uint32_t nextRandom(uint32_t &state) {
+    state = state * 1664525 + 1013904223;
+    return state >> 8;
+}
+
+/**
+ * width x height pixels stride apart with runs, repeats, small steps and noise, so every QOI op is used
+ */
+static std::vector<uint32_t> testImage(int width, int height, int stride, uint32_t seed) {
+    std::vector<uint32_t> pixels((size_t) stride * height, 0xdeadbeef);
+    uint8_t pixel[4] = {10, 20, 30, 255};
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const uint32_t random = nextRandom(seed);
+            switch (random % 6) {
+                case 0: break;
+                case 1: pixel[0]++, pixel[2]--; break;
+                case 2: pixel[1] += 20, pixel[0] += 25; break;
+                case 3: pixel[0] = random >> 3, pixel[1] = random >> 11; break;
+                case 4: pixel[3] = random >> 5; break;
+                default: pixel[0] = pixel[1] = pixel[2] = (uint8_t) (x * 7); break;
+            }
+            memcpy(&pixels[(size_t) y * stride + x], pixel, 4);
+        }
+    }
+    return pixels;
+}
+
+static bool sameRectangle(const uint32_t *a, const uint32_t *b, int width, int height, int strideA, int strideB) {
+    for (int y = 0; y < height; y++) {
+        if (memcmp(a + (size_t) y * strideA, b + (size_t) y * strideB, (size_t) width * 4) != 0)
+            return false;
+    }
+    return true;
+}
+
+static void testQoi() {
+    const int width = 45, height = 31, stride = 50;
+    const std::vector<uint32_t> pixels = testImage(width, height, stride, 1);
+    std::vector<uint8_t> encoded;
+    encodeQoi(pixels.data(), width, height, stride, encoded);
+    std::vector<uint32_t> decoded((size_t) width * height);
+    EXPECT(decodeQoi(encoded.data(), encoded.size(), decoded.data(), width, height, width));
+    EXPECT(sameRectangle(pixels.data(), decoded.data(), width, height, stride, width));
+
+    EXPECT(!decodeQoi(encoded.data(), encoded.size(), decoded.data(), width - 1, height, width));
+    EXPECT(!decodeQoi(encoded.data(), encoded.size(), decoded.data(), width, height + 1, width));
+    // every op is before the padding, so no prefix holds the whole image
+    int accepted = 0;
+    for (size_t size = 0; size < encoded.size(); size++) {
+        const std::vector<uint8_t> prefix(encoded.begin(), encoded.begin() + (long) size);
+        accepted += decodeQoi(prefix.data(), prefix.size(), decoded.data(), width, height, width);
+    }
+    EXPECT(accepted == 0);
+    // corrupted bytes may decode to other pixels, but never past the data or the image
+    for (size_t k = 14; k < encoded.size(); k++) {
+        std::vector<uint8_t> corrupted = encoded;
+        corrupted[k] ^= 0xa5;
+        decodeQoi(corrupted.data(), corrupted.size(), decoded.data(), width, height, width);
+    }
+}
+
+static void testTiles() {
+    const int stride = 64;
+    // the gradient compresses, the noise is sent raw
+    std::vector<uint32_t> smooth((size_t) stride * 16), noise((size_t) stride * 16);
+    uint32_t seed = 2;
+    for (size_t k = 0; k < smooth.size(); k++) {
+        smooth[k] = 0xff000000 | (uint32_t) (k % stride) * 0x010101;
+        noise[k] = nextRandom(seed) ^ nextRandom(seed) << 8;
+    }
+    for (const std::vector<uint32_t> *pixels : {&smooth, &noise}) {
+        std::vector<uint8_t> out;
+        appendEncodedTile(out, pixels->data() + 3, 3, 5, 17, 11, stride);
+        TileMessage tile = {};
+        EXPECT(readMessage(std::vector<uint8_t>(out.begin(), out.begin() + sizeof(tile)), tile));
+        EXPECT(tile.x == 3 && tile.y == 5 && tile.width == 17 && tile.height == 11);
+        EXPECT(tile.size == out.size() - sizeof(tile));
+        EXPECT(tile.encoding == (uint32_t) (pixels == &smooth ? TileEncoding::Qoi : TileEncoding::Raw));
+
+        const uint8_t *data = out.data() + sizeof(tile);
+        std::vector<uint32_t> decoded((size_t) 20 * 11);
+        EXPECT(decodeTile(tile, data, decoded.data(), 20));
+        EXPECT(sameRectangle(pixels->data() + 3, decoded.data(), 17, 11, stride, 20));
+
+        TileMessage truncated = tile;
+        truncated.size--;
+        EXPECT(!decodeTile(truncated, data, decoded.data(), 20));
+        TileMessage unknown = tile;
+        unknown.encoding = 7;
+        EXPECT(!decodeTile(unknown, data, decoded.data(), 20));
+    }
+}
+
+int main() {
+    testQoi();
+    testTiles();
+    return testFailures();
+}